@@ -31,6 +31,9 @@ public:
 	size_t getWaveFrontSize() {
 		return 64;
 	}
+	size_t getLanesPerComputeUnit() {
+		return 64;
+	}
 	cl_uint getVendorId(){
 		return vendorIdAMD;
 	}
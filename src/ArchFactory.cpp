@@ -32,7 +32,7 @@ IArch* ArchFactory::getArchitecture(cl_uint vendorId){
     case vendorIdXILINX:
         return new ArchXILINX();
 	default:
-		return nullptr;
+		return new ArchGeneric(vendorId);
 	}
 }
 
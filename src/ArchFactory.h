@@ -30,6 +30,7 @@
 #include "ArchNVD.h"
 #include "ArchINTL.h"
 #include "ArchXILINX.h"
+#include "ArchGeneric.h"
 
 namespace ltk {
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include "IArch.h"
+
+namespace ltk {
+
+// architecture for vendors without specific support, e.g. POCL
+class ArchGeneric: public IArch {
+
+public:
+	ArchGeneric(cl_uint vendorId) : vendorId(vendorId) {
+	}
+	size_t getWaveFrontSize() {
+		return 1;
+	}
+	size_t getLanesPerComputeUnit() {
+		return 0;
+	}
+	cl_uint getVendorId(){
+		return vendorId;
+	}
+  std::string getBuildOptions(){
+      return "";
+  }
+private:
+	cl_uint vendorId;
+};
+
+}
@@ -31,6 +31,9 @@ public:
 	size_t getWaveFrontSize() {
 		return 128;
 	}
+	size_t getLanesPerComputeUnit() {
+		return 8;
+	}
 	cl_uint getVendorId(){
 		return vendorIdINTL;
 	}
@@ -31,6 +31,9 @@ public:
 	size_t getWaveFrontSize() {
 		return 32;
 	}
+	size_t getLanesPerComputeUnit() {
+		return 128;
+	}
 	cl_uint getVendorId(){
 		return vendorIdNVD;
 	}
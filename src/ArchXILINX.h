@@ -31,6 +31,9 @@ public:
 	size_t getWaveFrontSize() {
 		return 1;
 	}
+	size_t getLanesPerComputeUnit() {
+		return 0;
+	}
 	cl_uint getVendorId(){
 		return vendorIdXILINX;
 	}
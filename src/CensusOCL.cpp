@@ -0,0 +1,181 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "CensusOCL.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+
+namespace ltk {
+
+CensusSiteOCL::CensusSiteOCL(CensusType type, const std::string &name) :
+		type(type), name(name), created(0), live(0) {
+}
+
+namespace {
+
+struct Registry {
+	Registry() : stopping(false) {
+	}
+	std::mutex sitesMutex;
+	std::vector<std::unique_ptr<CensusSiteOCL>> sites;
+
+	std::mutex dumpMutex;
+	std::condition_variable dumpCondition;
+	bool stopping;
+	std::thread dumper;
+};
+
+// never destroyed : objects released during static destruction
+// still hold site pointers
+Registry& registry() {
+	static Registry *instance = new Registry();
+	return *instance;
+}
+
+// stops the dump thread before exit
+struct DumpGuard {
+	~DumpGuard() {
+		CensusOCL::stopDumps();
+	}
+} dumpGuard;
+
+}
+
+CensusSiteOCL* CensusOCL::site(CensusType type, const std::string &name) {
+	auto &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.sitesMutex);
+	for (auto &s : reg.sites) {
+		if (s->type == type && s->name == name)
+			return s.get();
+	}
+	reg.sites.emplace_back(new CensusSiteOCL(type, name));
+	return reg.sites.back().get();
+}
+
+int64_t CensusOCL::getLive(CensusType type) {
+	auto &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.sitesMutex);
+	int64_t rc = 0;
+	for (auto &s : reg.sites) {
+		if (s->type == type)
+			rc += s->live.load(std::memory_order_relaxed);
+	}
+	return rc;
+}
+
+std::vector<CensusOCL::Entry> CensusOCL::snapshot() {
+	auto &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.sitesMutex);
+	std::vector<Entry> rc;
+	for (auto &s : reg.sites)
+		rc.push_back( { s->type, s->name, s->created.load(
+				std::memory_order_relaxed), s->live.load(
+				std::memory_order_relaxed) });
+	return rc;
+}
+
+const char* CensusOCL::typeName(CensusType type) {
+	switch (type) {
+	case CensusContext:
+		return "context";
+	case CensusQueue:
+		return "queue";
+	case CensusProgram:
+		return "program";
+	case CensusKernel:
+		return "kernel";
+	case CensusMem:
+		return "mem";
+	case CensusEvent:
+		return "event";
+	default:
+		return "unknown";
+	}
+}
+
+void CensusOCL::report(std::ostream &out, bool all) {
+	auto entries = snapshot();
+	int64_t live[CensusNumTypes] = { };
+	for (auto &e : entries)
+		live[e.type] += e.live;
+	out << "OpenCL object census at " << (long long) std::time(nullptr) << " :";
+	for (int t = 0; t < CensusNumTypes; ++t)
+		out << " " << typeName((CensusType) t) << "=" << live[t];
+	out << "\n";
+	for (int t = 0; t < CensusNumTypes; ++t) {
+		for (auto &e : entries) {
+			if (e.type != t || (!all && e.live == 0))
+				continue;
+			out << "  " << std::left << std::setw(8) << typeName(e.type)
+					<< std::right << std::setw(8) << e.live << " live "
+					<< std::setw(10) << e.created << " created  " << e.name
+					<< "\n";
+		}
+	}
+	out.flush();
+}
+
+bool CensusOCL::startDumps(const std::string &fileName, uint32_t intervalMs) {
+	stopDumps();
+	std::unique_ptr<std::ofstream> file;
+	if (fileName != "-") {
+		file.reset(new std::ofstream(fileName, std::ios::app));
+		if (!file->good())
+			return false;
+	}
+	auto &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.dumpMutex);
+	reg.stopping = false;
+	auto outFile = file.release();
+	reg.dumper = std::thread([&reg, outFile, intervalMs] {
+		std::unique_ptr<std::ofstream> owned(outFile);
+		std::ostream &out = owned ? *owned : std::cout;
+		std::unique_lock<std::mutex> lk(reg.dumpMutex);
+		while (!reg.dumpCondition.wait_for(lk,
+				std::chrono::milliseconds(intervalMs),
+				[&reg] { return reg.stopping; })) {
+			lk.unlock();
+			report(out);
+			lk.lock();
+		}
+	});
+	return true;
+}
+
+void CensusOCL::stopDumps() {
+	auto &reg = registry();
+	std::thread dumper;
+	{
+		std::lock_guard<std::mutex> lock(reg.dumpMutex);
+		reg.stopping = true;
+		dumper = std::move(reg.dumper);
+	}
+	reg.dumpCondition.notify_all();
+	if (dumper.joinable())
+		dumper.join();
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace ltk {
+
+enum CensusType {
+	CensusContext,
+	CensusQueue,
+	CensusProgram,
+	CensusKernel,
+	CensusMem,
+	CensusEvent,
+	CensusNumTypes
+};
+
+/**
+ * CensusSiteOCL
+ *
+ * Counts of one type of OpenCL object created at one site : total created,
+ * and currently live. Sites are registered with CensusOCL::site() and live
+ * until process exit, so hot paths can cache the pointer.
+ */
+struct CensusSiteOCL {
+	CensusSiteOCL(CensusType type, const std::string &name);
+
+	void add() {
+		created.fetch_add(1, std::memory_order_relaxed);
+		live.fetch_add(1, std::memory_order_relaxed);
+	}
+	void remove() {
+		live.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	const CensusType type;
+	const std::string name;
+	std::atomic<int64_t> created;
+	std::atomic<int64_t> live;
+};
+
+/**
+ * CensusTokenOCL
+ *
+ * Move-only membership of one object in a site : counted live from reset(site)
+ * until the token is reset or destroyed.
+ */
+class CensusTokenOCL {
+public:
+	CensusTokenOCL() : site(nullptr) {
+	}
+	explicit CensusTokenOCL(CensusSiteOCL *site) : site(nullptr) {
+		reset(site);
+	}
+	CensusTokenOCL(CensusTokenOCL &&other) noexcept : site(other.site) {
+		other.site = nullptr;
+	}
+	CensusTokenOCL& operator=(CensusTokenOCL &&other) noexcept {
+		if (this != &other) {
+			reset();
+			site = other.site;
+			other.site = nullptr;
+		}
+		return *this;
+	}
+	CensusTokenOCL(const CensusTokenOCL&) = delete;
+	CensusTokenOCL& operator=(const CensusTokenOCL&) = delete;
+	~CensusTokenOCL() {
+		reset();
+	}
+	void reset(CensusSiteOCL *newSite = nullptr) {
+		if (site)
+			site->remove();
+		site = newSite;
+		if (site)
+			site->add();
+	}
+private:
+	CensusSiteOCL *site;
+};
+
+/**
+ * CensusOCL
+ *
+ * Process wide census of the contexts, queues, programs, kernels, mem objects
+ * and events that latke holds references to, by creation site. A soak test
+ * can dump the census periodically : a live count that keeps growing is a leak,
+ * long before driver resource growth shows up as rising latency.
+ */
+class CensusOCL {
+public:
+	struct Entry {
+		CensusType type;
+		std::string name;
+		int64_t created;
+		int64_t live;
+	};
+
+	// site registered under type and name, created on first use
+	static CensusSiteOCL* site(CensusType type, const std::string &name);
+
+	// live objects of type, over all sites
+	static int64_t getLive(CensusType type);
+	static std::vector<Entry> snapshot();
+	static const char* typeName(CensusType type);
+
+	// live and created counts per site; sites with no live objects are
+	// skipped unless all is set
+	static void report(std::ostream &out, bool all = false);
+
+	// append a report to fileName every intervalMs, from a background thread;
+	// "-" writes to stdout
+	static bool startDumps(const std::string &fileName, uint32_t intervalMs);
+	static void stopDumps();
+};
+
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "CommandSequenceOCL.h"
+#include "KernelOCL.h"
+#include "IDualMemOCL.h"
+#include "UtilOCL.h"
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl_ext.h>
+#else
+#include <CL/cl_ext.h>
+#endif
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+namespace ltk {
+
+#if defined(cl_khr_command_buffer) && defined(CL_VERSION_1_2)
+#define LTK_COMMAND_BUFFERS
+#endif
+
+#ifdef LTK_COMMAND_BUFFERS
+// cl_khr_command_buffer entry points, and command buffers recorded per
+// memory binding : one per kernel segment
+struct CommandBufferSetOCL {
+	CommandBufferSetOCL() :
+			createCommandBuffer(nullptr), finalizeCommandBuffer(nullptr), releaseCommandBuffer(
+					nullptr), enqueueCommandBuffer(nullptr), commandNDRangeKernel(
+					nullptr) {
+	}
+	~CommandBufferSetOCL() {
+		for (auto &entry : buffers) {
+			for (auto buffer : entry.second) {
+				if (buffer)
+					releaseCommandBuffer(buffer);
+			}
+		}
+	}
+	static CommandBufferSetOCL* load(DeviceOCL *device) {
+		auto extensions = device->deviceInfo->extensions;
+		if (!extensions || !strstr(extensions, "cl_khr_command_buffer"))
+			return nullptr;
+		auto platform = device->deviceInfo->platform;
+		auto set = new CommandBufferSetOCL();
+		set->createCommandBuffer =
+				(clCreateCommandBufferKHR_fn) clGetExtensionFunctionAddressForPlatform(
+						platform, "clCreateCommandBufferKHR");
+		set->finalizeCommandBuffer =
+				(clFinalizeCommandBufferKHR_fn) clGetExtensionFunctionAddressForPlatform(
+						platform, "clFinalizeCommandBufferKHR");
+		set->releaseCommandBuffer =
+				(clReleaseCommandBufferKHR_fn) clGetExtensionFunctionAddressForPlatform(
+						platform, "clReleaseCommandBufferKHR");
+		set->enqueueCommandBuffer =
+				(clEnqueueCommandBufferKHR_fn) clGetExtensionFunctionAddressForPlatform(
+						platform, "clEnqueueCommandBufferKHR");
+		set->commandNDRangeKernel =
+				(clCommandNDRangeKernelKHR_fn) clGetExtensionFunctionAddressForPlatform(
+						platform, "clCommandNDRangeKernelKHR");
+		if (!set->createCommandBuffer || !set->finalizeCommandBuffer
+				|| !set->releaseCommandBuffer || !set->enqueueCommandBuffer
+				|| !set->commandNDRangeKernel) {
+			delete set;
+			return nullptr;
+		}
+		return set;
+	}
+
+	clCreateCommandBufferKHR_fn createCommandBuffer;
+	clFinalizeCommandBufferKHR_fn finalizeCommandBuffer;
+	clReleaseCommandBufferKHR_fn releaseCommandBuffer;
+	clEnqueueCommandBufferKHR_fn enqueueCommandBuffer;
+	clCommandNDRangeKernelKHR_fn commandNDRangeKernel;
+	std::map<std::vector<cl_mem>, std::vector<cl_command_buffer_khr> > buffers;
+	// segments that failed to record : replayed without command buffers
+	std::vector<bool> unusable;
+};
+#else
+struct CommandBufferSetOCL {
+	static CommandBufferSetOCL* load(DeviceOCL *device) {
+		(void) device;
+		return nullptr;
+	}
+};
+#endif
+
+CommandSequenceOCL::CommandSequenceOCL(DeviceOCL *device) :
+		device(device), finalized(false), commandBuffers(nullptr) {
+}
+
+CommandSequenceOCL::~CommandSequenceOCL() {
+	delete commandBuffers;
+}
+
+CommandSequenceOCL::StepId CommandSequenceOCL::recordMap(size_t binding) {
+	if (finalized)
+		throw std::runtime_error("Command sequence is finalized");
+	steps.push_back(Step(MapStep, binding));
+
+	return steps.size() - 1;
+}
+
+CommandSequenceOCL::StepId CommandSequenceOCL::recordUnmap(size_t binding) {
+	if (finalized)
+		throw std::runtime_error("Command sequence is finalized");
+	steps.push_back(Step(UnmapStep, binding));
+
+	return steps.size() - 1;
+}
+
+CommandSequenceOCL::StepId CommandSequenceOCL::recordKernel(KernelOCL *kernel,
+		const EnqueueInfoOCL &launch, const KernelArgsOCL &args,
+		const std::vector<MemArg> &memArgs) {
+	if (finalized)
+		throw std::runtime_error("Command sequence is finalized");
+	Step step(KernelStep, 0);
+	step.kernel = kernel;
+	step.launch = launch;
+	step.launch.numWaitEvents = 0;
+	step.launch.needsCompletionEvent = true;
+	step.args = args;
+	step.memArgs = memArgs;
+	steps.push_back(step);
+
+	return steps.size() - 1;
+}
+
+void CommandSequenceOCL::finalize() {
+	if (finalized)
+		return;
+	for (auto &step : steps) {
+		if (step.type != KernelStep)
+			continue;
+		if (!step.kernel || !step.launch.queue)
+			throw std::runtime_error("Kernel step has no kernel or queue");
+		cl_uint numArgs = 0;
+		cl_int error_code = clGetKernelInfo(step.kernel->getKernel(),
+				CL_KERNEL_NUM_ARGS, sizeof(numArgs), &numArgs, nullptr);
+		if (CL_SUCCESS != error_code) {
+			Util::LogError("Error: clGetKernelInfo returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+			throw std::runtime_error("Unable to query kernel arguments");
+		}
+		for (cl_uint i = 0; i < numArgs; ++i) {
+			bool bound = step.args.isSet(i);
+			for (auto &memArg : step.memArgs)
+				bound = bound || memArg.first == i;
+			if (!bound)
+				throw std::runtime_error(
+						"Kernel step argument " + std::to_string(i) + " is not bound");
+		}
+		auto &launch = step.launch;
+		if (launch.dimension < 1 || launch.dimension > 3)
+			throw std::runtime_error("Kernel step has invalid dimension");
+		size_t workGroupSize = 1;
+		for (int d = 0; d < launch.dimension; ++d) {
+			if (launch.global_work_size[d] == 0)
+				throw std::runtime_error("Kernel step has empty global size");
+			if (launch.local_work_size[d]) {
+				if (launch.global_work_size[d] % launch.local_work_size[d])
+					throw std::runtime_error(
+							"Kernel step global size is not a multiple of local size");
+				workGroupSize *= launch.local_work_size[d];
+			}
+		}
+		if (workGroupSize > step.kernel->getWorkGroupSize())
+			throw std::runtime_error("Kernel step local size exceeds kernel limit");
+	}
+
+	// runs of kernels on the same queue can be replayed from a command buffer
+	commandBuffers = CommandBufferSetOCL::load(device);
+	if (commandBuffers) {
+		for (size_t i = 0; i < steps.size();) {
+			if (steps[i].type != KernelStep) {
+				i++;
+				continue;
+			}
+			Segment segment;
+			segment.first = i;
+			segment.count = 0;
+			while (i < steps.size() && steps[i].type == KernelStep
+					&& steps[i].launch.queue == steps[segment.first].launch.queue) {
+				segment.count++;
+				i++;
+			}
+			steps[segment.first].segment = segments.size();
+			segments.push_back(segment);
+		}
+#ifdef LTK_COMMAND_BUFFERS
+		commandBuffers->unusable.assign(segments.size(), false);
+#endif
+	}
+	finalized = true;
+}
+
+bool CommandSequenceOCL::usesCommandBuffers() const {
+	return commandBuffers && !segments.empty();
+}
+
+void CommandSequenceOCL::bindArgs(Step &step, const Replay &replay) {
+	step.kernel->bind(step.args);
+	for (auto &memArg : step.memArgs)
+		step.kernel->setArg(memArg.first, sizeof(cl_mem),
+				replay.bindings[memArg.second]->getDeviceMem());
+}
+
+bool CommandSequenceOCL::enqueueStep(Step &step, Replay &replay, size_t index,
+		const std::vector<cl_event> &waits) {
+	auto numWaits = (cl_uint) waits.size();
+	auto waitList = waits.empty() ? nullptr : waits.data();
+	switch (step.type) {
+	case MapStep:
+		return replay.bindings[step.binding]->map(numWaits, waitList,
+				replay.events[index], false);
+	case UnmapStep:
+		return replay.bindings[step.binding]->unmap(numWaits, waitList,
+				replay.events[index]);
+	case KernelStep: {
+		bindArgs(step, replay);
+		step.launch.numWaitEvents = 0;
+		for (auto evt : waits) {
+			if (!step.launch.pushWaitEvent(evt)) {
+				Util::LogError("Error: kernel step has too many wait events.\n");
+				return false;
+			}
+		}
+		try {
+			step.kernel->enqueue(step.launch);
+		} catch (std::exception &ex) {
+			return false;
+		}
+		replay.events[index] = std::move(step.launch.completionEvent);
+		return true;
+	}
+	}
+	return false;
+}
+
+bool CommandSequenceOCL::enqueueSegment(Segment &segment, Replay &replay,
+		const std::vector<cl_event> &waits) {
+#ifdef LTK_COMMAND_BUFFERS
+	auto segmentIndex = steps[segment.first].segment;
+	if (commandBuffers->unusable[segmentIndex])
+		return false;
+	std::vector<cl_mem> key;
+	for (auto mem : replay.bindings)
+		key.push_back(*mem->getDeviceMem());
+	auto &buffers = commandBuffers->buffers[key];
+	if (buffers.empty())
+		buffers.assign(segments.size(), nullptr);
+	auto queue = steps[segment.first].launch.queue;
+	auto commandQueue = queue->getQueueImpl();
+	if (!buffers[segmentIndex]) {
+		// record : kernel arguments are captured when each command is added
+		cl_int error_code = CL_SUCCESS;
+		auto buffer = commandBuffers->createCommandBuffer(1, &commandQueue,
+				nullptr, &error_code);
+		cl_sync_point_khr syncPoint = 0;
+		for (size_t i = 0;
+				i < segment.count && buffer && CL_SUCCESS == error_code; ++i) {
+			auto &step = steps[segment.first + i];
+			bindArgs(step, replay);
+			auto &launch = step.launch;
+			cl_sync_point_khr previous = syncPoint;
+			error_code = commandBuffers->commandNDRangeKernel(buffer, nullptr,
+					nullptr, step.kernel->getKernel(), (cl_uint) launch.dimension,
+					launch.useOffset ? launch.global_work_offset : nullptr,
+					launch.global_work_size,
+					launch.local_work_size[0] ? launch.local_work_size : nullptr,
+					i ? 1 : 0, i ? &previous : nullptr, &syncPoint, nullptr);
+		}
+		if (buffer && CL_SUCCESS == error_code)
+			error_code = commandBuffers->finalizeCommandBuffer(buffer);
+		if (!buffer || CL_SUCCESS != error_code) {
+			Util::LogError(
+					"Error: recording command buffer returned %s : replaying without command buffers.\n",
+					Util::TranslateOpenCLError(error_code));
+			if (buffer)
+				commandBuffers->releaseCommandBuffer(buffer);
+			commandBuffers->unusable[segmentIndex] = true;
+			return false;
+		}
+		buffers[segmentIndex] = buffer;
+	}
+	cl_event completion = 0;
+	cl_int error_code = commandBuffers->enqueueCommandBuffer(0, nullptr,
+			buffers[segmentIndex], (cl_uint) waits.size(),
+			waits.empty() ? nullptr : waits.data(), &completion);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError(
+				"Error: clEnqueueCommandBufferKHR returned %s : replaying without command buffers.\n",
+				Util::TranslateOpenCLError(error_code));
+		commandBuffers->unusable[segmentIndex] = true;
+		return false;
+	}
+	// keep the steps' label, so profiles match direct launches
+	auto stepLabel = [](const Step &step) {
+		return step.launch.label.empty() ?
+				step.kernel->getKernelName() : step.launch.label;
+	};
+	std::string label = stepLabel(steps[segment.first]);
+	for (size_t i = 1; i < segment.count; ++i) {
+		if (stepLabel(steps[segment.first + i]) != label) {
+			label = "command buffer";
+			break;
+		}
+	}
+	queue->profile(label, completion);
+	if (queue->getCounters())
+		queue->getCounters()->addKernels(segment.count);
+	queue->onEnqueue();
+	// every step in the segment completes with the command buffer
+	static CensusSiteOCL *site = CensusOCL::site(CensusEvent,
+			"CommandSequenceOCL command buffer");
+	for (size_t i = 0; i + 1 < segment.count; ++i)
+		replay.events[segment.first + i] = Event::retain(completion, site);
+	replay.events[segment.first + segment.count - 1] = Event(completion, site);
+	return true;
+#else
+	(void) segment;
+	(void) replay;
+	(void) waits;
+	return false;
+#endif
+}
+
+bool CommandSequenceOCL::replay(Replay &replay, cl_uint numWaitEvents,
+		const cl_event *waitEvents, size_t numSteps) {
+	if (!finalized) {
+		Util::LogError("Error: command sequence replayed before finalize.\n");
+		return false;
+	}
+	for (auto &step : steps) {
+		bool missing = step.type != KernelStep
+				&& step.binding >= replay.bindings.size();
+		for (auto &memArg : step.memArgs)
+			missing = missing || memArg.second >= replay.bindings.size();
+		if (missing) {
+			Util::LogError("Error: command sequence replayed with missing binding.\n");
+			return false;
+		}
+	}
+	numSteps = std::min(numSteps, steps.size());
+	replay.events.resize(steps.size());
+	for (auto &evt : replay.events)
+		evt.reset();
+
+	std::vector<cl_event> waits;
+	for (size_t i = 0; i < numSteps;) {
+		waits.clear();
+		if (i == 0)
+			waits.insert(waits.end(), waitEvents, waitEvents + numWaitEvents);
+		else
+			waits.push_back(replay.events[i - 1].get());
+		if (i < replay.waits.size())
+			waits.insert(waits.end(), replay.waits[i].begin(),
+					replay.waits[i].end());
+		auto &step = steps[i];
+		if (commandBuffers && step.segment != (size_t) -1) {
+			auto &segment = segments[step.segment];
+			// a command buffer can only wait before its first command
+			bool innerWaits = false;
+			for (size_t k = 1; k < segment.count; ++k) {
+				auto index = segment.first + k;
+				innerWaits = innerWaits
+						|| (index < replay.waits.size()
+								&& !replay.waits[index].empty());
+			}
+			if (!innerWaits && segment.first + segment.count <= numSteps
+					&& enqueueSegment(segment, replay, waits)) {
+				i += segment.count;
+				continue;
+			}
+		}
+		if (!enqueueStep(step, replay, i, waits))
+			return false;
+		i++;
+	}
+
+	return true;
+}
+
+}
+#endif
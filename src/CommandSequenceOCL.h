@@ -0,0 +1,132 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "QueueOCL.h"
+#include "EnqueueInfoOCL.h"
+#include "EventOCL.h"
+#include "KernelArgsOCL.h"
+#include <vector>
+#include <map>
+#include <utility>
+
+namespace ltk {
+
+class KernelOCL;
+class IDualMemOCL;
+struct CommandBufferSetOCL;
+
+/**
+ * CommandSequenceOCL
+ *
+ * A fixed sequence of map, unmap and kernel commands, recorded once and
+ * replayed many times, e.g. once per frame. Commands refer to memory through
+ * binding indices, which are resolved to memory objects on each replay.
+ * Recorded kernel geometry and arguments are validated once on finalize.
+ *
+ * Each step waits on the previous step, plus any extra events passed for
+ * that replay. Runs of kernel steps are replayed from cl_khr_command_buffer
+ * command buffers when the device supports them, one set per distinct
+ * memory binding. Otherwise, and for map/unmap, the steps are enqueued
+ * directly from the validated list.
+ * A sequence binds arguments on its kernels, so replays must not run
+ * concurrently with other users of those kernels.
+ */
+class CommandSequenceOCL {
+public:
+	typedef size_t StepId;
+	// kernel argument index bound to a memory binding
+	typedef std::pair<cl_uint, size_t> MemArg;
+
+	struct Replay {
+		// memory object for each binding index
+		std::vector<IDualMemOCL*> bindings;
+		// extra wait events per step, indexed by step; may be shorter
+		// than the sequence
+		std::vector<std::vector<cl_event> > waits;
+		// completion event of each replayed step, set by replay
+		std::vector<Event> events;
+	};
+
+	CommandSequenceOCL(DeviceOCL *device);
+	~CommandSequenceOCL();
+
+	StepId recordMap(size_t binding);
+	StepId recordUnmap(size_t binding);
+	// launch geometry and queue are taken from launch; args holds the
+	// non memory arguments
+	StepId recordKernel(KernelOCL *kernel, const EnqueueInfoOCL &launch,
+			const KernelArgsOCL &args, const std::vector<MemArg> &memArgs);
+
+	// validate recorded steps; throws std::runtime_error if a kernel step
+	// has unbound arguments or invalid geometry
+	void finalize();
+
+	/**
+	 * Enqueue the first numSteps steps (all by default). The first step
+	 * also waits on waitEvents. Returns false if a step failed to enqueue;
+	 * events of the steps enqueued so far are still set.
+	 */
+	bool replay(Replay &replay, cl_uint numWaitEvents = 0,
+			const cl_event *waitEvents = nullptr, size_t numSteps = (size_t) -1);
+
+	size_t getNumSteps() const {
+		return steps.size();
+	}
+	bool usesCommandBuffers() const;
+private:
+	enum eStepType {
+		MapStep, UnmapStep, KernelStep
+	};
+	struct Step {
+		Step(eStepType type, size_t binding) :
+				type(type), binding(binding), kernel(nullptr), launch(nullptr), segment(
+						(size_t) -1) {
+		}
+		eStepType type;
+		size_t binding;
+		KernelOCL *kernel;
+		EnqueueInfoOCL launch;
+		KernelArgsOCL args;
+		std::vector<MemArg> memArgs;
+		// run of consecutive kernel steps this step starts, if any
+		size_t segment;
+	};
+	struct Segment {
+		size_t first;
+		size_t count;
+	};
+	void bindArgs(Step &step, const Replay &replay);
+	bool enqueueStep(Step &step, Replay &replay, size_t index,
+			const std::vector<cl_event> &waits);
+	bool enqueueSegment(Segment &segment, Replay &replay,
+			const std::vector<cl_event> &waits);
+	DeviceOCL *device;
+	std::vector<Step> steps;
+	std::vector<Segment> segments;
+	bool finalized;
+	// command buffers, keyed on memory bindings; null if unsupported
+	CommandBufferSetOCL *commandBuffers;
+};
+
+}
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "CompletionDispatcherOCL.h"
+#include "UtilOCL.h"
+#include "QueueOCL.h"
+#include <chrono>
+#include <exception>
+
+namespace ltk {
+
+CompletionDispatcherOCL::CompletionDispatcherOCL(size_t numThreads,
+		CountersOCL *counters) :
+		counters(counters), nextWorker(0), stopping(false), numDispatched(0), numPending(0), activeCallbacks(
+				0) {
+	if (numThreads == 0)
+		numThreads = 1;
+	for (size_t i = 0; i < numThreads; ++i) {
+		auto worker = new Worker(this);
+		workers.push_back(worker);
+		worker->thread = std::thread([this, worker]() {
+			QueueOCL::trackEnqueues();
+			run(worker);
+		});
+	}
+}
+
+CompletionDispatcherOCL::~CompletionDispatcherOCL() {
+	finish();
+	// a driver thread may still be returning from onComplete
+	while (activeCallbacks.load())
+		std::this_thread::yield();
+	stopping = true;
+	for (auto worker : workers) {
+		{
+			std::lock_guard<std::mutex> lk(worker->sleepMutex);
+			worker->sleeping = false;
+		}
+		worker->wake.notify_one();
+	}
+	for (auto worker : workers) {
+		worker->thread.join();
+		delete worker;
+	}
+}
+
+void CompletionDispatcherOCL::Worker::push(Node *node) {
+	// sequentially consistent : orders the push before the producer's
+	// load of sleeping, against the worker's store of sleeping before
+	// its load of head
+	auto old = head.load(std::memory_order_relaxed);
+	do {
+		node->next = old;
+	} while (!head.compare_exchange_weak(old, node, std::memory_order_seq_cst,
+			std::memory_order_relaxed));
+}
+
+CompletionDispatcherOCL::Node* CompletionDispatcherOCL::Worker::popAll() {
+	auto node = head.exchange(nullptr, std::memory_order_acquire);
+	// stack is LIFO : reverse to run continuations in completion order
+	Node *list = nullptr;
+	while (node) {
+		auto next = node->next;
+		node->next = list;
+		list = node;
+		node = next;
+	}
+	return list;
+}
+
+bool CompletionDispatcherOCL::dispatch(cl_event evt, Continuation fn) {
+	if (!evt || !fn)
+		return false;
+	auto worker = workers[nextWorker++ % workers.size()];
+	static CensusSiteOCL *site = CensusOCL::site(CensusEvent,
+			"CompletionDispatcherOCL");
+	auto node = new Node(worker, Event::retain(evt, site), fn);
+	numPending++;
+	numDispatched++;
+	cl_int error_code = clSetEventCallback(evt, CL_COMPLETE, onComplete, node);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: clSetEventCallback returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		delete node;
+		numDispatched--;
+		retire(1);
+		return false;
+	}
+	// a continuation only runs once its command has been submitted
+	QueueOCL::flushEventQueue(evt);
+	return true;
+}
+
+void CL_CALLBACK CompletionDispatcherOCL::onComplete(cl_event evt,
+		cl_int status, void *userData) {
+	(void) evt;
+	auto node = (Node*) userData;
+	auto worker = node->worker;
+	auto owner = worker->owner;
+	owner->activeCallbacks++;
+	node->status = status;
+	if (owner->counters)
+		node->completed = std::chrono::steady_clock::now();
+	// node belongs to the worker from here on
+	worker->push(node);
+	// only wake the worker if it announced that it is going to sleep,
+	// so a burst of completions costs one wake-up. The mutex makes the
+	// wake-up land either before the worker's predicate check or in its wait
+	if (worker->sleeping.load()) {
+		bool notify = false;
+		{
+			std::lock_guard<std::mutex> lk(worker->sleepMutex);
+			if (worker->sleeping) {
+				worker->sleeping = false;
+				notify = true;
+			}
+		}
+		if (notify) {
+			worker->wakeups++;
+			worker->wake.notify_one();
+		}
+	}
+	owner->activeCallbacks--;
+}
+
+void CompletionDispatcherOCL::run(Worker *worker) {
+	while (true) {
+		auto list = worker->popAll();
+		if (!list) {
+			if (stopping)
+				break;
+			std::unique_lock<std::mutex> lk(worker->sleepMutex);
+			worker->sleeping = true;
+			if (!worker->head.load() && !stopping)
+				worker->wake.wait(lk, [this, worker] {
+					return !worker->sleeping || stopping;
+				});
+			worker->sleeping = false;
+			continue;
+		}
+		size_t count = 0;
+		while (list) {
+			auto next = list->next;
+			if (counters)
+				counters->addCallback(
+						(uint64_t) std::chrono::duration_cast<
+								std::chrono::nanoseconds>(
+								std::chrono::steady_clock::now() - list->completed).count());
+			try {
+				list->fn(list->status);
+			} catch (std::exception &ex) {
+				Util::LogError("Error: completion continuation threw %s.\n",
+						ex.what());
+			}
+			delete list;
+			list = next;
+			count++;
+		}
+		// submit whatever this batch of continuations enqueued
+		QueueOCL::flushTracked();
+		retire(count);
+	}
+}
+
+void CompletionDispatcherOCL::retire(size_t count) {
+	if ((numPending -= count) == 0) {
+		std::lock_guard<std::mutex> lk(finishMutex);
+		finished.notify_all();
+	}
+}
+
+void CompletionDispatcherOCL::finish() {
+	std::unique_lock<std::mutex> lk(finishMutex);
+	finished.wait(lk, [this] {
+		return numPending.load() == 0;
+	});
+}
+
+uint64_t CompletionDispatcherOCL::getNumWakeups() const {
+	uint64_t rc = 0;
+	for (auto worker : workers)
+		rc += worker->wakeups.load();
+	return rc;
+}
+
+}
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "EventOCL.h"
+#include "CountersOCL.h"
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+
+namespace ltk {
+
+/**
+ * CompletionDispatcherOCL
+ *
+ * Runs continuations when OpenCL events complete. The driver callback only
+ * pushes the continuation onto a lock-free queue owned by one of a small
+ * number of worker threads, and wakes that worker if it is asleep : the
+ * driver's callback thread only takes a lock to wake a sleeping worker,
+ * and never runs user code.
+ * Workers drain their whole queue on each wake-up, so bursts of completions
+ * cost a single wake-up.
+ */
+class CompletionDispatcherOCL {
+public:
+	// status is CL_COMPLETE, or a negative error code if the command failed
+	typedef std::function<void(cl_int status)> Continuation;
+
+	// callback latency is added to counters, if not null
+	explicit CompletionDispatcherOCL(size_t numThreads = 1,
+			CountersOCL *counters = nullptr);
+	// waits for all pending continuations
+	~CompletionDispatcherOCL();
+
+	// run fn on a worker thread once evt completes. Event is retained
+	// until the continuation has run.
+	bool dispatch(cl_event evt, Continuation fn);
+	// block until every dispatched continuation has run
+	void finish();
+
+	size_t getNumThreads() const {
+		return workers.size();
+	}
+	uint64_t getNumDispatched() const {
+		return numDispatched.load();
+	}
+	// notifications of sleeping workers
+	uint64_t getNumWakeups() const;
+private:
+	struct Worker;
+	struct Node {
+		Node(Worker *worker, Event &&evt, Continuation fn) :
+				worker(worker), evt(std::move(evt)), fn(fn), status(
+						CL_COMPLETE), next(nullptr) {
+		}
+		Worker *worker;
+		Event evt;
+		Continuation fn;
+		cl_int status;
+		std::chrono::steady_clock::time_point completed;
+		Node *next;
+	};
+	struct Worker {
+		Worker(CompletionDispatcherOCL *owner) :
+				owner(owner), head(nullptr), sleeping(false), wakeups(0) {
+		}
+		// multiple producer single consumer stack : producers push
+		// with a CAS, the consumer takes the whole stack at once
+		void push(Node *node);
+		Node* popAll();
+		CompletionDispatcherOCL *owner;
+		std::atomic<Node*> head;
+		std::atomic<bool> sleeping;
+		std::atomic<uint64_t> wakeups;
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		std::thread thread;
+	};
+	static void CL_CALLBACK onComplete(cl_event evt, cl_int status,
+			void *userData);
+	void run(Worker *worker);
+	void retire(size_t count);
+
+	CountersOCL *counters;
+	std::vector<Worker*> workers;
+	std::atomic<size_t> nextWorker;
+	std::atomic<bool> stopping;
+	std::atomic<uint64_t> numDispatched;
+	std::atomic<size_t> numPending;
+	// driver threads currently inside onComplete
+	std::atomic<size_t> activeCallbacks;
+	std::mutex finishMutex;
+	std::condition_variable finished;
+};
+
+}
+#endif
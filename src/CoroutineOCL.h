@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "FutureOCL.h"
+
+/**
+ * C++20 coroutine support. Only available when the compiler implements
+ * coroutines; the future based API works without it.
+ */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define LTK_COROUTINES_FOUND
+#endif
+#endif
+
+#ifdef LTK_COROUTINES_FOUND
+#include <coroutine>
+#include <exception>
+#include "CompletionDispatcherOCL.h"
+#include "UtilOCL.h"
+
+namespace ltk {
+
+/**
+ * FutureAwaiterOCL
+ *
+ * co_await on a FutureOCL suspends until the future is ready, and resumes
+ * on the thread running its continuations : the device's completion
+ * dispatcher, or the awaiting thread if the future is already ready.
+ * The result of co_await is the command status.
+ */
+class FutureAwaiterOCL {
+public:
+	explicit FutureAwaiterOCL(FutureOCL future) :
+			future(future) {
+	}
+	bool await_ready() const {
+		return !future.valid() || future.isReady();
+	}
+	// false if the future became ready after await_ready(): the coroutine
+	// then continues on this thread, rather than being resumed recursively
+	// from inside await_suspend
+	bool await_suspend(std::coroutine_handle<> handle) {
+		// once registered, the continuation may resume and finish the
+		// coroutine, destroying this awaiter : hold the state locally
+		auto f = future;
+		return f.thenIfPending([handle](cl_int status) {
+			(void) status;
+			handle.resume();
+		});
+	}
+	// future is ready once resumed
+	cl_int await_resume() const {
+		return future.valid() ? future.getStatus() : CL_INVALID_OPERATION;
+	}
+private:
+	FutureOCL future;
+};
+
+inline FutureAwaiterOCL operator co_await(FutureOCL future) {
+	return FutureAwaiterOCL(future);
+}
+
+/**
+ * ResumeOnAwaiterOCL
+ *
+ * co_await resumeOn(pool) moves the coroutine to a thread of pool, any
+ * type with an enqueue(callable) member. Use it before blocking host work,
+ * such as file I/O or waiting for a buffer, which would otherwise stall
+ * every continuation behind it on the dispatcher thread.
+ */
+template<typename Pool> class ResumeOnAwaiterOCL {
+public:
+	explicit ResumeOnAwaiterOCL(Pool &pool) :
+			pool(pool) {
+	}
+	bool await_ready() const {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle) {
+		pool.enqueue([handle] {
+			handle.resume();
+		});
+	}
+	void await_resume() const {
+	}
+private:
+	Pool &pool;
+};
+
+template<typename Pool> ResumeOnAwaiterOCL<Pool> resumeOn(Pool &pool) {
+	return ResumeOnAwaiterOCL<Pool>(pool);
+}
+
+// wait on an event produced outside of latke; evt is retained
+inline FutureOCL awaitEvent(cl_event evt, CompletionDispatcherOCL *dispatcher) {
+	return FutureOCL(Event::retain(evt), dispatcher);
+}
+
+/**
+ * TaskOCL
+ *
+ * Return type for coroutines that drive device work. The coroutine starts
+ * running immediately, and its frame is freed when it finishes. Awaiting a
+ * TaskOCL (or its future) waits for the coroutine to finish; the status is
+ * CL_INVALID_OPERATION if it exited with an exception.
+ * No thread is held while the coroutine is suspended, so one coroutine per
+ * frame scales to thousands of frames in flight. Continuations run on the
+ * dispatcher thread : move long host work to a thread pool with resumeOn().
+ */
+class TaskOCL {
+public:
+	struct promise_type {
+		TaskOCL get_return_object() {
+			return TaskOCL(promise.getFuture());
+		}
+		std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+		void return_void() {
+			promise.setStatus(CL_COMPLETE);
+		}
+		void unhandled_exception() {
+			try {
+				std::rethrow_exception(std::current_exception());
+			} catch (std::exception &ex) {
+				Util::LogError("Error: coroutine threw %s.\n", ex.what());
+			} catch (...) {
+				Util::LogError("Error: coroutine threw unknown exception.\n");
+			}
+			promise.setStatus(CL_INVALID_OPERATION);
+		}
+		PromiseOCL promise;
+	};
+
+	FutureOCL getFuture() const {
+		return future;
+	}
+	// block until the coroutine finishes, and return its status
+	cl_int wait() const {
+		return future.wait();
+	}
+private:
+	explicit TaskOCL(FutureOCL future) :
+			future(future) {
+	}
+	FutureOCL future;
+};
+
+inline FutureAwaiterOCL operator co_await(const TaskOCL &task) {
+	return FutureAwaiterOCL(task.getFuture());
+}
+
+}
+#endif
+#endif
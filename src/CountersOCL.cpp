@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "CountersOCL.h"
+#include <fstream>
+#include <cstdio>
+
+namespace ltk {
+
+CountersOCL::CountersOCL() :
+		bytesUploaded(0), bytesDownloaded(0), kernelsLaunched(0), programCacheHits(
+				0), programCacheMisses(0), callbacks(0), callbackLatencyNanos(0), maxCallbackLatencyNanos(
+				0), framesInFlight(0), queueDepth(0), poolOccupancy(0) {
+}
+
+void CountersOCL::addCallback(uint64_t latencyNanos) {
+	callbacks.fetch_add(1, std::memory_order_relaxed);
+	callbackLatencyNanos.fetch_add(latencyNanos, std::memory_order_relaxed);
+	auto worst = maxCallbackLatencyNanos.load(std::memory_order_relaxed);
+	while (latencyNanos > worst
+			&& !maxCallbackLatencyNanos.compare_exchange_weak(worst, latencyNanos,
+					std::memory_order_relaxed))
+		;
+}
+
+static std::string escapeLabel(const std::string &str) {
+	std::string rc;
+	for (auto c : str) {
+		if (c == '"' || c == '\\')
+			rc += '\\';
+		if (c == '\n')
+			rc += "\\n";
+		else
+			rc += c;
+	}
+	return rc;
+}
+
+void CountersOCL::writePrometheus(std::ostream &out,
+		const std::string &device) const {
+	std::string label = "{device=\"" + escapeLabel(device) + "\"}";
+	auto write = [&out, &label](const char *name, const char *type,
+			const char *help, double value) {
+		out << "# HELP " << name << " " << help << "\n";
+		out << "# TYPE " << name << " " << type << "\n";
+		out << name << label << " " << value << "\n";
+	};
+	out.precision(17);
+	write("latke_uploaded_bytes_total", "counter",
+			"Bytes transferred from host to device.", (double) bytesUploaded);
+	write("latke_downloaded_bytes_total", "counter",
+			"Bytes transferred from device to host.", (double) bytesDownloaded);
+	write("latke_kernels_launched_total", "counter", "Kernels enqueued.",
+			(double) kernelsLaunched);
+	write("latke_program_cache_hits_total", "counter",
+			"Helper library lookups served from the program cache.",
+			(double) programCacheHits);
+	write("latke_program_cache_misses_total", "counter",
+			"Helper library lookups that built a library.",
+			(double) programCacheMisses);
+	write("latke_callbacks_total", "counter", "Completion continuations run.",
+			(double) callbacks);
+	write("latke_callback_latency_seconds_total", "counter",
+			"Total time from event completion to continuation start.",
+			(double) callbackLatencyNanos / 1e9);
+	write("latke_callback_latency_max_seconds", "gauge",
+			"Worst time from event completion to continuation start.",
+			(double) maxCallbackLatencyNanos / 1e9);
+	write("latke_frames_in_flight", "gauge", "Frames in the pipeline.",
+			(double) framesInFlight);
+	write("latke_queue_depth", "gauge",
+			"Commands enqueued but not yet flushed to the device.",
+			(double) queueDepth);
+	write("latke_pool_occupancy", "gauge", "Pooled buffers in use.",
+			(double) poolOccupancy);
+}
+
+bool CountersOCL::writeTextfile(const std::string &fileName,
+		const std::string &device) const {
+	// the collector may read at any time : write a temporary file and
+	// rename it over the target
+	auto tempName = fileName + ".tmp";
+	{
+		std::ofstream out(tempName, std::ios::trunc);
+		if (!out)
+			return false;
+		writePrometheus(out, device);
+		if (!out.good())
+			return false;
+	}
+#ifdef _WIN32
+	remove(fileName.c_str());
+#endif
+	return rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+
+}
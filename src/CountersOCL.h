@@ -0,0 +1,77 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <ostream>
+
+namespace ltk {
+
+/**
+ * CountersOCL
+ *
+ * Live runtime counters of one device, updated with relaxed atomics on the
+ * hot path and readable at any time. writePrometheus() formats them in the
+ * Prometheus text exposition format; writeTextfile() replaces a file for
+ * the node exporter's textfile collector.
+ *
+ * framesInFlight and poolOccupancy are owned by the application, which
+ * updates them as frames enter and leave its pipeline.
+ */
+struct CountersOCL {
+	CountersOCL();
+
+	void addUpload(uint64_t bytes) {
+		bytesUploaded.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	void addDownload(uint64_t bytes) {
+		bytesDownloaded.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	void addKernels(uint64_t count) {
+		kernelsLaunched.fetch_add(count, std::memory_order_relaxed);
+	}
+	void addCallback(uint64_t latencyNanos);
+
+	// counters
+	std::atomic<uint64_t> bytesUploaded;
+	std::atomic<uint64_t> bytesDownloaded;
+	std::atomic<uint64_t> kernelsLaunched;
+	std::atomic<uint64_t> programCacheHits;
+	std::atomic<uint64_t> programCacheMisses;
+	// completion continuations run, and their total and worst latency
+	// from event completion to continuation start
+	std::atomic<uint64_t> callbacks;
+	std::atomic<uint64_t> callbackLatencyNanos;
+	std::atomic<uint64_t> maxCallbackLatencyNanos;
+
+	// gauges
+	std::atomic<int64_t> framesInFlight;
+	// commands enqueued but not yet flushed to the device
+	std::atomic<int64_t> queueDepth;
+	std::atomic<int64_t> poolOccupancy;
+
+	// device label is added to every sample, e.g. the device name
+	void writePrometheus(std::ostream &out, const std::string &device) const;
+	bool writeTextfile(const std::string &fileName,
+			const std::string &device) const;
+};
+
+}
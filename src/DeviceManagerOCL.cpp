@@ -103,6 +103,7 @@ int DeviceManagerOCL::init(int32_t platformId, eDeviceType type,
     NULL,
     NULL, &status);
     CHECK_OPENCL_ERROR(status, "clCreateContextFromType failed.");
+    contextCensus.reset(CensusOCL::site(CensusContext, "DeviceManagerOCL"));
 
     cl_device_id *deviceIds = nullptr;
     size_t numDevices;
@@ -138,7 +139,7 @@ int DeviceManagerOCL::init(int32_t platformId, eDeviceType type,
         auto arch = ArchFactory::getArchitecture(deviceInfo->venderId);
         if (!arch) {
         	if (verbose)
-        		std::cout << "Unrecognized vendor id: " << deviceInfo->venderId << std::endl;
+        		Util::LogInfo("Unrecognized vendor id: %u\n", deviceInfo->venderId);
         	continue;
         }
         devices.push_back(
@@ -152,6 +153,7 @@ int DeviceManagerOCL::init(int32_t platformId, eDeviceType type,
             auto status = clReleaseContext(context);
             CHECK_OPENCL_ERROR_NO_RETURN(status, "clReleaseContext failed.");
             context = 0;
+            contextCensus.reset();
         }
     }
     delete[] deviceIds;
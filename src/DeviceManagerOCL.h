@@ -56,6 +56,7 @@ public:
 private:
 	bool singleContext;
 	cl_context context;
+	CensusTokenOCL contextCensus;
 	std::vector<DeviceOCL*> devices;
 };
 }
@@ -46,6 +46,10 @@
 #include <string.h>
 #include <math.h>
 #include "UtilOCL.h"
+#include "ProgramCacheOCL.h"
+#include "QueuePoolOCL.h"
+#include "CompletionDispatcherOCL.h"
+#include "DeviceProfileOCL.h"
 namespace ltk {
 
 DeviceOCL::DeviceOCL(cl_context my_context, bool ownsCtxt,
@@ -55,8 +59,11 @@ DeviceOCL::DeviceOCL(cl_context my_context, bool ownsCtxt,
 		device(my_device),
 		queue(NULL),
 		deviceInfo(deviceInfo),
-		arch(architecture) {
+		arch(architecture),
+		queuePoolSize{1,1,1},
+		deviceProfile(nullptr) {
     cl_int errorCode;
+    queue_props = getSupportedQueueProperties(queue_props);
 
   #ifdef CL_VERSION_2_0
     // Create command queue
@@ -78,9 +85,19 @@ DeviceOCL::DeviceOCL(cl_context my_context, bool ownsCtxt,
     }
     if (!queue)
       throw std::runtime_error("Failed to create command queue");
+    queueCensus.reset(CensusOCL::site(CensusQueue, "DeviceOCL"));
+    // shared contexts are counted by the device manager
+    if (ownsContext)
+      contextCensus.reset(CensusOCL::site(CensusContext, "DeviceOCL"));
 }
 
 DeviceOCL::~DeviceOCL() {
+	ProgramCacheOCL::release(this);
+	// waits for outstanding continuations
+	completionDispatcher.reset();
+	delete deviceProfile;
+	for (auto &pool : queuePools)
+		delete pool.second;
 	delete arch;
 	delete deviceInfo;
 	cl_int errorCode = CL_SUCCESS;
@@ -109,6 +126,64 @@ std::string DeviceOCL::getBuildOptions(){
 	return arch->getBuildOptions();
 }
 
+QueuePoolOCL* DeviceOCL::getQueuePool(cl_command_queue_properties queue_props) {
+	std::lock_guard<std::mutex> lock(queuePoolMutex);
+	auto iter = queuePools.find(queue_props);
+	if (iter != queuePools.end())
+		return iter->second;
+	auto pool = new QueuePoolOCL(this, queue_props, queuePoolSize[UploadQueue],
+			queuePoolSize[ComputeQueue], queuePoolSize[DownloadQueue]);
+	queuePools[queue_props] = pool;
+
+	return pool;
+}
+
+void DeviceOCL::setQueuePoolSize(size_t numUpload, size_t numCompute,
+		size_t numDownload) {
+	std::lock_guard<std::mutex> lock(queuePoolMutex);
+	queuePoolSize[UploadQueue] = numUpload;
+	queuePoolSize[ComputeQueue] = numCompute;
+	queuePoolSize[DownloadQueue] = numDownload;
+}
+
+bool DeviceOCL::supportsOutOfOrder() const {
+	return (deviceInfo->queueProperties
+			& CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+}
+
+cl_command_queue_properties DeviceOCL::getSupportedQueueProperties(
+		cl_command_queue_properties queue_props) const {
+	// queue pools emulate out of order execution with several in order queues
+	if (!supportsOutOfOrder())
+		queue_props &= ~(cl_command_queue_properties)CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+	return queue_props;
+}
+
+CompletionDispatcherOCL* DeviceOCL::getCompletionDispatcher() {
+	std::lock_guard<std::mutex> lock(dispatcherMutex);
+	if (!completionDispatcher)
+		completionDispatcher.reset(new CompletionDispatcherOCL(1, &counters));
+
+	return completionDispatcher.get();
+}
+
+const DeviceProfileOCL& DeviceOCL::getDeviceProfile(const std::string &cacheFile) {
+	std::lock_guard<std::mutex> lock(deviceProfileMutex);
+	if (!deviceProfile) {
+		deviceProfile = new DeviceProfileOCL();
+		if (!DeviceProfileOCL::load(this, cacheFile, *deviceProfile)
+				&& DeviceProfileOCL::probe(this, *deviceProfile))
+			DeviceProfileOCL::store(this, cacheFile, *deviceProfile);
+	}
+
+	return *deviceProfile;
+}
+
+const DeviceProfileOCL* DeviceOCL::getLoadedDeviceProfile() {
+	std::lock_guard<std::mutex> lock(deviceProfileMutex);
+	return deviceProfile && deviceProfile->valid ? deviceProfile : nullptr;
+}
+
 
 }
 #endif
@@ -42,10 +42,19 @@
 
 #include "IArch.h"
 #include "UtilOCL.h"
+#include "CountersOCL.h"
+#include "CensusOCL.h"
 #include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace ltk {
 
+class QueuePoolOCL;
+class CompletionDispatcherOCL;
+struct DeviceProfileOCL;
+
 struct DeviceOCL {
 	DeviceOCL(cl_context my_context, bool ownsCtxt, cl_device_id my_device,
 			DeviceInfo *deviceInfo, IArch *architecture,cl_command_queue_properties queue_props);
@@ -53,12 +62,44 @@ struct DeviceOCL {
 
 	std::string getBuildOptions();
 
+	bool supportsOutOfOrder() const;
+	// queue_props without the properties this device's queues don't support
+	cl_command_queue_properties getSupportedQueueProperties(
+			cl_command_queue_properties queue_props) const;
+
+	// shared upload/compute/download queues with these properties,
+	// created on first request
+	QueuePoolOCL* getQueuePool(cl_command_queue_properties queue_props);
+	// number of queues per role, for pools created after this call
+	void setQueuePoolSize(size_t numUpload, size_t numCompute, size_t numDownload);
+	// runs continuations of futures created for this device,
+	// created on first request
+	CompletionDispatcherOCL* getCompletionDispatcher();
+	// measured transfer bandwidth and latency : loaded from cacheFile,
+	// or probed and cached on first request
+	const DeviceProfileOCL& getDeviceProfile(
+			const std::string &cacheFile = "latke_device_profile.txt");
+	// profile from an earlier getDeviceProfile(), or null if none is valid.
+	// Never probes
+	const DeviceProfileOCL* getLoadedDeviceProfile();
+
 	bool ownsContext;
 	cl_context context;           // hold the context handler
 	cl_device_id device;            // hold the selected device handler
 	cl_command_queue queue;      // hold the commands-queue handler
 	DeviceInfo *deviceInfo;
 	IArch *arch;
+	CountersOCL counters;
+private:
+	std::mutex queuePoolMutex;
+	std::map<cl_command_queue_properties, QueuePoolOCL*> queuePools;
+	size_t queuePoolSize[3];
+	std::mutex dispatcherMutex;
+	std::unique_ptr<CompletionDispatcherOCL> completionDispatcher;
+	std::mutex deviceProfileMutex;
+	DeviceProfileOCL *deviceProfile;
+	CensusTokenOCL contextCensus;
+	CensusTokenOCL queueCensus;
 };
 
 }
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "DeviceProfileOCL.h"
+#include "DeviceOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <memory>
+
+namespace ltk {
+
+// probe transfer size, and number of timed repetitions
+const size_t probeBytes = 16 << 20;
+const size_t probeSmallBytes = 4;
+const uint32_t probeIterations = 5;
+
+static std::string stripWhiteSpace(const char *str) {
+	std::string rc(str ? str : "");
+	rc.erase(remove_if(rc.begin(), rc.end(), ::isspace), rc.end());
+	return rc;
+}
+
+DeviceProfileOCL::DeviceProfileOCL() :
+		pinnedWriteBandwidth(0), pinnedReadBandwidth(0), pageableWriteBandwidth(
+				0), pageableReadBandwidth(0), mapWriteBandwidth(0), mapReadBandwidth(
+				0), deviceCopyBandwidth(0), smallTransferLatency(0), mapLatency(0), valid(
+				false) {
+}
+
+bool DeviceProfileOCL::prefersMappedTransfers() const {
+	return valid
+			&& mapWriteBandwidth + mapReadBandwidth
+					>= std::max(pinnedWriteBandwidth, pageableWriteBandwidth)
+							+ std::max(pinnedReadBandwidth, pageableReadBandwidth);
+}
+
+bool DeviceProfileOCL::prefersPinnedHostMemory() const {
+	return valid
+			&& pinnedWriteBandwidth + pinnedReadBandwidth
+					> pageableWriteBandwidth + pageableReadBandwidth;
+}
+
+size_t DeviceProfileOCL::getMinEfficientTransfer() const {
+	if (!valid)
+		return 0;
+	// latency in us times GB/s is 1e3 bytes
+	double bandwidth = std::max(pinnedWriteBandwidth, pageableWriteBandwidth);
+	return (size_t) (9.0 * smallTransferLatency * bandwidth * 1e3);
+}
+
+FlushPolicy DeviceProfileOCL::getFlushPolicy() const {
+	FlushPolicy policy;
+	auto minTransfer = getMinEfficientTransfer();
+	if (minTransfer)
+		policy.maxBytes = minTransfer;
+	return policy;
+}
+
+// median wall time of op, in microseconds; first run is a warm-up
+static bool timeOp(std::function<cl_int()> op, double &micros) {
+	std::vector<double> times;
+	for (uint32_t i = 0; i < probeIterations + 1; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		cl_int error_code = op();
+		auto finish = std::chrono::steady_clock::now();
+		if (CL_SUCCESS != error_code) {
+			Util::LogError("Error: device probe returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+			return false;
+		}
+		if (i > 0)
+			times.push_back(
+					std::chrono::duration<double, std::micro>(finish - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	micros = times[times.size() / 2];
+
+	return true;
+}
+
+// GB/s of bytes moved in micros
+static double toBandwidth(size_t bytes, double micros) {
+	return micros > 0 ? (double) bytes / (micros * 1e3) : 0;
+}
+
+bool DeviceProfileOCL::probe(DeviceOCL *device, DeviceProfileOCL &profile) {
+	profile = DeviceProfileOCL();
+	size_t bytes = std::min<size_t>(probeBytes,
+			(size_t) device->deviceInfo->maxMemAllocSize / 2);
+	std::unique_ptr<QueueOCL> probeQueue;
+	try {
+		probeQueue.reset(new QueueOCL(device, 0));
+	} catch (std::exception &ex) {
+		return false;
+	}
+	auto queue = probeQueue->getQueueImpl();
+	cl_int error_code = CL_SUCCESS;
+	cl_mem deviceBuffer = clCreateBuffer(device->context, CL_MEM_READ_WRITE,
+			bytes, nullptr, &error_code);
+	cl_mem copyBuffer = 0;
+	if (CL_SUCCESS == error_code)
+		copyBuffer = clCreateBuffer(device->context, CL_MEM_READ_WRITE, bytes,
+				nullptr, &error_code);
+	cl_mem pinnedBuffer = 0;
+	if (CL_SUCCESS == error_code)
+		pinnedBuffer = clCreateBuffer(device->context,
+				CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, nullptr,
+				&error_code);
+	void *pinned = nullptr;
+	if (CL_SUCCESS == error_code)
+		error_code = Util::mapBuffer(queue, pinnedBuffer, true,
+				CL_MAP_READ | CL_MAP_WRITE, bytes, 0, nullptr, nullptr, &pinned);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: device probe allocation returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		Util::ReleaseMemory(deviceBuffer);
+		Util::ReleaseMemory(copyBuffer);
+		Util::ReleaseMemory(pinnedBuffer);
+		return false;
+	}
+	std::vector<uint8_t> pageable(bytes, 1);
+	memset(pinned, 1, bytes);
+
+	auto write = [&](const void *src, size_t len) {
+		return clEnqueueWriteBuffer(queue, deviceBuffer, CL_TRUE, 0, len, src, 0,
+				nullptr, nullptr);
+	};
+	auto read = [&](void *dest, size_t len) {
+		return clEnqueueReadBuffer(queue, deviceBuffer, CL_TRUE, 0, len, dest, 0,
+				nullptr, nullptr);
+	};
+	// map, copy, unmap and wait for the unmap
+	auto mapCopy = [&](bool toDevice, size_t len) {
+		void *mapped = nullptr;
+		cl_int rc = Util::mapBuffer(queue, deviceBuffer, true,
+				toDevice ? CL_MAP_WRITE_INVALIDATE_REGION : CL_MAP_READ, len, 0,
+				nullptr, nullptr, &mapped);
+		if (CL_SUCCESS != rc)
+			return rc;
+		if (toDevice)
+			memcpy(mapped, pageable.data(), len);
+		else
+			memcpy(pageable.data(), mapped, len);
+		rc = Util::unmapMemory(queue, 0, nullptr, nullptr, deviceBuffer, mapped);
+		if (CL_SUCCESS != rc)
+			return rc;
+		return clFinish(queue);
+	};
+	double micros = 0;
+	bool rc = timeOp([&] {
+		return write(pinned, bytes);
+	}, micros);
+	profile.pinnedWriteBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		return read(pinned, bytes);
+	}, micros);
+	profile.pinnedReadBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		return write(pageable.data(), bytes);
+	}, micros);
+	profile.pageableWriteBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		return read(pageable.data(), bytes);
+	}, micros);
+	profile.pageableReadBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		return mapCopy(true, bytes);
+	}, micros);
+	profile.mapWriteBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		return mapCopy(false, bytes);
+	}, micros);
+	profile.mapReadBandwidth = toBandwidth(bytes, micros);
+	rc = rc && timeOp([&] {
+		cl_int rc = clEnqueueCopyBuffer(queue, deviceBuffer, copyBuffer, 0, 0,
+				bytes, 0, nullptr, nullptr);
+		return CL_SUCCESS == rc ? clFinish(queue) : rc;
+	}, micros);
+	profile.deviceCopyBandwidth = toBandwidth(2 * bytes, micros);
+	rc = rc && timeOp([&] {
+		return write(pageable.data(), probeSmallBytes);
+	}, profile.smallTransferLatency);
+	rc = rc && timeOp([&] {
+		return mapCopy(true, probeSmallBytes);
+	}, profile.mapLatency);
+
+	Util::unmapMemory(queue, 0, nullptr, nullptr, pinnedBuffer, pinned);
+	probeQueue->finish();
+	Util::ReleaseMemory(pinnedBuffer);
+	Util::ReleaseMemory(copyBuffer);
+	Util::ReleaseMemory(deviceBuffer);
+	profile.valid = rc;
+
+	return rc;
+}
+
+std::string DeviceProfileOCL::getKey(DeviceOCL *device) {
+	std::stringstream key;
+	key << stripWhiteSpace(device->deviceInfo->name) << "|"
+			<< stripWhiteSpace(device->deviceInfo->driverVersion);
+	return key.str();
+}
+
+bool DeviceProfileOCL::load(DeviceOCL *device, const std::string &cacheFile,
+		DeviceProfileOCL &profile) {
+	std::ifstream in(cacheFile);
+	if (!in.is_open())
+		return false;
+	auto key = getKey(device);
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream ss(line);
+		std::string entryKey;
+		DeviceProfileOCL entry;
+		if (!(ss >> entryKey >> entry.pinnedWriteBandwidth
+				>> entry.pinnedReadBandwidth >> entry.pageableWriteBandwidth
+				>> entry.pageableReadBandwidth >> entry.mapWriteBandwidth
+				>> entry.mapReadBandwidth >> entry.deviceCopyBandwidth
+				>> entry.smallTransferLatency
+				>> entry.mapLatency))
+			continue;
+		if (entryKey == key) {
+			entry.valid = true;
+			profile = entry;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DeviceProfileOCL::store(DeviceOCL *device, const std::string &cacheFile,
+		const DeviceProfileOCL &profile) {
+	auto key = getKey(device);
+	std::vector<std::string> lines;
+	{
+		std::ifstream in(cacheFile);
+		std::string line;
+		while (std::getline(in, line)) {
+			std::istringstream ss(line);
+			std::string entryKey;
+			if ((ss >> entryKey) && entryKey != key)
+				lines.push_back(line);
+		}
+	}
+	std::ofstream out(cacheFile, std::ios::trunc);
+	if (!out.is_open()) {
+		Util::LogError("Error: unable to write device profile cache %s\n",
+				cacheFile.c_str());
+		return false;
+	}
+	for (auto &line : lines)
+		out << line << "\n";
+	out << key << " " << profile.pinnedWriteBandwidth << " "
+			<< profile.pinnedReadBandwidth << " "
+			<< profile.pageableWriteBandwidth << " "
+			<< profile.pageableReadBandwidth << " " << profile.mapWriteBandwidth
+			<< " " << profile.mapReadBandwidth << " "
+			<< profile.deviceCopyBandwidth << " "
+			<< profile.smallTransferLatency << " " << profile.mapLatency << "\n";
+	return out.good();
+}
+
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "QueueOCL.h"
+#include <string>
+
+namespace ltk {
+
+/**
+ * DeviceProfileOCL
+ *
+ * Measured host <-> device transfer characteristics of one device,
+ * and its device memory bandwidth.
+ * Bandwidths are in GB/s, latencies in microseconds. Once a device's
+ * profile is loaded, DualBufferOCL and DualImageOCL choose their host
+ * memory and transfer method from it, and getFlushPolicy() sizes batches
+ * of transfers.
+ *
+ * probe() takes on the order of a second; load() and store() cache
+ * results per (device, driver) in a plain text file, so a device is
+ * only probed once per driver.
+ */
+struct DeviceProfileOCL {
+	DeviceProfileOCL();
+
+	// clEnqueueWrite/ReadBuffer from pinned (CL_MEM_ALLOC_HOST_PTR) memory
+	double pinnedWriteBandwidth;
+	double pinnedReadBandwidth;
+	// clEnqueueWrite/ReadBuffer from pageable (malloc) memory
+	double pageableWriteBandwidth;
+	double pageableReadBandwidth;
+	// map, copy and unmap of a device buffer
+	double mapWriteBandwidth;
+	double mapReadBandwidth;
+	// device to device copy, counting bytes read and written : the
+	// achievable global memory bandwidth of kernels
+	double deviceCopyBandwidth;
+	// blocking write of a few bytes
+	double smallTransferLatency;
+	// blocking map and unmap of a few bytes
+	double mapLatency;
+	bool valid;
+
+	// transfer method : map/unmap rather than read/write
+	bool prefersMappedTransfers() const;
+	// host memory : pinned (CL_MEM_ALLOC_HOST_PTR) rather than pageable
+	bool prefersPinnedHostMemory() const;
+	// smallest transfer whose fixed latency costs at most 10% of its time,
+	// for sizing batches of small transfers
+	size_t getMinEfficientTransfer() const;
+	// flush policy that submits once queued transfers reach
+	// getMinEfficientTransfer()
+	FlushPolicy getFlushPolicy() const;
+
+	// measure device, on an in order queue of its own
+	static bool probe(DeviceOCL *device, DeviceProfileOCL &profile);
+	// look up cached profile. Returns false if no entry exists
+	static bool load(DeviceOCL *device, const std::string &cacheFile,
+			DeviceProfileOCL &profile);
+	// cache profile, replacing any existing entry for device and driver
+	static bool store(DeviceOCL *device, const std::string &cacheFile,
+			const DeviceProfileOCL &profile);
+private:
+	static std::string getKey(DeviceOCL *device);
+};
+
+}
+#endif
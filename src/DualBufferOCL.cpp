@@ -21,11 +21,24 @@
 #ifdef OPENCL_FOUND
 #include "DualBufferOCL.h"
 #include "UtilOCL.h"
+#include "QueuePoolOCL.h"
+#include "DeviceProfileOCL.h"
 #include <cassert>
 
 
 namespace ltk {
 
+static eQueueRole getQueueRole(DualBufferType type) {
+	switch (type) {
+	case HostToDeviceBuffer:
+		return UploadQueue;
+	case DeviceToHostBuffer:
+		return DownloadQueue;
+	default:
+		return ComputeQueue;
+	}
+}
+
 DualBufferOCL::DualBufferOCL(DeviceOCL *device, size_t len,DualBufferType type, cl_command_queue_properties queue_props) :
 		DualBufferOCL(device, len,type,0,nullptr,queue_props)
 {
@@ -38,13 +51,20 @@ DualBufferOCL::DualBufferOCL(DeviceOCL *device,
 							void* buffer,
 							cl_command_queue_properties queue_props) :
 		m_type(type),
-		queue(new QueueOCL(device, queue_props)),
+		queue(device->getQueuePool(queue_props)->lease(getQueueRole(type))),
 		hostBuffer(nullptr),
 		deviceBuffer(0),
-		numBytes(len){
+		numBytes(len),
+		mappedTransfers(true),
+		mapFlags(0){
 	if (numBytes == 0)
 		throw std::exception();
-  cl_mem_flags flags = buffer ? CL_MEM_ALLOC_HOST_PTR : 0;
+  // client memory is always mapped
+  auto profile = buffer ? nullptr : device->getLoadedDeviceProfile();
+  if (profile)
+	  mappedTransfers = profile->prefersMappedTransfers();
+  bool pinned = profile && profile->prefersPinnedHostMemory();
+  cl_mem_flags flags = (buffer || (mappedTransfers && pinned)) ? CL_MEM_ALLOC_HOST_PTR : 0;
   if (type == HostToDeviceBuffer){
 	  flags |= CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY;
   } else if (type == DeviceToHostBuffer){
@@ -62,6 +82,14 @@ DualBufferOCL::DualBufferOCL(DeviceOCL *device,
 		cleanup();
 		throw std::exception();
   }
+  if (!mappedTransfers) {
+	  if (!staging.allocate(device, queue->getQueueImpl(), numBytes, pinned)) {
+		  cleanup();
+		  throw std::exception();
+	  }
+	  hostBuffer = staging.get();
+  }
+  census.reset(CensusOCL::site(CensusMem, "DualBufferOCL"));
 }
 
 
@@ -81,8 +109,9 @@ size_t DualBufferOCL::getSize() const {
 	return numBytes;
 }
 void DualBufferOCL::cleanup() {
-	delete queue;
+	// queue is leased from the device queue pool
 	Util::ReleaseMemory(deviceBuffer);
+	census.reset();
 }
 
 bool DualBufferOCL::map(cl_uint num_events_in_wait_list,
@@ -101,16 +130,35 @@ bool DualBufferOCL::unmap(cl_uint num_events_in_wait_list,
 bool DualBufferOCL::map(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 		const cl_event *event_wait_list, cl_event *completionEvent,
 		bool synchronous, cl_map_flags flags) {
-	cl_int error_code = Util::mapBuffer(mapQueue->getQueueImpl(), deviceBuffer,
-			synchronous, flags, numBytes,
-			num_events_in_wait_list, event_wait_list, completionEvent,
-			(void**) &hostBuffer);
+	Event profileEvent;
+	completionEvent = mapQueue->profilingEvent(completionEvent, profileEvent);
+	cl_int error_code = CL_SUCCESS;
+	if (mappedTransfers) {
+		error_code = Util::mapBuffer(mapQueue->getQueueImpl(), deviceBuffer,
+				synchronous, flags, numBytes,
+				num_events_in_wait_list, event_wait_list, completionEvent,
+				(void**) &hostBuffer);
+	} else if (flags & CL_MAP_READ) {
+		error_code = clEnqueueReadBuffer(mapQueue->getQueueImpl(), deviceBuffer,
+				synchronous, 0, numBytes, hostBuffer, num_events_in_wait_list,
+				event_wait_list, completionEvent);
+	} else {
+		error_code = Util::enqueueMarker(mapQueue->getQueueImpl(), synchronous,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	}
+	mapFlags = flags;
 	if (CL_SUCCESS != error_code) {
 		Util::LogError(
 				"Error: mapDeviceToHost (CL_QUEUE_CONTEXT) returned %s.\n",
 				Util::TranslateOpenCLError(error_code));
 		return false;
 	}
+	// reads transfer on map, writes on unmap
+	if (completionEvent)
+		mapQueue->profile("map", *completionEvent);
+	if ((flags & CL_MAP_READ) && mapQueue->getCounters())
+		mapQueue->getCounters()->addDownload(numBytes);
+	mapQueue->onEnqueue((flags & CL_MAP_READ) ? numBytes : 0, synchronous);
 	return true;
 }
 
@@ -124,15 +172,32 @@ bool DualBufferOCL::map(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 }
 bool DualBufferOCL::unmap(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 		const cl_event *event_wait_list, cl_event *completionEvent) {
-
-	cl_int error_code = Util::unmapMemory(mapQueue->getQueueImpl(),
-			num_events_in_wait_list, event_wait_list, completionEvent,
-			deviceBuffer, hostBuffer);
+	Event profileEvent;
+	completionEvent = mapQueue->profilingEvent(completionEvent, profileEvent);
+	cl_int error_code = CL_SUCCESS;
+	if (mappedTransfers) {
+		error_code = Util::unmapMemory(mapQueue->getQueueImpl(),
+				num_events_in_wait_list, event_wait_list, completionEvent,
+				deviceBuffer, hostBuffer);
+	} else if (mapFlags & (CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) {
+		error_code = clEnqueueWriteBuffer(mapQueue->getQueueImpl(),
+				deviceBuffer, CL_FALSE, 0, numBytes, hostBuffer,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	} else {
+		error_code = Util::enqueueMarker(mapQueue->getQueueImpl(), false,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	}
 	if (CL_SUCCESS != error_code) {
 		Util::LogError("Error: unmap (CL_QUEUE_CONTEXT) returned %s.\n",
 				Util::TranslateOpenCLError(error_code));
+		return false;
 	}
-	return error_code == CL_SUCCESS;
+	if (completionEvent)
+		mapQueue->profile("unmap", *completionEvent);
+	if (m_type != DeviceToHostBuffer && mapQueue->getCounters())
+		mapQueue->getCounters()->addUpload(numBytes);
+	mapQueue->onEnqueue(m_type == DeviceToHostBuffer ? 0 : numBytes);
+	return true;
 }
 }
 #endif
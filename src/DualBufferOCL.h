@@ -22,8 +22,18 @@
 #ifdef OPENCL_FOUND
 #include "QueueOCL.h"
 #include "IDualMemOCL.h"
+#include "HostStagingOCL.h"
 namespace ltk {
 
+/**
+ * DualBufferOCL
+ *
+ * Device buffer with a host view. map() makes the host view valid, and
+ * unmap() hands it back to the device. If the device's profile is loaded
+ * (DeviceOCL::getDeviceProfile), host memory and transfer method follow it :
+ * map/unmap of the buffer, or read/write to a pinned or pageable staging
+ * area. Otherwise the buffer is mapped.
+ */
 class DualBufferOCL: public IDualMemOCL {
 
 public:
@@ -33,6 +43,8 @@ public:
 						cl_command_queue_properties queue_props);
 	~DualBufferOCL();
 
+	using IDualMemOCL::map;
+	using IDualMemOCL::unmap;
 	bool map(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
 			cl_event *completionEvent, bool synchronous);
 	bool unmap(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
@@ -57,7 +69,13 @@ private:
 	QueueOCL *queue;
 	unsigned char *hostBuffer;
 	cl_mem deviceBuffer;
+	CensusTokenOCL census;
 	size_t numBytes;
+	// map/unmap rather than read/write through staging
+	bool mappedTransfers;
+	HostStagingOCL staging;
+	// flags of the last map : read/write transfers write back on unmap
+	cl_map_flags mapFlags;
 };
 }
 #endif
@@ -21,21 +21,32 @@
 #ifdef OPENCL_FOUND
 #include "DualImageOCL.h"
 #include "UtilOCL.h"
+#include "QueuePoolOCL.h"
+#include "DeviceProfileOCL.h"
 
 namespace ltk {
 DualImageOCL::DualImageOCL(DeviceOCL *device, size_t dimX, size_t dimY,
 		uint32_t channelOrder, uint32_t dataType, bool doHostToDevice, cl_command_queue_properties queue_props) :
-		    hostToDevice(doHostToDevice), queue(new QueueOCL(device, queue_props)),
+		    hostToDevice(doHostToDevice),
+		    queue(device->getQueuePool(queue_props)->lease(
+		    		doHostToDevice ? UploadQueue : DownloadQueue)),
 		    hostBuffer(nullptr),
 		    image(0),
 		    dimX(dimX),
 		    dimY(dimY),
 		    channelOrder(channelOrder),
-		    dataType(dataType) {
+		    dataType(dataType),
+		    mappedTransfers(true) {
 	if (dimX == 0 && dimY == 0)
 		throw std::exception();
 
-	cl_mem_flags flags = CL_MEM_ALLOC_HOST_PTR;
+	auto profile = device->getLoadedDeviceProfile();
+	bool pinned = true;
+	if (profile) {
+		mappedTransfers = profile->prefersMappedTransfers();
+		pinned = profile->prefersPinnedHostMemory();
+	}
+	cl_mem_flags flags = (mappedTransfers && pinned) ? CL_MEM_ALLOC_HOST_PTR : 0;
 	flags |=
 			hostToDevice ?
 					(CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY) :
@@ -66,6 +77,15 @@ DualImageOCL::DualImageOCL(DeviceOCL *device, size_t dimX, size_t dimY,
 		cleanup();
 		throw std::exception();
 	}
+	if (!mappedTransfers) {
+		if (!staging.allocate(device, queue->getQueueImpl(), getNumBytes(),
+				pinned)) {
+			cleanup();
+			throw std::exception();
+		}
+		hostBuffer = staging.get();
+	}
+	census.reset(CensusOCL::site(CensusMem, "DualImageOCL"));
 }
 DualImageOCL::~DualImageOCL() {
 	cleanup();
@@ -88,8 +108,9 @@ size_t DualImageOCL::getDimY() const {
 	return dimY;
 }
 void DualImageOCL::cleanup() {
-	delete queue;
+	// queue is leased from the device queue pool
 	Util::ReleaseMemory(image);
+	census.reset();
 }
 size_t DualImageOCL::getNumBytes() const {
 	return getNumBytes(dimX, dimY, channelOrder, dataType);
@@ -144,28 +165,67 @@ bool DualImageOCL::unmap(cl_uint num_events_in_wait_list,
 bool DualImageOCL::map(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 		const cl_event *event_wait_list, cl_event *completionEvent,
 		bool synchronous) {
-
-	cl_int error_code = Util::mapImage(mapQueue->getQueueImpl(), image,
-			synchronous, hostToDevice ? CL_MAP_WRITE : CL_MAP_READ, dimX, dimY,
-			num_events_in_wait_list, event_wait_list, completionEvent,
-			(void**) &hostBuffer);
+	Event profileEvent;
+	completionEvent = mapQueue->profilingEvent(completionEvent, profileEvent);
+	const size_t origin[3] = { 0, 0, 0 };
+	const size_t region[3] = { dimX, dimY, 1 };
+	cl_int error_code = CL_SUCCESS;
+	if (mappedTransfers) {
+		error_code = Util::mapImage(mapQueue->getQueueImpl(), image,
+				synchronous, hostToDevice ? CL_MAP_WRITE : CL_MAP_READ, dimX,
+				dimY, num_events_in_wait_list, event_wait_list,
+				completionEvent, (void**) &hostBuffer);
+	} else if (hostToDevice) {
+		error_code = Util::enqueueMarker(mapQueue->getQueueImpl(), synchronous,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	} else {
+		error_code = clEnqueueReadImage(mapQueue->getQueueImpl(), image,
+				synchronous, origin, region, 0, 0, hostBuffer,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	}
 	if (CL_SUCCESS != error_code) {
 		Util::LogError("Error: map (CL_QUEUE_CONTEXT) returned %s.\n",
 				Util::TranslateOpenCLError(error_code));
 		return false;
 	}
+	// reads transfer on map, writes on unmap
+	if (completionEvent)
+		mapQueue->profile("map", *completionEvent);
+	if (!hostToDevice && mapQueue->getCounters())
+		mapQueue->getCounters()->addDownload(getNumBytes());
+	mapQueue->onEnqueue(hostToDevice ? 0 : getNumBytes(), synchronous);
 	return true;
 }
 bool DualImageOCL::unmap(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 		const cl_event *event_wait_list, cl_event *completionEvent) {
-	cl_int error_code = Util::unmapMemory(mapQueue->getQueueImpl(),
-			num_events_in_wait_list, event_wait_list, completionEvent, image,
-			hostBuffer);
+	Event profileEvent;
+	completionEvent = mapQueue->profilingEvent(completionEvent, profileEvent);
+	const size_t origin[3] = { 0, 0, 0 };
+	const size_t region[3] = { dimX, dimY, 1 };
+	cl_int error_code = CL_SUCCESS;
+	if (mappedTransfers) {
+		error_code = Util::unmapMemory(mapQueue->getQueueImpl(),
+				num_events_in_wait_list, event_wait_list, completionEvent,
+				image, hostBuffer);
+	} else if (hostToDevice) {
+		error_code = clEnqueueWriteImage(mapQueue->getQueueImpl(), image,
+				CL_FALSE, origin, region, 0, 0, hostBuffer,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	} else {
+		error_code = Util::enqueueMarker(mapQueue->getQueueImpl(), false,
+				num_events_in_wait_list, event_wait_list, completionEvent);
+	}
 	if (CL_SUCCESS != error_code) {
 		Util::LogError("Error: unmap (CL_QUEUE_CONTEXT) returned %s.\n",
 				Util::TranslateOpenCLError(error_code));
+		return false;
 	}
-	return error_code == CL_SUCCESS;
+	if (completionEvent)
+		mapQueue->profile("unmap", *completionEvent);
+	if (hostToDevice && mapQueue->getCounters())
+		mapQueue->getCounters()->addUpload(getNumBytes());
+	mapQueue->onEnqueue(hostToDevice ? getNumBytes() : 0);
+	return true;
 }
 }
 #endif
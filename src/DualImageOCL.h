@@ -23,9 +23,17 @@
 #include <vector>
 #include "QueueOCL.h"
 #include "IDualMemOCL.h"
+#include "HostStagingOCL.h"
 
 namespace ltk {
 
+/**
+ * DualImageOCL
+ *
+ * 2D image with a host view; host memory and transfer method follow the
+ * device's loaded profile, as for DualBufferOCL. Otherwise the image is
+ * allocated in pinned memory and mapped.
+ */
 class DualImageOCL: public IDualMemOCL {
 
 public:
@@ -33,6 +41,8 @@ public:
 			uint32_t channelOrder, uint32_t dataType, bool hostToDevice, cl_command_queue_properties queue_props);
 	~DualImageOCL();
 
+	using IDualMemOCL::map;
+	using IDualMemOCL::unmap;
 	bool map(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
 			cl_event *completionEvent, bool synchronous);
 	bool unmap(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
@@ -58,10 +68,14 @@ private:
 	QueueOCL *queue;
 	unsigned char *hostBuffer;
 	cl_mem image;
+	CensusTokenOCL census;
 	size_t dimX;
 	size_t dimY;
 	uint32_t channelOrder;
 	uint32_t dataType;
+	// map/unmap rather than read/write through staging
+	bool mappedTransfers;
+	HostStagingOCL staging;
 };
 }
 #endif
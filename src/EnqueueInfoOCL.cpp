@@ -32,8 +32,7 @@ EnqueueInfoOCL::EnqueueInfoOCL(QueueOCL *myQueue):
 		dimension(0),
 		useOffset(false),
 	    numWaitEvents(0),
-		needsCompletionEvent(false),
-		completionEvent(0)
+		needsCompletionEvent(false)
 {
 	for (int i = 0; i < 3; ++i){
 		local_work_size[i]=0;
@@ -43,6 +42,32 @@ EnqueueInfoOCL::EnqueueInfoOCL(QueueOCL *myQueue):
 
 }
 
+EnqueueInfoOCL::EnqueueInfoOCL(const EnqueueInfoOCL &other) :
+		EnqueueInfoOCL(other.queue) {
+	*this = other;
+}
+
+EnqueueInfoOCL& EnqueueInfoOCL::operator=(const EnqueueInfoOCL &other) {
+	if (this == &other)
+		return *this;
+	queue = other.queue;
+	dimension = other.dimension;
+	useOffset = other.useOffset;
+	for (int i = 0; i < 3; ++i){
+		local_work_size[i] = other.local_work_size[i];
+		global_work_size[i] = other.global_work_size[i];
+		global_work_offset[i] = other.global_work_offset[i];
+	}
+	numWaitEvents = other.numWaitEvents;
+	for (cl_uint i = 0; i < numWaitEvents; ++i)
+		waitEvents[i] = other.waitEvents[i];
+	needsCompletionEvent = other.needsCompletionEvent;
+	completionEvent.reset();
+	label = other.label;
+
+	return *this;
+}
+
 // push a wait event into the wait events
 bool EnqueueInfoOCL::pushWaitEvent(cl_event evt) {
     if (numWaitEvents < MAX_ENQUEUE_WAIT_EVENTS) {
@@ -28,6 +28,8 @@
 #endif
 
 #include "QueueOCL.h"
+#include "EventOCL.h"
+#include <string>
 
 
 namespace ltk {
@@ -37,6 +39,9 @@ const size_t MAX_ENQUEUE_WAIT_EVENTS = 64;
 
 struct EnqueueInfoOCL {
 	EnqueueInfoOCL(QueueOCL *myQueue);
+	// copies describe the same launch, but do not share the completion event
+	EnqueueInfoOCL(const EnqueueInfoOCL &other);
+	EnqueueInfoOCL& operator=(const EnqueueInfoOCL &other);
 
     // push a wait event into the wait events array
 	bool pushWaitEvent(cl_event evt);
@@ -54,7 +59,10 @@ struct EnqueueInfoOCL {
 	cl_uint numWaitEvents;
 	cl_event waitEvents[MAX_ENQUEUE_WAIT_EVENTS];
 	bool needsCompletionEvent;
-	cl_event completionEvent;
+	// set on enqueue if needsCompletionEvent is true
+	Event completionEvent;
+	// profiler label; the kernel name if empty
+	std::string label;
 };
 
 }
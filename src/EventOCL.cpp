@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "EventOCL.h"
+#include "UtilOCL.h"
+#include "QueueOCL.h"
+
+namespace ltk {
+
+static CensusSiteOCL* defaultSite() {
+	static CensusSiteOCL *site = CensusOCL::site(CensusEvent, "Event");
+	return site;
+}
+
+Event::Event(cl_event e, CensusSiteOCL *s) : evt(e), site(s), counted(false) {
+	if (evt)
+		count();
+}
+
+Event& Event::operator=(Event &&other) noexcept {
+	if (this != &other) {
+		reset();
+		evt = other.evt;
+		site = other.site;
+		counted = other.counted;
+		other.evt = 0;
+		other.counted = false;
+	}
+	return *this;
+}
+
+Event Event::retain(cl_event evt, CensusSiteOCL *site) {
+	return Event(Util::RetainEvent(evt), site);
+}
+
+void Event::count() {
+	counted = true;
+	(site ? site : defaultSite())->add();
+}
+
+void Event::uncount() {
+	if (counted)
+		(site ? site : defaultSite())->remove();
+	counted = false;
+}
+
+cl_event* Event::out(CensusSiteOCL *s) {
+	reset();
+	if (s)
+		site = s;
+	// counted when handed out, as the event may never be read back
+	count();
+	return &evt;
+}
+
+cl_event Event::detach() {
+	auto rc = evt;
+	uncount();
+	evt = 0;
+	return rc;
+}
+
+void Event::reset(cl_event e) {
+	if (evt)
+		Util::ReleaseEvent(evt);
+	uncount();
+	evt = e;
+	if (evt)
+		count();
+}
+
+bool Event::wait() const {
+	if (!evt)
+		return true;
+	// batched commands must be submitted before blocking on them
+	QueueOCL::flushEventQueue(evt);
+	cl_int error_code = clWaitForEvents(1, &evt);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: clWaitForEvents returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		return false;
+	}
+	return true;
+}
+
+void Event::setComplete() const {
+	Util::SetEventComplete(evt);
+}
+
+int64_t Event::getLiveCount() {
+	return CensusOCL::getLive(CensusEvent);
+}
+
+}
+#endif
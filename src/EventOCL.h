@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "CensusOCL.h"
+#include <cstdint>
+
+namespace ltk {
+
+/**
+ * Event
+ *
+ * Move-only owning handle to a cl_event : the handle holds one reference,
+ * released on destruction or reset. Every owned event is counted in the
+ * census under the handle's site (default "Event"), so long running pipelines
+ * can check getLiveCount() for leaks.
+ */
+class Event {
+public:
+	Event() : evt(0), site(nullptr), counted(false) {
+	}
+	// adopt evt : takes ownership of the caller's reference
+	explicit Event(cl_event evt, CensusSiteOCL *site = nullptr);
+	Event(Event &&other) noexcept : evt(other.evt), site(other.site),
+			counted(other.counted) {
+		other.evt = 0;
+		other.counted = false;
+	}
+	Event& operator=(Event &&other) noexcept;
+	Event(const Event&) = delete;
+	Event& operator=(const Event&) = delete;
+	~Event() {
+		reset();
+	}
+
+	// new handle holding an additional reference to evt
+	static Event retain(cl_event evt, CensusSiteOCL *site = nullptr);
+
+	cl_event get() const {
+		return evt;
+	}
+	// single element wait list, or null if empty
+	const cl_event* ptr() const {
+		return evt ? &evt : nullptr;
+	}
+	// release current event, and return storage for an OpenCL API
+	// output parameter; the event written there is owned by this handle.
+	// The slot is counted under site (if not null) right away, and stays
+	// counted until the handle is reset, even if the call leaves it empty
+	cl_event* out(CensusSiteOCL *site = nullptr);
+
+	// give up ownership without releasing
+	cl_event detach();
+	// release current event and adopt evt
+	void reset(cl_event evt = 0);
+
+	explicit operator bool() const {
+		return evt != 0;
+	}
+
+	bool wait() const;
+	// complete a user event
+	void setComplete() const;
+
+	// number of events currently owned by Event handles
+	static int64_t getLiveCount();
+private:
+	void count();
+	void uncount();
+	cl_event evt;
+	CensusSiteOCL *site;
+	bool counted;
+};
+
+}
+#endif
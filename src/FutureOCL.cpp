@@ -0,0 +1,192 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "FutureOCL.h"
+#include "CompletionDispatcherOCL.h"
+#include "UtilOCL.h"
+#include "QueueOCL.h"
+#include <atomic>
+#include <exception>
+
+namespace ltk {
+
+FutureOCL::FutureOCL() {
+}
+
+FutureOCL::FutureOCL(Event &&evt, CompletionDispatcherOCL *dispatcher) :
+		state(std::make_shared<State>()) {
+	if (!evt) {
+		state->complete(CL_INVALID_EVENT);
+		return;
+	}
+	state->evt = std::move(evt);
+	auto s = state;
+	if (!dispatcher->dispatch(state->evt.get(), [s](cl_int status) {
+		s->complete(status);
+	}))
+		state->complete(CL_INVALID_OPERATION);
+}
+
+FutureOCL FutureOCL::makeReady(cl_int status) {
+	auto s = std::make_shared<State>();
+	s->complete(status);
+
+	return FutureOCL(s);
+}
+
+void FutureOCL::State::complete(cl_int rc) {
+	std::vector<Continuation> pending;
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		if (ready)
+			return;
+		ready = true;
+		status = rc;
+		pending.swap(continuations);
+	}
+	readyCondition.notify_all();
+	for (auto &fn : pending)
+		fn(rc);
+}
+
+void FutureOCL::State::onReady(Continuation fn) {
+	cl_int rc;
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		if (!ready) {
+			continuations.push_back(fn);
+			return;
+		}
+		rc = status;
+	}
+	fn(rc);
+}
+
+bool FutureOCL::State::onPending(Continuation fn) {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (ready)
+		return false;
+	continuations.push_back(fn);
+
+	return true;
+}
+
+bool FutureOCL::isReady() const {
+	if (!state)
+		return false;
+	std::lock_guard<std::mutex> lk(state->mutex);
+
+	return state->ready;
+}
+
+cl_int FutureOCL::wait() const {
+	if (!state)
+		return CL_INVALID_OPERATION;
+	if (!isReady())
+		QueueOCL::flushEventQueue(state->evt.get());
+	std::unique_lock<std::mutex> lk(state->mutex);
+	state->readyCondition.wait(lk, [this] {
+		return state->ready;
+	});
+
+	return state->status;
+}
+
+cl_int FutureOCL::getStatus() const {
+	if (!state)
+		return CL_INVALID_OPERATION;
+	std::lock_guard<std::mutex> lk(state->mutex);
+
+	return state->ready ? state->status : CL_QUEUED;
+}
+
+cl_event FutureOCL::getEvent() const {
+	return state ? state->evt.get() : 0;
+}
+
+FutureOCL FutureOCL::then(Continuation fn) const {
+	if (!state)
+		return FutureOCL();
+	auto next = std::make_shared<State>();
+	state->onReady([fn, next](cl_int status) {
+		try {
+			fn(status);
+		} catch (std::exception &ex) {
+			Util::LogError("Error: future continuation threw %s.\n", ex.what());
+		}
+		next->complete(status);
+	});
+	// the continuation only runs once the command has been submitted
+	QueueOCL::flushEventQueue(state->evt.get());
+
+	return FutureOCL(next);
+}
+
+bool FutureOCL::thenIfPending(Continuation fn) const {
+	if (!state || !state->onPending(fn))
+		return false;
+	QueueOCL::flushEventQueue(state->evt.get());
+
+	return true;
+}
+
+FutureOCL FutureOCL::whenAll(const std::vector<FutureOCL> &futures) {
+	struct Join {
+		Join(size_t count) :
+				remaining(count), status(CL_COMPLETE) {
+		}
+		std::atomic<size_t> remaining;
+		std::atomic<cl_int> status;
+	};
+	auto all = std::make_shared<State>();
+	if (futures.empty()) {
+		all->complete(CL_COMPLETE);
+		return FutureOCL(all);
+	}
+	auto join = std::make_shared<Join>(futures.size());
+	Continuation arrive = [all, join](cl_int status) {
+		if (status < 0) {
+			cl_int expected = CL_COMPLETE;
+			join->status.compare_exchange_strong(expected, status);
+		}
+		if (--join->remaining == 0)
+			all->complete(join->status.load());
+	};
+	for (auto &f : futures) {
+		if (f.state)
+			f.state->onReady(arrive);
+		else
+			arrive(CL_INVALID_OPERATION);
+	}
+
+	return FutureOCL(all);
+}
+
+PromiseOCL::PromiseOCL() :
+		future(std::make_shared<FutureOCL::State>()) {
+}
+
+void PromiseOCL::setStatus(cl_int status) {
+	future.state->complete(status);
+}
+
+}
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "EventOCL.h"
+#include <functional>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace ltk {
+
+class CompletionDispatcherOCL;
+
+/**
+ * FutureOCL
+ *
+ * Lightweight future for a device command. It becomes ready when the
+ * command's completion event completes. Continuations added with then()
+ * run on the device's completion dispatcher, or on the calling thread if
+ * the future is already ready. Copies share the same state.
+ */
+class FutureOCL {
+public:
+	// status is CL_COMPLETE, or a negative error code if the command failed
+	typedef std::function<void(cl_int status)> Continuation;
+
+	// invalid future
+	FutureOCL();
+	// adopt evt; future is ready once evt completes
+	FutureOCL(Event &&evt, CompletionDispatcherOCL *dispatcher);
+	static FutureOCL makeReady(cl_int status = CL_COMPLETE);
+
+	bool valid() const {
+		return state != nullptr;
+	}
+	bool isReady() const;
+	// block until ready, and return status
+	cl_int wait() const;
+	cl_int getStatus() const;
+	// device completion event, for wait lists; null for host continuations
+	cl_event getEvent() const;
+
+	// run fn once this future is ready. The returned future is ready
+	// after fn has run, with the status of this future.
+	FutureOCL then(Continuation fn) const;
+	// add fn as a continuation and return true if this future is not
+	// ready yet; otherwise return false without running fn
+	bool thenIfPending(Continuation fn) const;
+	// ready once all futures are ready, with the first error status
+	// if any of them failed
+	static FutureOCL whenAll(const std::vector<FutureOCL> &futures);
+private:
+	struct State {
+		State() :
+				ready(false), status(CL_COMPLETE) {
+		}
+		void complete(cl_int status);
+		void onReady(Continuation fn);
+		bool onPending(Continuation fn);
+
+		std::mutex mutex;
+		std::condition_variable readyCondition;
+		bool ready;
+		cl_int status;
+		Event evt;
+		std::vector<Continuation> continuations;
+	};
+	explicit FutureOCL(std::shared_ptr<State> state) :
+			state(state) {
+	}
+	friend class PromiseOCL;
+	std::shared_ptr<State> state;
+};
+
+/**
+ * PromiseOCL
+ *
+ * Host side producer of a FutureOCL, for work that does not end
+ * in a device command.
+ */
+class PromiseOCL {
+public:
+	PromiseOCL();
+	FutureOCL getFuture() const {
+		return future;
+	}
+	// make future ready; only the first call has an effect
+	void setStatus(cl_int status = CL_COMPLETE);
+private:
+	FutureOCL future;
+};
+
+}
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "HostStagingOCL.h"
+#include "DeviceOCL.h"
+#include "UtilOCL.h"
+
+namespace ltk {
+
+HostStagingOCL::HostStagingOCL() :
+		queue(0), pinnedBuffer(0), host(nullptr) {
+}
+
+HostStagingOCL::~HostStagingOCL() {
+	release();
+}
+
+bool HostStagingOCL::allocate(DeviceOCL *device, cl_command_queue stagingQueue,
+		size_t len, bool pinned) {
+	release();
+	if (!pinned) {
+		pageable.reset(new unsigned char[len]);
+		host = pageable.get();
+		return true;
+	}
+	cl_int error_code = CL_SUCCESS;
+	pinnedBuffer = clCreateBuffer(device->context,
+			CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, len, nullptr,
+			&error_code);
+	if (CL_SUCCESS == error_code)
+		error_code = Util::mapBuffer(stagingQueue, pinnedBuffer, true,
+				CL_MAP_READ | CL_MAP_WRITE, len, 0, nullptr, nullptr,
+				(void**) &host);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: pinned staging allocation returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		Util::ReleaseMemory(pinnedBuffer);
+		pinnedBuffer = 0;
+		host = nullptr;
+		return false;
+	}
+	queue = stagingQueue;
+	return true;
+}
+
+void HostStagingOCL::release() {
+	if (pinnedBuffer) {
+		// the buffer is freed once the unmap has run
+		Util::unmapMemory(queue, 0, nullptr, nullptr, pinnedBuffer, host);
+		Util::ReleaseMemory(pinnedBuffer);
+		pinnedBuffer = 0;
+	}
+	pageable.reset();
+	host = nullptr;
+}
+
+}
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <memory>
+
+namespace ltk {
+
+class DeviceOCL;
+
+/**
+ * HostStagingOCL
+ *
+ * Host side of a read/write transfer : either pinned memory, a
+ * CL_MEM_ALLOC_HOST_PTR buffer kept mapped for its lifetime, or pageable
+ * memory from the heap.
+ */
+class HostStagingOCL {
+public:
+	HostStagingOCL();
+	~HostStagingOCL();
+	HostStagingOCL(const HostStagingOCL&) = delete;
+	HostStagingOCL& operator=(const HostStagingOCL&) = delete;
+
+	// pinned memory is mapped, and later unmapped, on queue
+	bool allocate(DeviceOCL *device, cl_command_queue queue, size_t len,
+			bool pinned);
+	unsigned char* get() const {
+		return host;
+	}
+	bool isPinned() const {
+		return pinnedBuffer != 0;
+	}
+private:
+	void release();
+	cl_command_queue queue;
+	cl_mem pinnedBuffer;
+	std::unique_ptr<unsigned char[]> pageable;
+	unsigned char *host;
+};
+
+}
+#endif
@@ -32,6 +32,9 @@ public:
 	virtual size_t getWaveFrontSize()=0;
 	virtual cl_uint getVendorId() = 0;
 	virtual std::string getBuildOptions() = 0;
+	// ALU lanes per GPU compute unit, for peak throughput estimates;
+	// 0 if unknown
+	virtual size_t getLanesPerComputeUnit() = 0;
 };
 
 }
@@ -22,6 +22,8 @@
 #include "latke_config.h"
 #ifdef OPENCL_FOUND
 #include "platform.h"
+#include "EventOCL.h"
+#include "FutureOCL.h"
 namespace ltk {
 
 enum DualBufferType {
@@ -47,25 +49,69 @@ public:
 	virtual bool unmap(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
 			const cl_event *event_wait_list, cl_event *completionEvent) = 0;
 
+	// completion event is owned by the Event handle
+	bool map(cl_uint num_events_in_wait_list, const cl_event *event_wait_list,
+			Event &completion, bool synchronous) {
+		return map(num_events_in_wait_list, event_wait_list,
+				completion.out(mapSite()), synchronous);
+	}
+	bool unmap(cl_uint num_events_in_wait_list,
+			const cl_event *event_wait_list, Event &completion) {
+		return unmap(num_events_in_wait_list, event_wait_list,
+				completion.out(unmapSite()));
+	}
+	bool map(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
+			const cl_event *event_wait_list, Event &completion,
+			bool synchronous) {
+		return map(mapQueue, num_events_in_wait_list, event_wait_list,
+				completion.out(mapSite()), synchronous);
+	}
+	bool unmap(QueueOCL *mapQueue, cl_uint num_events_in_wait_list,
+			const cl_event *event_wait_list, Event &completion) {
+		return unmap(mapQueue, num_events_in_wait_list, event_wait_list,
+				completion.out(unmapSite()));
+	}
+
+	// non-blocking map / unmap returning a future for the command;
+	// continuations run on dispatcher
+	FutureOCL mapAsync(CompletionDispatcherOCL *dispatcher,
+			cl_uint num_events_in_wait_list, const cl_event *event_wait_list) {
+		Event completion;
+		if (!map(num_events_in_wait_list, event_wait_list, completion, false))
+			return FutureOCL::makeReady(CL_INVALID_OPERATION);
+		return FutureOCL(std::move(completion), dispatcher);
+	}
+	FutureOCL unmapAsync(CompletionDispatcherOCL *dispatcher,
+			cl_uint num_events_in_wait_list, const cl_event *event_wait_list) {
+		Event completion;
+		if (!unmap(num_events_in_wait_list, event_wait_list, completion))
+			return FutureOCL::makeReady(CL_INVALID_OPERATION);
+		return FutureOCL(std::move(completion), dispatcher);
+	}
+
 	virtual unsigned char* getHostBuffer() const =0;
 	virtual cl_mem* getDeviceMem() const =0;
 	virtual QueueOCL* getQueue() const=0;
-
+private:
+	static CensusSiteOCL* mapSite() {
+		static CensusSiteOCL *site = CensusOCL::site(CensusEvent, "IDualMemOCL map");
+		return site;
+	}
+	static CensusSiteOCL* unmapSite() {
+		static CensusSiteOCL *site = CensusOCL::site(CensusEvent, "IDualMemOCL unmap");
+		return site;
+	}
 };
 
 template<typename M> struct MemMapEvents {
 	MemMapEvents(DeviceOCL *dev, std::shared_ptr<M> image) :
-			mem(image), triggerMemUnmap(Util::CreateUserEvent(dev->context)), memUnmapped(
-					0) {
-	}
-	~MemMapEvents() {
-		Util::ReleaseEvent(triggerMemUnmap);
-		Util::ReleaseEvent(memUnmapped);
+			mem(image), triggerMemUnmap(Util::CreateUserEvent(dev->context),
+					CensusOCL::site(CensusEvent, "MemMapEvents trigger")) {
 	}
 
 	std::shared_ptr<M> mem;
-	cl_event triggerMemUnmap;
-	cl_event memUnmapped;
+	Event triggerMemUnmap;
+	Event memUnmapped;
 };
 
 
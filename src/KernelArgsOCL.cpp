@@ -0,0 +1,77 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "KernelArgsOCL.h"
+#include <cstring>
+
+namespace ltk {
+
+void KernelArgsOCL::set(cl_uint index, size_t size, const void *val) {
+	if (index >= values.size()) {
+		values.resize(index + 1);
+		valid.resize(index + 1, false);
+		local.resize(index + 1, false);
+	}
+	auto bytes = (const uint8_t*) val;
+	// local memory arguments are passed with a null value and only a size
+	local[index] = bytes == nullptr;
+	if (bytes)
+		values[index].assign(bytes, bytes + size);
+	else
+		values[index].assign(size, 0);
+	valid[index] = true;
+}
+
+bool KernelArgsOCL::equals(cl_uint index, size_t size, const void *val) const {
+	if (!isSet(index))
+		return false;
+	auto &stored = values[index];
+	if (stored.size() != size)
+		return false;
+	if (!val || local[index])
+		return !val && local[index];
+	return memcmp(stored.data(), val, size) == 0;
+}
+
+bool KernelArgsOCL::isSet(cl_uint index) const {
+	return index < valid.size() && valid[index];
+}
+
+size_t KernelArgsOCL::getSize(cl_uint index) const {
+	return isSet(index) ? values[index].size() : 0;
+}
+
+const void* KernelArgsOCL::getValue(cl_uint index) const {
+	return (isSet(index) && !local[index]) ? values[index].data() : nullptr;
+}
+
+cl_uint KernelArgsOCL::count() const {
+	return (cl_uint) values.size();
+}
+
+void KernelArgsOCL::clear() {
+	values.clear();
+	valid.clear();
+	local.clear();
+}
+
+}
+#endif
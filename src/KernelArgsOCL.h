@@ -0,0 +1,61 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <vector>
+#include <cstdint>
+
+namespace ltk {
+
+/**
+ * KernelArgsOCL
+ *
+ * Set of kernel arguments recorded by index. A KernelOCL keeps one of these
+ * as a mirror of the arguments currently bound to its cl_kernel, so that
+ * binding an argument set only calls clSetKernelArg for arguments that changed.
+ */
+class KernelArgsOCL {
+public:
+	template<typename T> void set(cl_uint index, const T &val) {
+		set(index, sizeof(T), &val);
+	}
+	void set(cl_uint index, size_t size, const void *val);
+
+	// true if argument at index is recorded with exactly this value
+	bool equals(cl_uint index, size_t size, const void *val) const;
+	bool isSet(cl_uint index) const;
+
+	size_t getSize(cl_uint index) const;
+	// null for local memory arguments
+	const void* getValue(cl_uint index) const;
+
+	// one past the highest recorded index
+	cl_uint count() const;
+	void clear();
+private:
+	std::vector<std::vector<uint8_t> > values;
+	std::vector<bool> valid;
+	std::vector<bool> local;
+};
+
+}
+#endif
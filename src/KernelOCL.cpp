@@ -22,6 +22,8 @@
 #include "KernelOCL.h"
 #include <stdio.h>
 #include "UtilOCL.h"
+#include "ProgramCacheOCL.h"
+#include "CompletionDispatcherOCL.h"
 #include <sstream>
 #include <algorithm>
 
@@ -33,13 +35,25 @@ KernelOCL::KernelOCL(KernelInitInfo init) : KernelOCL(init, 0)
 
 KernelOCL::KernelOCL(KernelInitInfo init, cl_program prog) : initInfo(init),
 											myKernel(0),
+											workGroupSize(0),
+											preferredWorkGroupSizeMultiple(1),
+											localMemorySize(0),
+											privateMemorySize(0),
+											compileWorkGroupSize{0,0,0},
 											device(init.device->device),
 											context(init.device->context),
 											argCount(0),
-											program(prog) {
-	bool verbose = true;
-	if (!prog)
+											program(prog),
+											eventSite(CensusOCL::site(CensusEvent,
+													"KernelOCL " + init.kernelName)) {
+	// a program we build is released once the kernel holds it; it stays
+	// counted if kernel creation throws
+	CensusSiteOCL *programSite = nullptr;
+	if (!prog) {
 		program = generateProgram(init);
+		programSite = CensusOCL::site(CensusProgram, "KernelOCL " + init.programName);
+		programSite->add();
+	}
 
 	// Create the required kernel
 	cl_int error_code;
@@ -52,11 +66,70 @@ KernelOCL::KernelOCL(KernelInitInfo init, cl_program prog) : initInfo(init),
 		throw std::runtime_error(
 				("Failed to create kernel " + initInfo.kernelName + "\n").c_str());
 	}
-	if (verbose)
-		std::cout << "Created kernel " << initInfo.kernelName << std::endl;
+	census.reset(CensusOCL::site(CensusKernel, "KernelOCL " + initInfo.kernelName));
+	Util::LogDebug("Created kernel %s\n", initInfo.kernelName.c_str());
+	queryWorkGroupInfo();
 
-	if (!prog)
+	if (!prog) {
 		clReleaseProgram(program);
+		programSite->remove();
+	}
+}
+
+KernelOCL::KernelOCL(const KernelOCL &other, cl_kernel kernel, bool argsCloned) :
+											initInfo(other.initInfo),
+											myKernel(kernel),
+											workGroupSize(other.workGroupSize),
+											preferredWorkGroupSizeMultiple(other.preferredWorkGroupSizeMultiple),
+											localMemorySize(other.localMemorySize),
+											privateMemorySize(other.privateMemorySize),
+											compileWorkGroupSize{other.compileWorkGroupSize[0],
+																other.compileWorkGroupSize[1],
+																other.compileWorkGroupSize[2]},
+											device(other.device),
+											context(other.context),
+											argCount(0),
+											program(other.program),
+											census(CensusOCL::site(CensusKernel,
+													"KernelOCL " + other.initInfo.kernelName)),
+											eventSite(other.eventSite) {
+	// clCloneKernel copies argument values; a re-created kernel has none bound
+	if (argsCloned)
+		boundArgs = other.boundArgs;
+	else
+		bind(other.boundArgs);
+}
+
+void KernelOCL::queryWorkGroupInfo() {
+	cl_int error_code = clGetKernelWorkGroupInfo(myKernel, device,
+			CL_KERNEL_WORK_GROUP_SIZE, sizeof(workGroupSize), &workGroupSize,
+			NULL);
+	if (CL_SUCCESS == error_code)
+		error_code = clGetKernelWorkGroupInfo(myKernel, device,
+				CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+				sizeof(preferredWorkGroupSizeMultiple),
+				&preferredWorkGroupSizeMultiple, NULL);
+	if (CL_SUCCESS == error_code)
+		error_code = clGetKernelWorkGroupInfo(myKernel, device,
+				CL_KERNEL_LOCAL_MEM_SIZE, sizeof(localMemorySize),
+				&localMemorySize, NULL);
+	if (CL_SUCCESS == error_code)
+		error_code = clGetKernelWorkGroupInfo(myKernel, device,
+				CL_KERNEL_PRIVATE_MEM_SIZE, sizeof(privateMemorySize),
+				&privateMemorySize, NULL);
+	if (CL_SUCCESS == error_code)
+		error_code = clGetKernelWorkGroupInfo(myKernel, device,
+				CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(compileWorkGroupSize),
+				compileWorkGroupSize, NULL);
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: clGetKernelWorkGroupInfo returned %s for kernel %s.\n",
+				Util::TranslateOpenCLError(error_code),
+				initInfo.kernelName.c_str());
+		throw std::runtime_error(
+				("Failed to query work group info for kernel " + initInfo.kernelName + "\n").c_str());
+	}
+	if (preferredWorkGroupSizeMultiple == 0)
+		preferredWorkGroupSizeMultiple = 1;
 }
 
 KernelOCL::~KernelOCL(void) {
@@ -66,6 +139,14 @@ KernelOCL::~KernelOCL(void) {
 
 cl_program KernelOCL::generateProgram(KernelInitInfo init){
 	cl_program program = 0;
+	if (init.binaryBuildMethod != LOAD_BINARY && !init.helperPrograms.empty()
+			&& ProgramCacheOCL::supportsLinking(init.device)) {
+		program = generateLinkedProgram(init);
+		if (program)
+			return program;
+		Util::LogInfo("Falling back to full build of %s\n",
+				init.programName.c_str());
+	}
 	buildProgramData data = getProgramData(init);
 	if (init.binaryBuildMethod == LOAD_BINARY ) {
 		generateBinaryName(data);
@@ -84,16 +165,47 @@ cl_program KernelOCL::generateProgram(KernelInitInfo init){
 	return program;
 }
 
-void KernelOCL::generateBinaryName(buildProgramData &data) {
-	// try binary
-	char deviceName[1024];
-	auto status = clGetDeviceInfo(data.device,CL_DEVICE_NAME, sizeof(deviceName), deviceName,NULL);
+cl_program KernelOCL::generateLinkedProgram(KernelInitInfo init) {
+	cl_program program = 0;
+#ifdef CL_VERSION_1_2
+	const std::string linkedHelpers = " -D LTK_LINKED_HELPERS";
+	auto library = ProgramCacheOCL::getHelperLibrary(init.device,
+			init.helperPrograms, init.directory,
+			getBuildOptions(init) + " " + init.helperBuildOptions
+					+ linkedHelpers);
+	if (!library)
+		return 0;
+	buildProgramData data = getProgramData(init);
+	data.flagsStr += linkedHelpers;
+	cl_program object = 0;
+	if (compileOpenCLProgram(object, init.device->context, data) == SUCCESS) {
+		std::vector<cl_program> inputs = { object, library };
+		if (linkOpenCLProgram(program, init.device->context, data.device, "",
+				inputs) != SUCCESS)
+			program = 0;
+		clReleaseProgram(object);
+	}
+	clReleaseProgram(library);
+#else
+	(void) init;
+#endif
+	return program;
+}
 
-	// remove white space from device name
-	std::string deviceNameString(deviceName);
-	deviceNameString.erase(	remove_if(deviceNameString.begin(), deviceNameString.end(),::isspace),
-							deviceNameString.end());
-	data.binaryName = data.binaryName + "." + deviceNameString;
+void KernelOCL::generateBinaryName(buildProgramData &data) {
+	// prefer the binary recorded in the manifest for this device, driver and
+	// build options; otherwise fall back to the file name for this key
+	auto key = getBinaryCacheKey(data.device, data.binaryName, data.flagsStr);
+	std::string fileName;
+	if (lookupBinaryManifest(binaryManifestName, key, fileName)
+			|| (!data.programPath.empty()
+					&& lookupBinaryManifest(data.programPath + binaryManifestName,
+							key, fileName))) {
+		data.binaryName = fileName;
+		return;
+	}
+	data.binaryName = getBinaryFileName(data.device, data.binaryName,
+			data.flagsStr);
 }
 
 buildProgramData KernelOCL::getProgramData(KernelInitInfo init) {
@@ -106,19 +218,20 @@ buildProgramData KernelOCL::getProgramData(KernelInitInfo init) {
 	return data;
 }
 
-void KernelOCL::generateBinary(KernelInitInfo init) {
+bool KernelOCL::generateBinary(KernelInitInfo init, std::string outputPath) {
 	buildProgramData data = getProgramData(init);
 	bifData biData;
 	biData.programPath = data.programPath;
 	biData.programFileName = data.programName;
 	biData.binaryName = init.binaryName;
 	biData.flagsStr = data.flagsStr;
+	biData.outputPath = outputPath;
 	if (!(init.binaryBuildMethod & BUILD_BINARY_OFFLINE_ALL_DEVICES)) {
 		biData.numDevices = 1;
 		biData.devices = &init.device->device;
+		biData.context = init.device->context;
 	}
-	generateBinaryImage(biData);
-
+	return generateBinaryImage(biData) == SUCCESS;
 }
 
 std::string KernelOCL::getBuildOptions(KernelInitInfo init) {
@@ -129,19 +242,145 @@ std::string KernelOCL::getBuildOptions(KernelInitInfo init) {
 	return bldOptions.str();
 }
 
+std::unique_ptr<KernelOCL> KernelOCL::clone() {
+	cl_kernel kernel = 0;
+	cl_int error_code = CL_SUCCESS;
+	bool argsCloned = false;
+#ifdef CL_VERSION_2_1
+	if (initInfo.device->deviceInfo->checkOpenCLVersion(2, 1)) {
+		kernel = clCloneKernel(myKernel, &error_code);
+		argsCloned = (error_code == CL_SUCCESS);
+		if (!argsCloned)
+			kernel = 0;
+	}
+#endif
+	if (!kernel) {
+		// kernel holds a reference to its program, even if we have released ours
+		cl_program prog = 0;
+		error_code = clGetKernelInfo(myKernel, CL_KERNEL_PROGRAM, sizeof(prog),
+				&prog, NULL);
+		if (CL_SUCCESS == error_code)
+			kernel = clCreateKernel(prog, initInfo.kernelName.c_str(), &error_code);
+	}
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: failed to clone kernel %s : %s.\n",
+				initInfo.kernelName.c_str(),
+				Util::TranslateOpenCLError(error_code));
+		throw std::runtime_error(
+				("Failed to clone kernel " + initInfo.kernelName + "\n").c_str());
+	}
+
+	return std::unique_ptr<KernelOCL>(new KernelOCL(*this, kernel, argsCloned));
+}
+
+void KernelOCL::setArg(cl_uint index, size_t size, const void *val) {
+	if (boundArgs.equals(index, size, val))
+		return;
+	auto error_code = clSetKernelArg(myKernel, index, size, val);
+	if (DeviceSuccess != error_code) {
+		Util::LogError("Error: setKernelArgs returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		throw std::exception();
+	}
+	boundArgs.set(index, size, val);
+}
+
+void KernelOCL::bind(const KernelArgsOCL &args) {
+	for (cl_uint i = 0; i < args.count(); ++i) {
+		if (args.isSet(i))
+			setArg(i, args.getSize(i), args.getValue(i));
+	}
+}
+
+void KernelOCL::configureLaunch(EnqueueInfoOCL &info, size_t dimX,
+		size_t dimY, size_t dimZ, const size_t *local) const {
+	// target work group size when the kernel leaves the choice to us
+	const size_t targetWorkGroupSize = 256;
+	auto deviceInfo = initInfo.device->deviceInfo;
+	const size_t dims[3] = { std::max<size_t>(dimX, 1), std::max<size_t>(dimY, 1),
+			std::max<size_t>(dimZ, 1) };
+	bool required = compileWorkGroupSize[0] != 0;
+	int dimension = dims[2] > 1 ? 3 : (dims[1] > 1 ? 2 : 1);
+	if (required)
+		dimension = std::max(dimension, compileWorkGroupSize[2] > 1 ? 3 :
+							(compileWorkGroupSize[1] > 1 ? 2 : 1));
+
+	size_t localSize[3] = { 1, 1, 1 };
+	if (required) {
+		for (int i = 0; i < 3; ++i)
+			localSize[i] = compileWorkGroupSize[i];
+	} else if (local) {
+		for (int i = 0; i < dimension; ++i)
+			localSize[i] = local[i];
+	} else {
+		size_t limit = std::min(workGroupSize, targetWorkGroupSize);
+		size_t multiple = std::min(preferredWorkGroupSizeMultiple, limit);
+		if (dimension == 1) {
+			localSize[0] = std::max<size_t>((limit / multiple) * multiple, 1);
+		} else {
+			localSize[0] = std::max<size_t>(multiple, 1);
+			localSize[1] = std::max<size_t>(limit / localSize[0], 1);
+		}
+		for (int i = 0; i < dimension && i < (int)deviceInfo->maxWorkItemDims; ++i)
+			localSize[i] = std::min(localSize[i], deviceInfo->maxWorkItemSizes[i]);
+	}
+
+	size_t total = 1;
+	for (int i = 0; i < 3; ++i) {
+		if (localSize[i] == 0 || (i < (int)deviceInfo->maxWorkItemDims
+						&& localSize[i] > deviceInfo->maxWorkItemSizes[i]))
+			total = 0;
+		total *= localSize[i];
+	}
+	if (total == 0 || total > workGroupSize) {
+		Util::LogError("Error: local work size %dx%dx%d is invalid for kernel %s "
+				"(max work group size %d).\n", (int) localSize[0],
+				(int) localSize[1], (int) localSize[2],
+				initInfo.kernelName.c_str(), (int) workGroupSize);
+		throw std::runtime_error(
+				("Invalid local work size for kernel " + initInfo.kernelName + "\n").c_str());
+	}
+
+	info.dimension = dimension;
+	for (int i = 0; i < 3; ++i) {
+		info.local_work_size[i] = localSize[i];
+		// round up : remainder work items must be discarded by the kernel
+		info.global_work_size[i] = ((dims[i] + localSize[i] - 1) / localSize[i])
+				* localSize[i];
+	}
+}
+
 // Enqueue the command to asynchronously execute the kernel on the device
 void KernelOCL::enqueue(EnqueueInfoOCL &info) {
+	Event profileEvent;
+	cl_event *completion = info.queue->profilingEvent(
+			info.needsCompletionEvent ? info.completionEvent.out(eventSite) : NULL,
+			profileEvent);
 	cl_int error_code = clEnqueueNDRangeKernel(info.queue->getQueueImpl(), myKernel,
 			info.dimension, info.global_work_offset, info.global_work_size,
 			info.local_work_size, info.numWaitEvents,
 			info.numWaitEvents ? (cl_event*)info.waitEvents : NULL,
-			info.needsCompletionEvent ? &info.completionEvent : NULL);
+			completion);
 	if (CL_SUCCESS != error_code) {
 		Util::LogError("Error: clEnqueueNDRangeKernel returned %s.\n",
 				Util::TranslateOpenCLError(error_code));
 		throw std::exception();
 	}
+	if (completion)
+		info.queue->profile(
+				info.label.empty() ? initInfo.kernelName : info.label,
+				*completion);
+	if (info.queue->getCounters())
+		info.queue->getCounters()->addKernels(1);
+	info.queue->onEnqueue();
 	argCount = 0;
 }
+FutureOCL KernelOCL::enqueueAsync(EnqueueInfoOCL &info) {
+	info.needsCompletionEvent = true;
+	enqueue(info);
+
+	return FutureOCL(std::move(info.completionEvent),
+			initInfo.device->getCompletionDispatcher());
+}
 }
 #endif
@@ -25,6 +25,10 @@
 #include "QueueOCL.h"
 #include "UtilOCL.h"
 #include "EnqueueInfoOCL.h"
+#include "KernelArgsOCL.h"
+#include "FutureOCL.h"
+#include <memory>
+#include <vector>
 
 
 namespace ltk {
@@ -70,6 +74,15 @@ struct KernelInitInfo: KernelInitInfoBase {
 	std::string programName;
 	std::string binaryName;
 	std::string kernelName;
+	// Optional helper sources, compiled once per device into a library that
+	// the program is linked against. The program and helper library are
+	// compiled with LTK_LINKED_HELPERS defined. Ignored when loading a binary,
+	// or if the device cannot link; the program is then built as a whole.
+	std::vector<std::string> helperPrograms;
+	// compile options for helper library, in addition to device options.
+	// Options that vary between kernels (e.g. tile sizes) belong in buildOptions
+	// so that the library can be shared
+	std::string helperBuildOptions;
 };
 
 class KernelOCL {
@@ -86,28 +99,89 @@ public:
 	cl_device_id getDevice() {
 		return device;
 	}
+	const std::string& getKernelName() const {
+		return initInfo.kernelName;
+	}
 	void enqueue(EnqueueInfoOCL &info);
-	static void generateBinary(KernelInitInfo init);
+	// enqueue, and return a future for the launch; continuations run
+	// on the device's completion dispatcher
+	FutureOCL enqueueAsync(EnqueueInfoOCL &info);
+	// build program binary offline, writing binaries and manifest entries
+	// to outputPath (empty for current directory, otherwise with trailing separator)
+	static bool generateBinary(KernelInitInfo init, std::string outputPath = "");
+
+	// Create an independent kernel object with the same arguments bound.
+	// Kernel objects are not thread safe, so each submitting thread (or queue)
+	// should enqueue through its own clone.
+	// Uses clCloneKernel on OpenCL 2.1+ devices, otherwise re-creates the
+	// kernel from its program and re-binds the arguments.
+	std::unique_ptr<KernelOCL> clone();
+
+	// set argument at index, skipping clSetKernelArg if value is unchanged
+	void setArg(cl_uint index, size_t size, const void *val);
+	template<typename T> void setArg(cl_uint index, T *val) {
+		setArg(index, sizeof(T), val);
+	}
+	// bind all arguments in set, skipping those that are unchanged
+	void bind(const KernelArgsOCL &args);
 
 	template<typename T> void pushArg(T *val) {
-		auto error_code = clSetKernelArg(myKernel, argCount++, sizeof(T), val);
-		if (DeviceSuccess != error_code) {
-			Util::LogError("Error: setKernelArgs returned %s.\n",
-					Util::TranslateOpenCLError(error_code));
-			throw std::exception();
-		}
+		setArg(argCount++, sizeof(T), val);
+	}
+
+	// work group metadata, queried when the kernel is created
+	size_t getWorkGroupSize() const {
+		return workGroupSize;
 	}
+	size_t getPreferredWorkGroupSizeMultiple() const {
+		return preferredWorkGroupSizeMultiple;
+	}
+	cl_ulong getLocalMemorySize() const {
+		return localMemorySize;
+	}
+	cl_ulong getPrivateMemorySize() const {
+		return privateMemorySize;
+	}
+	// reqd_work_group_size of kernel, or zeros if not specified
+	const size_t* getCompileWorkGroupSize() const {
+		return compileWorkGroupSize;
+	}
+
+	/**
+	 * configureLaunch
+	 * set dimension, local and global work sizes for a problem of size
+	 * dimX x dimY x dimZ. Local size is the kernel's reqd_work_group_size if
+	 * present, otherwise local if not null, otherwise derived from the preferred
+	 * work group size multiple. Global size is rounded up to a multiple of the
+	 * local size in each dimension, so the kernel must discard work items
+	 * outside of the problem.
+	 * Throws if the local size exceeds device or kernel limits.
+	 */
+	void configureLaunch(EnqueueInfoOCL &info, size_t dimX, size_t dimY = 1,
+			size_t dimZ = 1, const size_t *local = nullptr) const;
 protected:
+	KernelOCL(const KernelOCL &other, cl_kernel kernel, bool argsCloned);
+	void queryWorkGroupInfo();
+	static cl_program generateLinkedProgram(KernelInitInfo init);
 	static void generateBinaryName(buildProgramData &data);
 	static buildProgramData getProgramData(KernelInitInfo init);
 	static std::string getBuildOptions(KernelInitInfo init);
 	KernelInitInfo initInfo;
 	cl_kernel myKernel;
+	size_t workGroupSize;
+	size_t preferredWorkGroupSizeMultiple;
 	cl_ulong localMemorySize;
+	cl_ulong privateMemorySize;
+	size_t compileWorkGroupSize[3];
 	cl_device_id device;
 	cl_context context;
 	uint32_t argCount;
 	cl_program program;
+	// mirror of arguments currently bound to myKernel
+	KernelArgsOCL boundArgs;
+	// census sites are keyed on kernel name
+	CensusTokenOCL census;
+	CensusSiteOCL *eventSite;
 };
 }
 #endif
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "LoggerOCL.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ltk {
+
+namespace {
+
+const size_t logBufferCapacity = 1024;
+
+struct LogEntry {
+	LogLevel level;
+	std::string text;
+};
+
+// single producer (owning thread), single consumer (drain thread) ring
+struct LogBuffer {
+	LogBuffer() :
+			head(0), tail(0), retired(false) {
+	}
+	LogEntry slots[logBufferCapacity];
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	// owning thread has exited
+	std::atomic<bool> retired;
+};
+
+// binary semaphore with a single waiter, the drain thread. On Linux,
+// post() is a futex wake and never takes a lock
+class WakeSignal {
+public:
+	WakeSignal() :
+			word(0) {
+	}
+	void post() {
+		if (word.exchange(1))
+			return;
+#ifdef __linux__
+		syscall(SYS_futex, (int*) &word, FUTEX_WAKE_PRIVATE, 1, nullptr,
+				nullptr, 0);
+#else
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+		}
+		condition.notify_one();
+#endif
+	}
+	void wait() {
+		while (!word.exchange(0)) {
+#ifdef __linux__
+			syscall(SYS_futex, (int*) &word, FUTEX_WAIT_PRIVATE, 0, nullptr,
+					nullptr, 0);
+#else
+			std::unique_lock<std::mutex> lk(mutex);
+			condition.wait(lk, [this] {
+				return word.load() != 0;
+			});
+#endif
+		}
+	}
+private:
+	static_assert(sizeof(std::atomic<int>) == sizeof(int),
+			"futex word must be a plain int");
+	std::atomic<int> word;
+#ifndef __linux__
+	std::mutex mutex;
+	std::condition_variable condition;
+#endif
+};
+
+struct Sink {
+	Sink() :
+			stopping(false), stopped(false), flushTarget(0), sleeping(false),
+			drained(0), dropped(0), previousTerminate(nullptr) {
+	}
+	std::mutex mutex;
+	WakeSignal wake;
+	std::condition_variable drainedCondition;
+	std::vector<std::shared_ptr<LogBuffer>> buffers;
+	std::thread drainer;
+	bool stopping;
+	// after shutdown, messages are written synchronously
+	std::atomic<bool> stopped;
+	// drain passes requested by flush()
+	uint64_t flushTarget;
+	// drain thread is waiting, or about to wait, on wake : the first
+	// producer to clear it posts wake
+	std::atomic<bool> sleeping;
+	uint64_t drained;
+	std::atomic<uint64_t> dropped;
+	std::terminate_handler previousTerminate;
+};
+
+// never destroyed : threads may log during static destruction
+Sink& sink() {
+	static Sink *instance = new Sink();
+	return *instance;
+}
+
+std::atomic<int>& level() {
+	static std::atomic<int> instance([] {
+		LogLevel rc = LogLevelInfo;
+		auto env = getenv("LATKE_LOG_LEVEL");
+		if (env)
+			LoggerOCL::parseLevel(env, rc);
+		return (int) rc;
+	}());
+	return instance;
+}
+
+void writeEntry(LogLevel lvl, const std::string &text) {
+	fwrite(text.data(), 1, text.size(), lvl >= LogLevelWarning ? stderr : stdout);
+}
+
+// write all queued messages; returns true if any were written
+bool drainBuffer(LogBuffer &buf) {
+	auto t = buf.tail.load(std::memory_order_relaxed);
+	auto h = buf.head.load(std::memory_order_acquire);
+	if (t == h)
+		return false;
+	for (; t != h; ++t) {
+		auto &entry = buf.slots[t % logBufferCapacity];
+		writeEntry(entry.level, entry.text);
+		std::string().swap(entry.text);
+		buf.tail.store(t + 1, std::memory_order_release);
+	}
+	return true;
+}
+
+bool hasQueued(const std::vector<std::shared_ptr<LogBuffer>> &buffers) {
+	for (auto &b : buffers) {
+		if (b->tail.load(std::memory_order_relaxed) != b->head.load())
+			return true;
+	}
+	return false;
+}
+
+// snapshot of registered buffers; returns true if there is work other
+// than queued messages : stop or flush
+bool refresh(Sink &s, std::vector<std::shared_ptr<LogBuffer>> &buffers,
+		bool &stop) {
+	std::lock_guard<std::mutex> lk(s.mutex);
+	stop = s.stopping;
+	// buffers of exited threads are dropped once drained
+	for (auto iter = s.buffers.begin(); iter != s.buffers.end();) {
+		auto &b = *iter;
+		if (b->retired.load(std::memory_order_acquire)
+				&& b->tail.load(std::memory_order_relaxed)
+						== b->head.load(std::memory_order_acquire))
+			iter = s.buffers.erase(iter);
+		else
+			++iter;
+	}
+	buffers = s.buffers;
+	return stop || s.drained < s.flushTarget;
+}
+
+void drainLoop() {
+	auto &s = sink();
+	std::vector<std::shared_ptr<LogBuffer>> buffers;
+	uint64_t reportedDrops = 0;
+	while (true) {
+		bool stop;
+		if (!refresh(s, buffers, stop) && !hasQueued(buffers)) {
+			// pairs with the head store and sleeping load in write() : either
+			// the producer sees sleeping and posts wake, or we see its
+			// message. Threads registering a buffer post wake with their
+			// first message; flush() and shutdown always post it
+			s.sleeping.store(true);
+			if (!hasQueued(buffers))
+				s.wake.wait();
+			s.sleeping.store(false);
+			refresh(s, buffers, stop);
+		}
+		bool wrote = false;
+		for (auto &b : buffers)
+			wrote |= drainBuffer(*b);
+		auto drops = s.dropped.load(std::memory_order_relaxed);
+		if (drops != reportedDrops) {
+			fprintf(stderr, "latke : %llu log messages dropped\n",
+					(unsigned long long) (drops - reportedDrops));
+			reportedDrops = drops;
+			wrote = true;
+		}
+		if (wrote) {
+			fflush(stdout);
+			fflush(stderr);
+		}
+		{
+			std::lock_guard<std::mutex> lk(s.mutex);
+			s.drained++;
+		}
+		s.drainedCondition.notify_all();
+		if (stop)
+			break;
+	}
+}
+
+// queued messages, often the error that led here, are written before
+// the process aborts
+void onTerminate() {
+	auto &s = sink();
+	if (!s.stopped)
+		LoggerOCL::flush();
+	if (s.previousTerminate)
+		s.previousTerminate();
+	abort();
+}
+
+// owning thread's buffer, registered on first use. Plain thread locals
+// stay valid while the thread exits, unlike the holder
+thread_local LogBuffer *threadLog = nullptr;
+thread_local bool threadExited = false;
+struct ThreadBuffer {
+	~ThreadBuffer() {
+		threadExited = true;
+		if (buf)
+			buf->retired.store(true, std::memory_order_release);
+	}
+	std::shared_ptr<LogBuffer> buf;
+};
+thread_local ThreadBuffer threadBuffer;
+
+LogBuffer* getThreadLog() {
+	if (threadExited)
+		return nullptr;
+	if (!threadLog) {
+		auto &s = sink();
+		std::lock_guard<std::mutex> lk(s.mutex);
+		if (s.stopping)
+			return nullptr;
+		threadBuffer.buf = std::make_shared<LogBuffer>();
+		threadLog = threadBuffer.buf.get();
+		s.buffers.push_back(threadBuffer.buf);
+		if (!s.drainer.joinable()) {
+			s.drainer = std::thread(drainLoop);
+			s.previousTerminate = std::set_terminate(onTerminate);
+		}
+	}
+	return threadLog;
+}
+
+// drains and stops the drain thread before exit
+struct Shutdown {
+	~Shutdown() {
+		auto &s = sink();
+		std::thread drainer;
+		{
+			std::lock_guard<std::mutex> lk(s.mutex);
+			s.stopping = true;
+			drainer = std::move(s.drainer);
+		}
+		s.wake.post();
+		if (drainer.joinable())
+			drainer.join();
+		s.stopped = true;
+		// messages queued after the final drain
+		std::lock_guard<std::mutex> lk(s.mutex);
+		for (auto &b : s.buffers)
+			drainBuffer(*b);
+		fflush(stdout);
+		fflush(stderr);
+	}
+} shutdownGuard;
+
+}
+
+void LoggerOCL::setLevel(LogLevel lvl) {
+	level().store((int) lvl, std::memory_order_relaxed);
+}
+
+LogLevel LoggerOCL::getLevel() {
+	return (LogLevel) level().load(std::memory_order_relaxed);
+}
+
+void LoggerOCL::log(LogLevel lvl, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vlog(lvl, format, args);
+	va_end(args);
+}
+
+void LoggerOCL::vlog(LogLevel lvl, const char *format, va_list args) {
+	if (!format || !isEnabled(lvl))
+		return;
+	char stackBuffer[256];
+	va_list copy;
+	va_copy(copy, args);
+	int len = vsnprintf(stackBuffer, sizeof(stackBuffer), format, copy);
+	va_end(copy);
+	if (len < 0)
+		return;
+	if ((size_t) len < sizeof(stackBuffer)) {
+		write(lvl, std::string(stackBuffer, (size_t) len));
+		return;
+	}
+	std::string text((size_t) len + 1, '\0');
+	vsnprintf(&text[0], text.size(), format, args);
+	text.resize((size_t) len);
+	write(lvl, text);
+}
+
+void LoggerOCL::write(LogLevel lvl, const std::string &message) {
+	if (!isEnabled(lvl))
+		return;
+	auto &s = sink();
+	LogBuffer *buf = s.stopped ? nullptr : getThreadLog();
+	if (!buf) {
+		writeEntry(lvl, message);
+		return;
+	}
+	auto h = buf->head.load(std::memory_order_relaxed);
+	if (h - buf->tail.load(std::memory_order_acquire) >= logBufferCapacity) {
+		// errors are never dropped
+		if (lvl >= LogLevelError) {
+			flush();
+			writeEntry(lvl, message);
+			fflush(stderr);
+		} else {
+			s.dropped.fetch_add(1, std::memory_order_relaxed);
+		}
+		return;
+	}
+	auto &entry = buf->slots[h % logBufferCapacity];
+	entry.level = lvl;
+	entry.text = message;
+	buf->head.store(h + 1);
+	if (s.sleeping.load() && s.sleeping.exchange(false))
+		s.wake.post();
+}
+
+void LoggerOCL::flush() {
+	auto &s = sink();
+	std::unique_lock<std::mutex> lk(s.mutex);
+	if (!s.drainer.joinable())
+		return;
+	// the drain in progress may have missed messages queued before this call
+	auto target = s.drained + 2;
+	if (s.flushTarget < target)
+		s.flushTarget = target;
+	s.wake.post();
+	s.drainedCondition.wait(lk, [&s, target] {
+		return s.drained >= target || s.stopping;
+	});
+}
+
+uint64_t LoggerOCL::getDropped() {
+	return sink().dropped.load(std::memory_order_relaxed);
+}
+
+bool LoggerOCL::parseLevel(const std::string &name, LogLevel &lvl) {
+	static const char *names[] = { "debug", "info", "warning", "error", "off" };
+	for (int i = 0; i <= LogLevelOff; ++i) {
+		if (name == names[i]) {
+			lvl = (LogLevel) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+
+namespace ltk {
+
+enum LogLevel {
+	LogLevelDebug,
+	LogLevelInfo,
+	LogLevelWarning,
+	LogLevelError,
+	LogLevelOff
+};
+
+/**
+ * LoggerOCL
+ *
+ * Process wide, level gated log sink. Messages below the current level are
+ * discarded before formatting. Enabled messages are queued on a lock free
+ * buffer owned by the calling thread, and a background thread drains all
+ * buffers to stdout (debug and info) or stderr (warning and error), so
+ * logging never takes the stdio lock or waits on a slow terminal.
+ * If a thread's buffer is full, its messages are dropped and counted;
+ * error messages are written directly instead. On Linux producers never
+ * lock : the first message to find the drain thread asleep wakes it.
+ * Queued messages are written at exit, and before std::terminate aborts.
+ *
+ * Messages from one thread are written in order; messages from different
+ * threads are not ordered. The initial level is read from the LATKE_LOG_LEVEL
+ * environment variable (debug, info, warning, error or off), default info.
+ */
+class LoggerOCL {
+public:
+	static void setLevel(LogLevel level);
+	static LogLevel getLevel();
+	static bool isEnabled(LogLevel level) {
+		return level >= getLevel() && level != LogLevelOff;
+	}
+
+	// printf style
+	static void log(LogLevel level, const char *format, ...);
+	static void vlog(LogLevel level, const char *format, va_list args);
+	static void write(LogLevel level, const std::string &message);
+
+	// block until all messages queued so far are written
+	static void flush();
+	// messages dropped on full buffers so far
+	static uint64_t getDropped();
+	// parse a level name; returns false if name is not a level
+	static bool parseLevel(const std::string &name, LogLevel &level);
+};
+
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "ProfilerOCL.h"
+#include "DeviceOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+
+namespace ltk {
+
+// collect finished commands from the front once this many are waiting,
+// to bound retained events
+const size_t maxPendingProfileEvents = 1024;
+
+ProfilerOCL::ProfilerOCL(DeviceOCL *device) :
+		hostCorrelated(false), deviceReference(0), hostReference(0) {
+#ifdef CL_VERSION_2_1
+	if (device->deviceInfo->checkOpenCLVersion(2, 1)) {
+		// the driver's host timer is implementation defined : only its
+		// device timer is used, paired with our own host clock
+		cl_ulong driverHostTime = 0;
+		cl_int error_code = clGetDeviceAndHostTimer(device->device,
+				&deviceReference, &driverHostTime);
+		hostReference = hostNow();
+		if (CL_SUCCESS == error_code)
+			hostCorrelated = true;
+		else
+			Util::LogError("Error: clGetDeviceAndHostTimer returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+	}
+#else
+	(void) device;
+#endif
+}
+
+ProfilerOCL::~ProfilerOCL() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &p : pending)
+		Util::ReleaseEvent(p.evt);
+}
+
+void ProfilerOCL::record(const std::string &label, cl_event evt) {
+	if (!evt)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.push_back( { label, Util::RetainEvent(evt) });
+	if (pending.size() >= maxPendingProfileEvents)
+		collectFrontLocked();
+}
+
+void ProfilerOCL::collect() {
+	std::lock_guard<std::mutex> lock(mutex);
+	collectLocked(false);
+}
+
+cl_ulong ProfilerOCL::toHostTime(cl_ulong deviceTime) const {
+	if (!hostCorrelated)
+		return deviceTime;
+	return deviceTime + hostReference - deviceReference;
+}
+
+cl_ulong ProfilerOCL::hostNow() {
+	return (cl_ulong) std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+cl_int ProfilerOCL::getExecutionStatus(const Pending &p) {
+	cl_int status = CL_COMPLETE;
+	cl_int error_code = clGetEventInfo(p.evt, CL_EVENT_COMMAND_EXECUTION_STATUS,
+			sizeof(status), &status, nullptr);
+	// an event that can't be queried is treated as failed
+	return CL_SUCCESS == error_code ? status : error_code;
+}
+
+void ProfilerOCL::collectFrontLocked() {
+	while (!pending.empty()) {
+		auto status = getExecutionStatus(pending.front());
+		if (status > CL_COMPLETE)
+			break;
+		addSample(pending.front(), status);
+		pending.pop_front();
+	}
+}
+
+void ProfilerOCL::collectLocked(bool all) {
+	std::deque<Pending> stillPending;
+	for (auto &p : pending) {
+		auto status = getExecutionStatus(p);
+		if (status > CL_COMPLETE && !all)
+			stillPending.push_back(p);
+		else
+			addSample(p, status);
+	}
+	pending.swap(stillPending);
+}
+
+void ProfilerOCL::addSample(const Pending &p, cl_int status) {
+	if (CL_COMPLETE == status) {
+		cl_int error_code = CL_SUCCESS;
+		cl_ulong times[4] = { 0, 0, 0, 0 };
+		const cl_profiling_info params[4] = { CL_PROFILING_COMMAND_QUEUED,
+				CL_PROFILING_COMMAND_SUBMIT, CL_PROFILING_COMMAND_START,
+				CL_PROFILING_COMMAND_END };
+		for (int i = 0; i < 4 && CL_SUCCESS == error_code; ++i)
+			error_code = clGetEventProfilingInfo(p.evt, params[i],
+					sizeof(cl_ulong), times + i, nullptr);
+		if (CL_SUCCESS == error_code) {
+			ProfileSample sample;
+			sample.label = p.label;
+			sample.queue = nullptr;
+			clGetEventInfo(p.evt, CL_EVENT_COMMAND_QUEUE,
+					sizeof(sample.queue), &sample.queue, nullptr);
+			sample.queued = toHostTime(times[0]);
+			sample.submit = toHostTime(times[1]);
+			sample.start = toHostTime(times[2]);
+			sample.end = toHostTime(times[3]);
+			if (samples.size() == maxProfileSamples)
+				samples.pop_front();
+			samples.push_back(sample);
+
+			auto &s = stats[p.label];
+			double execution = (double) (sample.end - sample.start) / 1e6;
+			s.queueWait += (double) (sample.submit - sample.queued) / 1e6;
+			s.submitLatency += (double) (sample.start - sample.submit) / 1e6;
+			s.execution += execution;
+			s.minExecution =
+					s.count ? std::min(s.minExecution, execution) : execution;
+			s.maxExecution = std::max(s.maxExecution, execution);
+			s.count++;
+		} else {
+			// e.g. queue created without CL_QUEUE_PROFILING_ENABLE
+			Util::LogError("Error: clGetEventProfilingInfo returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+		}
+	}
+	Util::ReleaseEvent(p.evt);
+}
+
+std::map<std::string, ProfileStats> ProfilerOCL::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	collectLocked(false);
+	return stats;
+}
+
+std::vector<ProfileSample> ProfilerOCL::getSamples() {
+	std::lock_guard<std::mutex> lock(mutex);
+	collectLocked(false);
+	return std::vector<ProfileSample>(samples.begin(), samples.end());
+}
+
+void ProfilerOCL::report(std::ostream &out) {
+	auto labelStats = getStats();
+	out << "device profile ("
+			<< (hostCorrelated ? "host correlated" : "device timer")
+			<< "), mean ms :" << std::endl;
+	out << std::left << std::setw(24) << "label" << std::right << std::setw(8)
+			<< "count" << std::setw(12) << "queue wait" << std::setw(12)
+			<< "submit" << std::setw(12) << "execution" << std::setw(12)
+			<< "min" << std::setw(12) << "max" << std::endl;
+	out << std::fixed << std::setprecision(3);
+	for (auto &entry : labelStats) {
+		auto &s = entry.second;
+		double n = (double) s.count;
+		out << std::left << std::setw(24) << entry.first << std::right
+				<< std::setw(8) << s.count << std::setw(12) << s.queueWait / n
+				<< std::setw(12) << s.submitLatency / n << std::setw(12)
+				<< s.execution / n << std::setw(12) << s.minExecution
+				<< std::setw(12) << s.maxExecution << std::endl;
+	}
+}
+
+void ProfilerOCL::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	collectLocked(true);
+	samples.clear();
+	stats.clear();
+}
+
+}
+#endif
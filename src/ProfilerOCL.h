@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <cstdint>
+
+namespace ltk {
+
+// samples kept by ProfilerOCL : older samples are discarded
+const size_t maxProfileSamples = 65536;
+
+// timestamps of one command, in nanoseconds
+struct ProfileSample {
+	std::string label;
+	cl_command_queue queue;
+	cl_ulong queued;
+	cl_ulong submit;
+	cl_ulong start;
+	cl_ulong end;
+};
+
+// per label totals, in milliseconds
+struct ProfileStats {
+	ProfileStats() :
+			count(0), queueWait(0), submitLatency(0), execution(0), minExecution(
+					0), maxExecution(0) {
+	}
+	uint64_t count;
+	// QUEUED to SUBMIT
+	double queueWait;
+	// SUBMIT to START
+	double submitLatency;
+	// START to END
+	double execution;
+	double minExecution;
+	double maxExecution;
+};
+
+/**
+ * ProfilerOCL
+ *
+ * Collects QUEUED/SUBMIT/START/END timestamps of labelled commands. Attach
+ * a profiler to queues created with CL_QUEUE_PROFILING_ENABLE; every kernel
+ * launch and map/unmap on them is then recorded under its label.
+ * Per label stats cover every command; only the most recent
+ * maxProfileSamples samples are kept, so long runs use bounded memory.
+ *
+ * If the device supports clGetDeviceAndHostTimer (OpenCL 2.1), sample
+ * timestamps are converted to hostNow()'s clock, so they can be lined
+ * up with host events; otherwise they are raw device timestamps.
+ */
+class ProfilerOCL {
+public:
+	ProfilerOCL(DeviceOCL *device);
+	~ProfilerOCL();
+
+	// record command of evt under label; evt is retained until its
+	// timestamps are collected
+	void record(const std::string &label, cl_event evt);
+	// read timestamps of completed commands
+	void collect();
+
+	bool isHostCorrelated() const {
+		return hostCorrelated;
+	}
+	// device timestamp to host clock, if correlated
+	cl_ulong toHostTime(cl_ulong deviceTime) const;
+	// host clock, in nanoseconds
+	static cl_ulong hostNow();
+
+	std::map<std::string, ProfileStats> getStats();
+	// most recent samples, oldest first
+	std::vector<ProfileSample> getSamples();
+	void report(std::ostream &out);
+	void clear();
+private:
+	struct Pending {
+		std::string label;
+		cl_event evt;
+	};
+	// CL_COMPLETE, a pending status (> CL_COMPLETE), or an error
+	static cl_int getExecutionStatus(const Pending &p);
+	// record timestamps of p if it completed, and release its event
+	void addSample(const Pending &p, cl_int status);
+	// collect finished commands from the front, stopping at the first
+	// unfinished one : O(1) per command on the record() path
+	void collectFrontLocked();
+	void collectLocked(bool all);
+	std::mutex mutex;
+	// in record order
+	std::deque<Pending> pending;
+	std::deque<ProfileSample> samples;
+	std::map<std::string, ProfileStats> stats;
+	bool hostCorrelated;
+	cl_ulong deviceReference;
+	cl_ulong hostReference;
+};
+
+}
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "ProgramCacheOCL.h"
+#include "DeviceOCL.h"
+#include "UtilOCL.h"
+#include "CensusOCL.h"
+#include <sstream>
+
+namespace ltk {
+
+std::mutex ProgramCacheOCL::cacheMutex;
+std::map<std::string, ProgramCacheOCL::Library> ProgramCacheOCL::libraries;
+
+bool ProgramCacheOCL::supportsLinking(DeviceOCL *device) {
+#ifdef CL_VERSION_1_2
+	return device->deviceInfo->checkOpenCLVersion(1, 2)
+			&& device->deviceInfo->linkerAvailable;
+#else
+	(void) device;
+	return false;
+#endif
+}
+
+std::string ProgramCacheOCL::getKey(DeviceOCL *device,
+		const std::vector<std::string> &helperPrograms,
+		const std::string &directory, const std::string &options) {
+	std::stringstream key;
+	key << device->context << "|" << device->device << "|" << directory;
+	for (auto &helper : helperPrograms)
+		key << "|" << helper;
+	key << "|" << options;
+	return key.str();
+}
+
+static CensusSiteOCL* librarySite() {
+	static CensusSiteOCL *site = CensusOCL::site(CensusProgram,
+			"ProgramCacheOCL library");
+	return site;
+}
+
+cl_program ProgramCacheOCL::getHelperLibrary(DeviceOCL *device,
+		const std::vector<std::string> &helperPrograms,
+		const std::string &directory, const std::string &options) {
+	if (helperPrograms.empty() || !supportsLinking(device))
+		return 0;
+	auto key = getKey(device, helperPrograms, directory, options);
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	auto iter = libraries.find(key);
+	if (iter == libraries.end()) {
+		device->counters.programCacheMisses++;
+		auto program = buildLibrary(device, helperPrograms, directory, options);
+		if (!program)
+			return 0;
+		iter = libraries.insert(std::make_pair(key,
+						Library { device->context, device->device, program })).first;
+		librarySite()->add();
+	} else {
+		device->counters.programCacheHits++;
+	}
+	clRetainProgram(iter->second.program);
+
+	return iter->second.program;
+}
+
+cl_program ProgramCacheOCL::buildLibrary(DeviceOCL *device,
+		const std::vector<std::string> &helperPrograms,
+		const std::string &directory, const std::string &options) {
+	cl_program library = 0;
+#ifdef CL_VERSION_1_2
+	std::vector<cl_program> objects;
+	bool success = true;
+	for (auto &helper : helperPrograms) {
+		buildProgramData data;
+		data.device = device->device;
+		data.programName = helper;
+		data.programPath = directory;
+		data.flagsStr = options;
+		cl_program object = 0;
+		if (compileOpenCLProgram(object, device->context, data) != SUCCESS) {
+			success = false;
+			break;
+		}
+		objects.push_back(object);
+	}
+	if (success) {
+		if (linkOpenCLProgram(library, device->context, device->device,
+				"-create-library", objects) != SUCCESS)
+			library = 0;
+		else
+			Util::LogInfo("Created helper library for %zu program(s)\n",
+					helperPrograms.size());
+	}
+	for (auto object : objects)
+		clReleaseProgram(object);
+#else
+	(void) device;
+	(void) helperPrograms;
+	(void) directory;
+	(void) options;
+#endif
+	return library;
+}
+
+void ProgramCacheOCL::release(DeviceOCL *device) {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	for (auto iter = libraries.begin(); iter != libraries.end();) {
+		if (iter->second.context == device->context
+				&& iter->second.device == device->device) {
+			clReleaseProgram(iter->second.program);
+			librarySite()->remove();
+			iter = libraries.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+}
+
+void ProgramCacheOCL::clear() {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	for (auto &entry : libraries) {
+		clReleaseProgram(entry.second.program);
+		librarySite()->remove();
+	}
+	libraries.clear();
+}
+
+}
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace ltk {
+
+struct DeviceOCL;
+
+/**
+ * ProgramCacheOCL
+ *
+ * Process wide cache of compiled helper libraries. Helper sources are
+ * compiled with clCompileProgram and linked with -create-library once per
+ * (context, device, sources, options); kernel programs are then linked
+ * against the cached library instead of recompiling the helpers.
+ */
+class ProgramCacheOCL {
+public:
+	/**
+	 * getHelperLibrary
+	 * look up helper library, building it on first request
+	 * @param device device to build for
+	 * @param helperPrograms helper source files, relative to directory
+	 * @param directory source directory
+	 * @param options compile options
+	 * @return library with a reference owned by the caller, or 0 on failure
+	 */
+	static cl_program getHelperLibrary(DeviceOCL *device,
+			const std::vector<std::string> &helperPrograms,
+			const std::string &directory, const std::string &options);
+
+	// true if device can compile and link separately (OpenCL 1.2+)
+	static bool supportsLinking(DeviceOCL *device);
+
+	// release all libraries built for device
+	static void release(DeviceOCL *device);
+	static void clear();
+private:
+	struct Library {
+		cl_context context;
+		cl_device_id device;
+		cl_program program;
+	};
+	static std::string getKey(DeviceOCL *device,
+			const std::vector<std::string> &helperPrograms,
+			const std::string &directory, const std::string &options);
+	static cl_program buildLibrary(DeviceOCL *device,
+			const std::vector<std::string> &helperPrograms,
+			const std::string &directory, const std::string &options);
+	static std::mutex cacheMutex;
+	static std::map<std::string, Library> libraries;
+};
+
+}
+#endif
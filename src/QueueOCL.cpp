@@ -22,25 +22,113 @@
 #include "QueueOCL.h"
 #include "DeviceOCL.h"
 #include "UtilOCL.h"
+#include "ProfilerOCL.h"
+#include "EventOCL.h"
 #include <numeric>
 #include <algorithm>
 #include <iterator>
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <set>
+#include <thread>
+#include <condition_variable>
+#include <shared_mutex>
 
 namespace ltk {
 
+// every live QueueOCL. Held shared while flushing a queue, so queues can't be
+// destroyed under a flush. Lock order : liveQueuesMutex, then a queue's
+// submitMutex, then the latency flusher's mutex.
+static std::shared_timed_mutex liveQueuesMutex;
+static std::set<QueueOCL*> liveQueues;
+
+// queues that received commands while the calling thread tracks its enqueues
+static thread_local bool tracking = false;
+static thread_local std::vector<QueueOCL*> trackedQueues;
+
+/**
+ * Flushes queues whose oldest unflushed command reaches the latency limit,
+ * even when nothing else is enqueued on them. Sleeps until the earliest
+ * armed deadline, or indefinitely when none is armed.
+ */
+class LatencyFlusher {
+public:
+	LatencyFlusher() :
+			stopping(false), deadline(Clock::time_point::max()) {
+	}
+	~LatencyFlusher() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_one();
+		if (thread.joinable())
+			thread.join();
+	}
+	void arm(std::chrono::steady_clock::time_point when) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping || when >= deadline)
+			return;
+		deadline = when;
+		if (!thread.joinable())
+			thread = std::thread([this] {
+				run();
+			});
+		wake.notify_one();
+	}
+private:
+	typedef std::chrono::steady_clock Clock;
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!stopping) {
+			if (deadline == Clock::time_point::max()) {
+				wake.wait(lock);
+				continue;
+			}
+			if (wake.wait_until(lock, deadline) != std::cv_status::timeout
+					&& Clock::now() < deadline)
+				continue;
+			deadline = Clock::time_point::max();
+			lock.unlock();
+			// queues that are not due yet re-arm
+			QueueOCL::flushExpired();
+			lock.lock();
+		}
+	}
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+	Clock::time_point deadline;
+	std::thread thread;
+};
+// destroyed before the queue registry
+static LatencyFlusher latencyFlusher;
+
 QueueOCL::QueueOCL(QueueOCL &rhs) :
-		queue(rhs.queue), ownsQueue(rhs.ownsQueue) {
+		queue(rhs.queue), ownsQueue(rhs.ownsQueue), properties(rhs.properties),
+		profiler(rhs.getProfiler()), counters(rhs.counters),
+		policy(rhs.getFlushPolicy()),
+		pendingCommands(0), pendingBytes(0) {
+	addLive();
 }
 QueueOCL::QueueOCL(cl_command_queue cmdQueue) :
-		queue(cmdQueue), ownsQueue(false) {
+		queue(cmdQueue), ownsQueue(false), properties(0), profiler(nullptr),
+		counters(nullptr), pendingCommands(0), pendingBytes(0) {
+	cl_int errorCode = clGetCommandQueueInfo(queue, CL_QUEUE_PROPERTIES,
+			sizeof(properties), &properties, nullptr);
+	if (errorCode != CL_SUCCESS)
+		Util::LogError("Error: clGetCommandQueueInfo() returned %s.\n",
+				Util::TranslateOpenCLError(errorCode));
+	addLive();
 }
 
 QueueOCL::QueueOCL(DeviceOCL *device, cl_command_queue_properties queue_props) :
-		queue(0), ownsQueue(true) {
+		queue(0), ownsQueue(true), properties(0), profiler(nullptr),
+		counters(&device->counters), pendingCommands(0), pendingBytes(0) {
 	cl_int errorCode;
+	queue_props = device->getSupportedQueueProperties(queue_props);
+	properties = queue_props;
 
 #ifdef CL_VERSION_2_0
 	// Create command queue
@@ -62,9 +150,20 @@ QueueOCL::QueueOCL(DeviceOCL *device, cl_command_queue_properties queue_props) :
 	}
 	if (!queue)
 		throw std::runtime_error("Failed to create command queue");
+	census.reset(CensusOCL::site(CensusQueue, "QueueOCL"));
+	addLive();
+}
+
+void QueueOCL::addLive() {
+	std::unique_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+	liveQueues.insert(this);
 }
 
 QueueOCL::~QueueOCL(void) {
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+		liveQueues.erase(this);
+	}
 	if (queue && ownsQueue) {
 		cl_int errorCode = clReleaseCommandQueue(queue);
 		if (errorCode != CL_SUCCESS) {
@@ -89,6 +188,12 @@ tDeviceRC QueueOCL::finish(cl_command_queue commandQueue) {
 }
 
 tDeviceRC QueueOCL::finish(void) {
+	{
+		std::lock_guard<std::mutex> lock(submitMutex);
+		// clFinish submits anything still pending
+		if (pendingCommands)
+			recordSubmission();
+	}
 	return QueueOCL::finish(queue);
 }
 
@@ -107,7 +212,159 @@ tDeviceRC QueueOCL::flush(cl_command_queue commandQueue) {
 }
 
 tDeviceRC QueueOCL::flush(void) {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	if (pendingCommands)
+		return submit();
 	return QueueOCL::flush(queue);
 }
+
+void QueueOCL::onEnqueue(size_t bytes, bool blocking) {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	stats.commands++;
+	if (counters)
+		counters->queueDepth.fetch_add(1, std::memory_order_relaxed);
+	bool first = pendingCommands++ == 0;
+	if (first)
+		firstPending = std::chrono::steady_clock::now();
+	pendingBytes += bytes;
+	if (blocking) {
+		// already submitted by the driver
+		recordSubmission();
+		return;
+	}
+	auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - firstPending).count();
+	if (pendingCommands >= policy.maxCommands
+			|| pendingBytes >= policy.maxBytes
+			|| latency >= policy.maxLatencyMicroseconds) {
+		submit();
+		return;
+	}
+	if (tracking
+			&& std::find(trackedQueues.begin(), trackedQueues.end(), this)
+					== trackedQueues.end())
+		trackedQueues.push_back(this);
+	if (first)
+		latencyFlusher.arm(
+				firstPending
+						+ std::chrono::microseconds(
+								policy.maxLatencyMicroseconds));
+}
+
+tDeviceRC QueueOCL::flushPending() {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	return pendingCommands ? submit() : CL_SUCCESS;
+}
+
+void QueueOCL::flushAllPending() {
+	std::shared_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+	for (auto queue : liveQueues)
+		queue->flushPending();
+}
+
+void QueueOCL::flushEventQueue(cl_event evt) {
+	if (!evt)
+		return;
+	cl_command_queue commandQueue = 0;
+	// user events have no queue
+	if (clGetEventInfo(evt, CL_EVENT_COMMAND_QUEUE, sizeof(commandQueue),
+			&commandQueue, nullptr) != CL_SUCCESS || !commandQueue)
+		return;
+	std::shared_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+	for (auto queue : liveQueues) {
+		if (queue->queue == commandQueue)
+			queue->flushPending();
+	}
+}
+
+void QueueOCL::trackEnqueues() {
+	tracking = true;
+}
+
+void QueueOCL::flushTracked() {
+	if (trackedQueues.empty())
+		return;
+	std::shared_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+	for (auto queue : trackedQueues) {
+		// skip queues destroyed since they were tracked
+		if (liveQueues.count(queue))
+			queue->flushPending();
+	}
+	trackedQueues.clear();
+}
+
+void QueueOCL::flushExpired() {
+	auto now = std::chrono::steady_clock::now();
+	std::shared_lock<std::shared_timed_mutex> lock(liveQueuesMutex);
+	for (auto queue : liveQueues) {
+		std::lock_guard<std::mutex> queueLock(queue->submitMutex);
+		if (!queue->pendingCommands)
+			continue;
+		auto due = queue->firstPending
+				+ std::chrono::microseconds(queue->policy.maxLatencyMicroseconds);
+		if (due <= now)
+			queue->submit();
+		else
+			latencyFlusher.arm(due);
+	}
+}
+
+tDeviceRC QueueOCL::submit() {
+	auto rc = QueueOCL::flush(queue);
+	recordSubmission();
+	return rc;
+}
+
+void QueueOCL::recordSubmission() {
+	if (counters)
+		counters->queueDepth.fetch_sub(pendingCommands,
+				std::memory_order_relaxed);
+	stats.submissions++;
+	if (pendingCommands > stats.maxBatch)
+		stats.maxBatch = pendingCommands;
+	pendingCommands = 0;
+	pendingBytes = 0;
+}
+
+void QueueOCL::setFlushPolicy(const FlushPolicy &flushPolicy) {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	policy = flushPolicy;
+	if (policy.maxCommands == 0)
+		policy.maxCommands = 1;
+}
+
+FlushPolicy QueueOCL::getFlushPolicy() {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	return policy;
+}
+
+SubmissionStats QueueOCL::getSubmissionStats() {
+	std::lock_guard<std::mutex> lock(submitMutex);
+	return stats;
+}
+
+bool QueueOCL::setProfiler(ProfilerOCL *queueProfiler) {
+	if (queueProfiler && !isProfilingEnabled()) {
+		Util::LogError(
+				"Error: profiler set on queue created without CL_QUEUE_PROFILING_ENABLE.\n");
+		return false;
+	}
+	profiler = queueProfiler;
+	return true;
+}
+
+cl_event* QueueOCL::profilingEvent(cl_event *completionEvent, Event &scratch) {
+	if (completionEvent || !getProfiler())
+		return completionEvent;
+	static CensusSiteOCL *site = CensusOCL::site(CensusEvent,
+			"QueueOCL profiling");
+	return scratch.out(site);
+}
+
+void QueueOCL::profile(const std::string &label, cl_event evt) {
+	auto queueProfiler = getProfiler();
+	if (queueProfiler && evt)
+		queueProfiler->record(label, evt);
+}
 }
 #endif
@@ -20,12 +20,50 @@
 #pragma once
 
 #include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <string>
 
 #ifdef OPENCL_FOUND
 #include "platform.h"
+#include "CensusOCL.h"
 
 namespace ltk {
 
+class ProfilerOCL;
+class Event;
+struct CountersOCL;
+
+/**
+ * Thresholds for submitting batched commands : a queue is flushed once
+ * it holds maxCommands unflushed commands or maxBytes of unflushed
+ * transfers, or once its oldest unflushed command is older than
+ * maxLatencyMicroseconds, checked on enqueue and by a timer.
+ * maxCommands of 1 flushes after every enqueue.
+ */
+struct FlushPolicy {
+	FlushPolicy() :
+			maxCommands(16), maxBytes(64 << 20), maxLatencyMicroseconds(1000) {
+	}
+	uint32_t maxCommands;
+	size_t maxBytes;
+	uint32_t maxLatencyMicroseconds;
+};
+
+struct SubmissionStats {
+	SubmissionStats() :
+			commands(0), submissions(0), maxBatch(0) {
+	}
+	double meanBatch() const {
+		return submissions ? (double) commands / (double) submissions : 0;
+	}
+	// commands enqueued through latke, and flushes that submitted them
+	uint64_t commands;
+	uint64_t submissions;
+	uint32_t maxBatch;
+};
 
 class QueueOCL
 {
@@ -45,9 +83,69 @@ public:
     cl_command_queue getQueueImpl() {
         return queue;
     }
+
+    // record a command enqueued on this queue, and flush if the flush
+    // policy says so. Blocking commands are flushed by the driver.
+    void onEnqueue(size_t bytes = 0, bool blocking = false);
+    // flush only if commands are waiting to be submitted
+    tDeviceRC flushPending();
+    // flush every queue with unflushed commands
+    static void flushAllPending();
+    // flush the queue evt was enqueued on, so evt can complete : called
+    // before the host blocks on evt or attaches a continuation to it
+    static void flushEventQueue(cl_event evt);
+    // remember queues that the calling thread enqueues on, until
+    // flushTracked() flushes them; used by completion dispatcher workers
+    // to submit what a batch of continuations enqueued
+    static void trackEnqueues();
+    static void flushTracked();
+
+    void setFlushPolicy(const FlushPolicy &flushPolicy);
+    FlushPolicy getFlushPolicy();
+    SubmissionStats getSubmissionStats();
+
+    cl_command_queue_properties getProperties() const {
+        return properties;
+    }
+    bool isProfilingEnabled() const {
+        return (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+    }
+    // record labelled commands enqueued on this queue with profiler.
+    // Queue must have been created with CL_QUEUE_PROFILING_ENABLE;
+    // null profiler disables recording
+    bool setProfiler(ProfilerOCL *profiler);
+    ProfilerOCL* getProfiler() const {
+        return profiler;
+    }
+    // event to request for a command : completionEvent, or scratch if the
+    // caller doesn't need one but the command is profiled
+    cl_event* profilingEvent(cl_event *completionEvent, Event &scratch);
+    // record command of evt under label, if a profiler is set
+    void profile(const std::string &label, cl_event evt);
+    // counters of the queue's device; null for wrapped queues
+    CountersOCL* getCounters() const {
+        return counters;
+    }
 private:
+    friend class LatencyFlusher;
+    // flush queues whose oldest unflushed command is past its latency limit
+    static void flushExpired();
+    void addLive();
+    tDeviceRC submit();
+    void recordSubmission();
     cl_command_queue queue;
     bool ownsQueue;
+    cl_command_queue_properties properties;
+    std::atomic<ProfilerOCL*> profiler;
+    CountersOCL *counters;
+    // set for owned queues only
+    CensusTokenOCL census;
+    std::mutex submitMutex;
+    FlushPolicy policy;
+    SubmissionStats stats;
+    uint32_t pendingCommands;
+    size_t pendingBytes;
+    std::chrono::steady_clock::time_point firstPending;
 };
 
 }
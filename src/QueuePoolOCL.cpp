@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "QueuePoolOCL.h"
+#include "DeviceOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+
+namespace ltk {
+
+const size_t QueuePoolOCL::inOrderFanOut;
+
+QueuePoolOCL::QueuePoolOCL(DeviceOCL *device,
+		cl_command_queue_properties queue_props, size_t numUpload,
+		size_t numCompute, size_t numDownload) :
+		properties(queue_props),
+		outOfOrderEmulated((queue_props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+				&& !device->supportsOutOfOrder()) {
+	size_t counts[NUM_QUEUE_ROLES] = { numUpload, numCompute, numDownload };
+	size_t fanOut = outOfOrderEmulated ? inOrderFanOut : 1;
+	auto supportedProps = device->getSupportedQueueProperties(queue_props);
+	try {
+		for (int role = 0; role < NUM_QUEUE_ROLES; ++role) {
+			next[role] = 0;
+			for (size_t i = 0; i < std::max<size_t>(counts[role], 1) * fanOut; ++i)
+				queues[role].push_back(new QueueOCL(device, supportedProps));
+		}
+	} catch (std::exception &ex) {
+		for (auto &roleQueues : queues) {
+			for (auto queue : roleQueues)
+				delete queue;
+		}
+		throw;
+	}
+}
+
+QueuePoolOCL::~QueuePoolOCL() {
+	for (auto &roleQueues : queues) {
+		for (auto queue : roleQueues)
+			delete queue;
+	}
+}
+
+QueueOCL* QueuePoolOCL::lease(eQueueRole role) {
+	auto &roleQueues = queues[role];
+	return roleQueues[next[role]++ % roleQueues.size()];
+}
+
+size_t QueuePoolOCL::getNumQueues(eQueueRole role) const {
+	return queues[role].size();
+}
+
+QueueOCL* QueuePoolOCL::getQueue(eQueueRole role, size_t index) const {
+	return index < queues[role].size() ? queues[role][index] : nullptr;
+}
+
+tDeviceRC QueuePoolOCL::flush() {
+	tDeviceRC rc = CL_SUCCESS;
+	for (auto &roleQueues : queues) {
+		for (auto queue : roleQueues) {
+			auto status = queue->flush();
+			if (status != CL_SUCCESS)
+				rc = status;
+		}
+	}
+	return rc;
+}
+
+tDeviceRC QueuePoolOCL::finish() {
+	tDeviceRC rc = CL_SUCCESS;
+	for (auto &roleQueues : queues) {
+		for (auto queue : roleQueues) {
+			auto status = queue->finish();
+			if (status != CL_SUCCESS)
+				rc = status;
+		}
+	}
+	return rc;
+}
+
+SubmissionStats QueuePoolOCL::getSubmissionStats() {
+	SubmissionStats rc;
+	for (auto &roleQueues : queues) {
+		for (auto queue : roleQueues) {
+			auto stats = queue->getSubmissionStats();
+			rc.commands += stats.commands;
+			rc.submissions += stats.submissions;
+			if (stats.maxBatch > rc.maxBatch)
+				rc.maxBatch = stats.maxBatch;
+		}
+	}
+	return rc;
+}
+
+void QueuePoolOCL::setFlushPolicy(const FlushPolicy &policy) {
+	for (auto &roleQueues : queues)
+		for (auto queue : roleQueues)
+			queue->setFlushPolicy(policy);
+}
+
+bool QueuePoolOCL::setProfiler(ProfilerOCL *profiler) {
+	bool rc = true;
+	for (auto &roleQueues : queues)
+		for (auto queue : roleQueues)
+			rc = queue->setProfiler(profiler) && rc;
+	return rc;
+}
+
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "QueueOCL.h"
+#include <vector>
+#include <atomic>
+
+namespace ltk {
+
+enum eQueueRole {
+	UploadQueue, ComputeQueue, DownloadQueue, NUM_QUEUE_ROLES
+};
+
+/**
+ * QueuePoolOCL
+ *
+ * Fixed set of command queues for one device, split by role : uploads
+ * (host to device), compute and downloads (device to host). Memory objects
+ * and kernels lease queues from the pool instead of creating their own,
+ * which keeps the number of queues the driver has to serialize small, and
+ * makes copy/compute overlap explicit.
+ *
+ * Leased queues are shared and owned by the pool : commands on a shared
+ * queue must be ordered by events, or the queue must be out of order.
+ *
+ * If out of order execution is requested but the device doesn't support it,
+ * each role gets inOrderFanOut times as many in order queues instead, so
+ * independent commands leased onto different queues still overlap.
+ */
+class QueuePoolOCL {
+public:
+	QueuePoolOCL(DeviceOCL *device, cl_command_queue_properties queue_props,
+			size_t numUpload, size_t numCompute, size_t numDownload);
+	~QueuePoolOCL();
+
+	// lease next queue for role, round robin
+	QueueOCL* lease(eQueueRole role);
+
+	size_t getNumQueues(eQueueRole role) const;
+	QueueOCL* getQueue(eQueueRole role, size_t index) const;
+	cl_command_queue_properties getProperties() const {
+		return properties;
+	}
+	// out of order requested, and emulated with in order queues
+	bool isOutOfOrderEmulated() const {
+		return outOfOrderEmulated;
+	}
+	static const size_t inOrderFanOut = 4;
+
+	// flush / finish all queues in pool
+	tDeviceRC flush();
+	tDeviceRC finish();
+
+	void setFlushPolicy(const FlushPolicy &policy);
+	// set profiler on all queues in pool; false if any queue
+	// was created without CL_QUEUE_PROFILING_ENABLE
+	bool setProfiler(ProfilerOCL *profiler);
+	// submission counters summed over all queues in pool
+	SubmissionStats getSubmissionStats();
+private:
+	cl_command_queue_properties properties;
+	bool outOfOrderEmulated;
+	std::vector<QueueOCL*> queues[NUM_QUEUE_ROLES];
+	std::atomic<size_t> next[NUM_QUEUE_ROLES];
+};
+
+}
+#endif
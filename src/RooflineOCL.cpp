@@ -0,0 +1,137 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "RooflineOCL.h"
+#include "DeviceOCL.h"
+#include "DeviceProfileOCL.h"
+#include "ProfilerOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace ltk {
+
+RooflineOCL::RooflineOCL(DeviceOCL *device, const DeviceProfileOCL *profile) :
+		peakOps(0), peakBandwidth(0) {
+	auto info = device->deviceInfo;
+	deviceName = info->name ? info->name : "";
+	// CPU runtimes vectorize work items across SIMD lanes of each core
+	size_t lanes = 0;
+	if ((info->dType & CL_DEVICE_TYPE_GPU) && device->arch)
+		lanes = device->arch->getLanesPerComputeUnit();
+	if (!lanes)
+		lanes = std::max<cl_uint>(info->nativeIntVecWidth, 1);
+	// MHz to Gops / s
+	peakOps = (double) info->maxComputeUnits * (double) lanes
+			* (double) info->maxClockFrequency * 1e-3;
+	if (profile && profile->valid)
+		peakBandwidth = profile->deviceCopyBandwidth;
+}
+
+void RooflineOCL::declare(const std::string &label,
+		const KernelCostOCL &cost) {
+	costs[label] = cost;
+}
+
+double RooflineOCL::getRidgeIntensity() const {
+	return peakBandwidth > 0 ? peakOps / peakBandwidth : 0;
+}
+
+std::vector<RooflinePointOCL> RooflineOCL::analyze(
+		ProfilerOCL &profiler) const {
+	std::vector<RooflinePointOCL> rc;
+	auto stats = profiler.getStats();
+	double ridge = getRidgeIntensity();
+	for (auto &entry : costs) {
+		auto iter = stats.find(entry.first);
+		if (iter == stats.end() || !iter->second.count
+				|| iter->second.execution <= 0)
+			continue;
+		auto &cost = entry.second;
+		auto &s = iter->second;
+		double launches = (double) s.count;
+		double seconds = s.execution * 1e-3;
+		double bytes = cost.bytesRead + cost.bytesWritten;
+		RooflinePointOCL point;
+		point.label = entry.first;
+		point.launches = s.count;
+		point.execution = s.execution / launches;
+		point.bandwidth = launches * bytes / seconds * 1e-9;
+		point.pixelRate = launches * cost.pixels / seconds * 1e-6;
+		point.opRate = launches * cost.ops / seconds * 1e-9;
+		point.intensity = bytes > 0 ? cost.ops / bytes : 0;
+		point.attainable = peakOps;
+		if (peakBandwidth > 0)
+			point.attainable = std::min(peakOps,
+					point.intensity * peakBandwidth);
+		point.memoryBound = ridge > 0 && point.intensity < ridge;
+		point.efficiency =
+				point.attainable > 0 ? point.opRate / point.attainable : 0;
+		rc.push_back(point);
+	}
+
+	return rc;
+}
+
+void RooflineOCL::report(std::ostream &out, ProfilerOCL &profiler) const {
+	auto points = analyze(profiler);
+	auto flags = out.flags();
+	auto precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << "roofline for " << deviceName << " : peak " << peakOps
+			<< " Gops/s, ";
+	if (peakBandwidth > 0)
+		out << peakBandwidth << " GB/s, ridge " << std::setprecision(2)
+				<< getRidgeIntensity() << " ops/byte" << std::endl;
+	else
+		out << "no bandwidth profile" << std::endl;
+	out << std::setprecision(1);
+	out << std::left << std::setw(28) << "label" << std::right << std::setw(8)
+			<< "count" << std::setw(10) << "ms" << std::setw(10) << "GB/s"
+			<< std::setw(10) << "MP/s" << std::setw(10) << "Gops/s"
+			<< std::setw(10) << "ops/byte" << std::setw(10) << "roof %"
+			<< std::endl;
+	for (auto &p : points) {
+		out << std::left << std::setw(28) << p.label << std::right
+				<< std::setw(8) << p.launches << std::setw(10)
+				<< std::setprecision(3) << p.execution << std::setprecision(1)
+				<< std::setw(10) << p.bandwidth << std::setw(10) << p.pixelRate
+				<< std::setw(10) << p.opRate << std::setw(10)
+				<< std::setprecision(2) << p.intensity << std::setprecision(1)
+				<< std::setw(10) << p.efficiency * 100 << std::endl;
+	}
+	for (auto &p : points) {
+		if (peakBandwidth <= 0)
+			break;
+		out << p.label << " is "
+				<< (p.memoryBound ? "memory bound" : "compute bound") << " : ";
+		if (p.memoryBound)
+			out << p.bandwidth << " of " << peakBandwidth << " GB/s";
+		else
+			out << p.opRate << " of " << peakOps << " Gops/s";
+		out << " (" << p.efficiency * 100 << "% of roof)" << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <cstdint>
+
+namespace ltk {
+
+struct DeviceProfileOCL;
+class ProfilerOCL;
+
+// work done by one launch of a kernel, as declared by its author
+struct KernelCostOCL {
+	KernelCostOCL() :
+			bytesRead(0), bytesWritten(0), ops(0), pixels(0) {
+	}
+	KernelCostOCL(double bytesRead, double bytesWritten, double ops,
+			double pixels) :
+			bytesRead(bytesRead), bytesWritten(bytesWritten), ops(ops), pixels(
+					pixels) {
+	}
+	// global memory traffic
+	double bytesRead;
+	double bytesWritten;
+	// arithmetic operations
+	double ops;
+	double pixels;
+};
+
+// achieved performance of one label, against the device roofline
+struct RooflinePointOCL {
+	std::string label;
+	uint64_t launches;
+	// mean execution time, in ms
+	double execution;
+	// GB/s
+	double bandwidth;
+	// megapixels / s
+	double pixelRate;
+	// Gops / s
+	double opRate;
+	// ops per byte
+	double intensity;
+	// roofline bound at this intensity, in Gops / s
+	double attainable;
+	// intensity below the ridge point
+	bool memoryBound;
+	// opRate as a fraction of attainable
+	double efficiency;
+};
+
+/**
+ * RooflineOCL
+ *
+ * Roofline analysis of profiled kernels. Kernels declare the cost of one
+ * launch under their profiler label (the kernel name by default); achieved
+ * bandwidth, pixel rate and op rate are then computed from device execution
+ * times and compared against device peaks :
+ *
+ * peak ops = compute units * lanes per compute unit * max clock
+ * peak bandwidth = measured device copy bandwidth (DeviceProfileOCL)
+ *
+ * A kernel whose intensity (ops per byte) lies below the ridge point
+ * peak ops / peak bandwidth is memory bound.
+ */
+class RooflineOCL {
+public:
+	// profile may be null or invalid, in which case there is no
+	// bandwidth peak and kernels are not classified
+	RooflineOCL(DeviceOCL *device, const DeviceProfileOCL *profile);
+
+	void declare(const std::string &label, const KernelCostOCL &cost);
+
+	// Gops / s
+	double getPeakOps() const {
+		return peakOps;
+	}
+	// GB/s
+	double getPeakBandwidth() const {
+		return peakBandwidth;
+	}
+	// ops per byte where the memory and compute roofs meet; 0 if unknown
+	double getRidgeIntensity() const;
+
+	// declared labels that have profiled launches
+	std::vector<RooflinePointOCL> analyze(ProfilerOCL &profiler) const;
+	void report(std::ostream &out, ProfilerOCL &profiler) const;
+private:
+	std::string deviceName;
+	double peakOps;
+	double peakBandwidth;
+	std::map<std::string, KernelCostOCL> costs;
+};
+
+}
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "TaskGraphOCL.h"
+#include "KernelOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace ltk {
+
+TaskGraphOCL::TaskGraphOCL(QueuePoolOCL *queuePool) :
+		pool(queuePool), numSubmitted(0) {
+}
+
+TaskGraphOCL::~TaskGraphOCL() {
+	reset();
+}
+
+bool TaskGraphOCL::isAncestor(NodeId ancestor, NodeId node) const {
+	auto &bits = nodes[node].ancestors;
+	size_t word = ancestor / 64;
+	return word < bits.size() && (bits[word] >> (ancestor % 64)) & 1;
+}
+
+TaskGraphOCL::NodeId TaskGraphOCL::addTask(TaskFn task,
+		const std::vector<cl_mem> &reads, const std::vector<cl_mem> &writes,
+		eQueueRole role) {
+	NodeId id = nodes.size();
+
+	// 1. candidate edges from memory hazards
+	std::vector<NodeId> candidates;
+	for (auto mem : reads) {
+		auto &state = memStates[mem];
+		if (state.hasWriter)
+			candidates.push_back(state.lastWriter); // RAW
+	}
+	for (auto mem : writes) {
+		auto &state = memStates[mem];
+		if (state.hasWriter)
+			candidates.push_back(state.lastWriter); // WAW
+		candidates.insert(candidates.end(), state.readers.begin(),
+				state.readers.end()); // WAR
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()),
+			candidates.end());
+
+	// 2. drop edges implied by a path through another candidate
+	Node node;
+	node.task = task;
+	node.role = role;
+	node.submitted = false;
+	node.ancestors.assign((id + 64) / 64, 0);
+	for (auto candidate : candidates) {
+		bool redundant = false;
+		for (auto other : candidates) {
+			if (other != candidate && isAncestor(candidate, other)) {
+				redundant = true;
+				break;
+			}
+		}
+		if (!redundant)
+			node.dependencies.push_back(candidate);
+		auto &bits = nodes[candidate].ancestors;
+		for (size_t i = 0; i < bits.size(); ++i)
+			node.ancestors[i] |= bits[i];
+		node.ancestors[candidate / 64] |= (uint64_t) 1 << (candidate % 64);
+	}
+	nodes.push_back(std::move(node));
+
+	// 3. update memory state. A task that both reads and writes an object
+	// becomes its last writer
+	for (auto mem : reads) {
+		if (std::find(writes.begin(), writes.end(), mem) == writes.end())
+			memStates[mem].readers.push_back(id);
+	}
+	for (auto mem : writes) {
+		auto &state = memStates[mem];
+		state.hasWriter = true;
+		state.lastWriter = id;
+		state.readers.clear();
+	}
+
+	return id;
+}
+
+TaskGraphOCL::NodeId TaskGraphOCL::addKernel(KernelOCL *kernel,
+		const EnqueueInfoOCL &info, const std::vector<cl_mem> &reads,
+		const std::vector<cl_mem> &writes) {
+	EnqueueInfoOCL geometry = info;
+	auto task = [kernel, geometry](QueueOCL *queue, cl_uint numWaitEvents,
+			const cl_event *waitEvents, cl_event *completionEvent) {
+		EnqueueInfoOCL launch = geometry;
+		launch.queue = queue;
+		launch.numWaitEvents = 0;
+		for (cl_uint i = 0; i < numWaitEvents; ++i) {
+			if (!launch.pushWaitEvent(waitEvents[i]))
+				throw std::runtime_error("Too many wait events for kernel task");
+		}
+		launch.needsCompletionEvent = true;
+		kernel->enqueue(launch);
+		*completionEvent = launch.completionEvent.detach();
+	};
+	return addTask(task, reads, writes, ComputeQueue);
+}
+
+void TaskGraphOCL::addExternalWait(NodeId node, cl_event evt) {
+	if (node >= nodes.size() || nodes[node].submitted || !evt)
+		throw std::runtime_error("Invalid external wait");
+	nodes[node].externalWaits.push_back(Event::retain(evt));
+}
+
+const std::vector<TaskGraphOCL::NodeId>& TaskGraphOCL::getDependencies(
+		NodeId node) const {
+	return nodes.at(node).dependencies;
+}
+
+void TaskGraphOCL::submit() {
+	std::vector<cl_event> waitEvents;
+	while (numSubmitted < nodes.size()) {
+		auto &node = nodes[numSubmitted];
+		waitEvents.clear();
+		for (auto dep : node.dependencies)
+			waitEvents.push_back(nodes[dep].completionEvent.get());
+		for (auto &evt : node.externalWaits)
+			waitEvents.push_back(evt.get());
+		cl_event completionEvent = 0;
+		try {
+			node.task(pool->lease(node.role), (cl_uint) waitEvents.size(),
+					waitEvents.empty() ? nullptr : waitEvents.data(),
+					&completionEvent);
+			if (!completionEvent)
+				throw std::runtime_error(
+						"Task did not return a completion event");
+		} catch (...) {
+			// node stays unsubmitted, so a later submit() retries it;
+			// tasks already enqueued are flushed so that wait() can finish
+			if (completionEvent)
+				clReleaseEvent(completionEvent);
+			pool->flush();
+			throw;
+		}
+		node.completionEvent.reset(completionEvent);
+		node.submitted = true;
+		++numSubmitted;
+	}
+	pool->flush();
+}
+
+cl_event TaskGraphOCL::getCompletionEvent(NodeId node) const {
+	return nodes.at(node).completionEvent.get();
+}
+
+bool TaskGraphOCL::wait() {
+	std::vector<cl_event> events;
+	for (size_t i = 0; i < numSubmitted; ++i)
+		events.push_back(nodes[i].completionEvent.get());
+	bool rc = numSubmitted == nodes.size();
+	if (!rc)
+		Util::LogError("Error: task graph has %zu unsubmitted tasks.\n",
+				nodes.size() - numSubmitted);
+	if (events.empty())
+		return rc;
+	// batched commands must be submitted before blocking on them
+	for (auto evt : events)
+		QueueOCL::flushEventQueue(evt);
+	cl_int error_code = clWaitForEvents((cl_uint) events.size(), events.data());
+	if (CL_SUCCESS != error_code) {
+		Util::LogError("Error: clWaitForEvents returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		return false;
+	}
+	return rc;
+}
+
+void TaskGraphOCL::reset() {
+	// events are released by their handles
+	nodes.clear();
+	memStates.clear();
+	numSubmitted = 0;
+}
+
+}
+#endif
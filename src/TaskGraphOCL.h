@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include "QueuePoolOCL.h"
+#include "EnqueueInfoOCL.h"
+#include "EventOCL.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+namespace ltk {
+
+class KernelOCL;
+
+/**
+ * TaskGraphOCL
+ *
+ * Directed acyclic graph of device commands. Each task declares the memory
+ * objects it reads and writes; dependencies are derived in program order
+ * (read after write, write after read and write after write), and edges
+ * implied by other edges are dropped, so every task waits on a minimal
+ * list of events. On submit, tasks are enqueued on queues leased from a
+ * queue pool : with out of order queues, independent tasks run concurrently.
+ */
+class TaskGraphOCL {
+public:
+	typedef size_t NodeId;
+	/**
+	 * Enqueue a task on queue, waiting on the wait list, and return its
+	 * completion event in completionEvent. The graph takes ownership of
+	 * the completion event.
+	 */
+	typedef std::function<
+			void(QueueOCL *queue, cl_uint numWaitEvents,
+					const cl_event *waitEvents, cl_event *completionEvent)> TaskFn;
+
+	TaskGraphOCL(QueuePoolOCL *pool);
+	~TaskGraphOCL();
+
+	NodeId addTask(TaskFn task, const std::vector<cl_mem> &reads,
+			const std::vector<cl_mem> &writes, eQueueRole role = ComputeQueue);
+
+	// kernel task : info supplies geometry; queue and wait list are set by the graph
+	NodeId addKernel(KernelOCL *kernel, const EnqueueInfoOCL &info,
+			const std::vector<cl_mem> &reads, const std::vector<cl_mem> &writes);
+
+	// extra wait on an event produced outside of the graph, e.g. a user event.
+	// Event is retained by the graph.
+	void addExternalWait(NodeId node, cl_event evt);
+
+	// direct dependencies of node, after redundant edges have been removed
+	const std::vector<NodeId>& getDependencies(NodeId node) const;
+	size_t getNumTasks() const {
+		return nodes.size();
+	}
+
+	// enqueue all tasks added since the last submit, in insertion order,
+	// and flush the pool queues. If a task throws, the tasks before it stay
+	// submitted, the failed task and those after it do not, and the
+	// exception propagates : a later submit() resumes at the failed task
+	void submit();
+
+	// completion event of submitted task; owned by the graph
+	cl_event getCompletionEvent(NodeId node) const;
+
+	// wait for all submitted tasks to complete. Returns false on error,
+	// or if some tasks have not been submitted
+	bool wait();
+
+	// release all events and remove all tasks
+	void reset();
+private:
+	struct Node {
+		TaskFn task;
+		eQueueRole role;
+		std::vector<NodeId> dependencies;
+		std::vector<Event> externalWaits;
+		// bitset of all (transitive) predecessors
+		std::vector<uint64_t> ancestors;
+		Event completionEvent;
+		bool submitted;
+	};
+	struct MemState {
+		MemState() : hasWriter(false), lastWriter(0) {
+		}
+		bool hasWriter;
+		NodeId lastWriter;
+		// readers since last write
+		std::vector<NodeId> readers;
+	};
+	bool isAncestor(NodeId ancestor, NodeId node) const;
+	QueuePoolOCL *pool;
+	std::vector<Node> nodes;
+	std::map<cl_mem, MemState> memStates;
+	size_t numSubmitted;
+};
+
+}
+#endif
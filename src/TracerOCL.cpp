@@ -0,0 +1,149 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "TracerOCL.h"
+#include "ProfilerOCL.h"
+#include "UtilOCL.h"
+#include <fstream>
+#include <map>
+#include <algorithm>
+
+namespace ltk {
+
+static std::atomic<uint32_t> nextTraceThread(0);
+
+// small stable id for the calling thread
+static uint32_t traceThreadId() {
+	static thread_local uint32_t id = nextTraceThread++;
+	return id;
+}
+
+static std::string escapeJson(const std::string &str) {
+	std::string rc;
+	for (auto c : str) {
+		if (c == '"' || c == '\\')
+			rc += '\\';
+		if ((unsigned char) c >= 0x20)
+			rc += c;
+	}
+	return rc;
+}
+
+TracerOCL::TracerOCL(size_t capacity) :
+		size(1), mask(0), next(0) {
+	while (size < capacity)
+		size <<= 1;
+	ring.reset(new Span[size]);
+	mask = size - 1;
+	for (size_t i = 0; i < size; ++i) {
+		ring[i].name = "";
+		ring[i].begin = 0;
+		ring[i].end = 0;
+		ring[i].thread = 0;
+	}
+}
+
+void TracerOCL::record(const char *name, cl_ulong begin, cl_ulong end) {
+	auto &span = ring[next.fetch_add(1, std::memory_order_relaxed) & mask];
+	span.name.store(name, std::memory_order_relaxed);
+	span.begin.store(begin, std::memory_order_relaxed);
+	span.end.store(end, std::memory_order_relaxed);
+	span.thread.store(traceThreadId(), std::memory_order_relaxed);
+}
+
+uint64_t TracerOCL::getNumRecorded() const {
+	return next.load();
+}
+
+bool TracerOCL::writeChromeTrace(const std::string &fileName,
+		ProfilerOCL *profiler) {
+	std::ofstream out(fileName);
+	if (!out) {
+		Util::LogError("Error: unable to open trace file %s.\n",
+				fileName.c_str());
+		return false;
+	}
+	uint64_t recorded = next.load();
+	uint64_t first = recorded > size ? recorded - size : 0;
+	std::vector<ProfileSample> samples;
+	if (profiler)
+		samples = profiler->getSamples();
+
+	// timestamps relative to earliest event, in microseconds
+	cl_ulong origin = (cl_ulong) -1;
+	for (uint64_t i = first; i < recorded; ++i)
+		origin = std::min(origin, ring[i & mask].begin.load());
+	for (auto &sample : samples)
+		origin = std::min(origin, sample.queued);
+	auto toMicros = [&origin](cl_ulong t) {
+		return (double) (t - origin) / 1000.0;
+	};
+
+	const int hostPid = 1, devicePid = 2;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << hostPid
+			<< ",\"args\":{\"name\":\"host\"}}";
+	out << ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << devicePid
+			<< ",\"args\":{\"name\":\"device"
+			<< (profiler && !profiler->isHostCorrelated() ?
+					" (not host correlated)" : "") << "\"}}";
+	out.precision(3);
+	out << std::fixed;
+	for (uint64_t i = first; i < recorded; ++i) {
+		auto &span = ring[i & mask];
+		cl_ulong begin = span.begin, end = span.end;
+		out << ",\n{\"name\":\"" << escapeJson(span.name.load())
+				<< "\",\"ph\":\"X\",\"pid\":" << hostPid << ",\"tid\":"
+				<< span.thread << ",\"ts\":" << toMicros(begin)
+				<< ",\"dur\":" << (double) (end - std::min(begin, end)) / 1000.0
+				<< "}";
+	}
+	std::map<cl_command_queue, size_t> queues;
+	for (auto &sample : samples) {
+		auto queue = queues.insert(std::make_pair(sample.queue, queues.size()));
+		if (queue.second)
+			out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":"
+					<< devicePid << ",\"tid\":" << queue.first->second
+					<< ",\"args\":{\"name\":\"queue " << queue.first->second
+					<< "\"}}";
+		out << ",\n{\"name\":\"" << escapeJson(sample.label)
+				<< "\",\"ph\":\"X\",\"pid\":" << devicePid << ",\"tid\":"
+				<< queue.first->second << ",\"ts\":" << toMicros(sample.start)
+				<< ",\"dur\":" << (double) (sample.end - sample.start) / 1000.0
+				<< ",\"args\":{\"queued_us\":" << toMicros(sample.queued)
+				<< ",\"submit_us\":" << toMicros(sample.submit) << "}}";
+	}
+	out << "\n]}\n";
+
+	return out.good();
+}
+
+TraceScopeOCL::TraceScopeOCL(TracerOCL *tracer, const char *name) :
+		tracer(tracer), name(name), begin(tracer ? ProfilerOCL::hostNow() : 0) {
+}
+
+TraceScopeOCL::~TraceScopeOCL() {
+	if (tracer)
+		tracer->record(name, begin, ProfilerOCL::hostNow());
+}
+
+}
+#endif
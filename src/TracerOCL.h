@@ -0,0 +1,90 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace ltk {
+
+class ProfilerOCL;
+
+/**
+ * TracerOCL
+ *
+ * Records host spans into a fixed size ring buffer, and writes them
+ * together with a profiler's device commands as Chrome trace JSON,
+ * which chrome://tracing and the Perfetto UI both load. Host spans are
+ * one row per thread, device commands one row per queue.
+ *
+ * Recording is lock free and doesn't allocate : span names must be string
+ * literals, and once the ring is full the oldest spans are overwritten.
+ * A span overwritten while it is being recorded may come out torn.
+ * Write the trace once host threads have stopped recording.
+ */
+class TracerOCL {
+public:
+	// capacity is rounded up to a power of two
+	explicit TracerOCL(size_t capacity = 1 << 16);
+
+	// record span of calling thread, times from ProfilerOCL::hostNow()
+	void record(const char *name, cl_ulong begin, cl_ulong end);
+	// spans recorded, including overwritten ones
+	uint64_t getNumRecorded() const;
+
+	// write host spans, and device commands of profiler if not null
+	bool writeChromeTrace(const std::string &fileName,
+			ProfilerOCL *profiler = nullptr);
+private:
+	// relaxed atomics : writers racing on a wrapped slot stay well defined
+	struct Span {
+		std::atomic<const char*> name;
+		std::atomic<cl_ulong> begin;
+		std::atomic<cl_ulong> end;
+		std::atomic<uint32_t> thread;
+	};
+	std::unique_ptr<Span[]> ring;
+	size_t size;
+	size_t mask;
+	std::atomic<uint64_t> next;
+};
+
+/**
+ * Records a host span from construction to destruction.
+ * A null tracer records nothing.
+ */
+class TraceScopeOCL {
+public:
+	TraceScopeOCL(TracerOCL *tracer, const char *name);
+	~TraceScopeOCL();
+	TraceScopeOCL(const TraceScopeOCL&) = delete;
+	TraceScopeOCL& operator=(const TraceScopeOCL&) = delete;
+private:
+	TracerOCL *tracer;
+	const char *name;
+	cl_ulong begin;
+};
+
+}
+#endif
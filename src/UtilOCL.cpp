@@ -41,6 +41,7 @@
 #endif
 
 #include "UtilOCL.h"
+#include "LoggerOCL.h"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
@@ -67,7 +68,7 @@ const char* getOpenCLErrorCodeStr(std::string input) {
  * @param errorMsg std::string message
  */
 void error(std::string errorMsg) {
-    std::cout << "Error: " << errorMsg << std::endl;
+    Util::LogError("Error: %s\n", errorMsg.c_str());
 }
 
 /**
@@ -269,7 +270,7 @@ bool getDefaultPlatform(cl_uint numPlatforms, cl_platform_id *platforms,
     }
 
     if (verbose)
-        std::cout << "Platform found : " << platformName << "\n";
+        Util::LogInfo("Platform found : %s\n", platformName);
     return defaultPlatform;
 }
 int getPlatformL(cl_platform_id &platform, int platformId,
@@ -354,7 +355,7 @@ int displayDevices(cl_platform_id platform, cl_device_type deviceType) {
     status = clGetPlatformInfo(platform, CL_PLATFORM_VENDOR,
             sizeof(platformVendor), platformVendor, NULL);
     CHECK_OPENCL_ERROR(status, "clGetPlatformInfo failed");
-    std::cout << "Selected Platform Vendor : " << platformVendor << std::endl;
+    Util::LogInfo("Selected Platform Vendor : %s\n", platformVendor);
     // Get number of devices available
     cl_uint deviceCount = 0;
     status = clGetDeviceIDs(platform, deviceType, 0, NULL, &deviceCount);
@@ -371,12 +372,44 @@ int displayDevices(cl_platform_id platform, cl_device_type deviceType) {
         status = clGetDeviceInfo(deviceIds[i], CL_DEVICE_NAME,
                 sizeof(deviceName), deviceName, NULL);
         CHECK_OPENCL_ERROR(status, "clGetDeviceInfo failed");
-        std::cout << "Device " << i << " : " << deviceName << std::endl
-                << "Device ID : " << deviceIds[i] << std::endl;
+        Util::LogInfo("Device %u : %s\nDevice ID : %p\n", i, deviceName,
+                (void*) deviceIds[i]);
     }
     return SUCCESS;
 }
 
+/**
+ * printBuildLog
+ * prints the build log of a program that failed to compile or build
+ * @param program program object
+ * @param device device the program was built for
+ * @return 0 if success else nonzero
+ */
+static int printBuildLog(cl_program program, cl_device_id device) {
+    cl_int logStatus;
+    size_t buildLogSize = 0;
+    logStatus = clGetProgramBuildInfo(program, device,
+    CL_PROGRAM_BUILD_LOG, buildLogSize, nullptr, &buildLogSize);
+    CHECK_OPENCL_ERROR(logStatus, "clGetProgramBuildInfo failed.");
+    std::unique_ptr<char[]> buildLog(new char[buildLogSize]);
+    CHECK_ALLOCATION(buildLog,
+            "Failed to allocate host memory. (buildLog)");
+    memset(buildLog.get(), 0, buildLogSize);
+    logStatus = clGetProgramBuildInfo(program, device,
+    CL_PROGRAM_BUILD_LOG, buildLogSize, buildLog.get(),
+    NULL);
+    if (checkVal(logStatus, CL_SUCCESS,
+            "clGetProgramBuildInfo failed.")) {
+        return FAILURE;
+    }
+    Util::LogError(" \n\t\t\tBUILD LOG\n"
+            " ************************************************\n"
+            "%s\n"
+            " ************************************************\n",
+            buildLog.get());
+    return SUCCESS;
+}
+
 /**
  * buildOpenCLProgram
  * builds the opencl program
@@ -387,10 +420,8 @@ int displayDevices(cl_platform_id platform, cl_device_type deviceType) {
  */
 int buildOpenCLProgram(cl_program &program, const cl_context &context,
         const buildProgramData &buildData) {
-    // we only output debug info to console if we are building from source
+    // we only log build details if we are building from source
     bool verbose = buildData.binaryName.empty();
-    if (verbose)
-        std::cout << std::endl;
     cl_int status = CL_SUCCESS;
     KernelFile kernelFile;
     auto programPath = buildData.programPath;
@@ -411,8 +442,8 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
             }
         }
         if (!successfulRead){
-			std::cout << "Failed to load binary file : " << binaryPath
-					<< std::endl;
+			Util::LogError("Failed to load binary file : %s\n",
+					binaryPath.c_str());
 			return FAILURE;
         }
 
@@ -425,12 +456,12 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
     }
 //otherwise, build from source
     else {
-        std::cout << "Creating program " << buildData.programName
-                << " from source" << std::endl;
+        Util::LogInfo("Creating program %s from source\n",
+                buildData.programName.c_str());
         programPath += buildData.programName;
         if (!kernelFile.open(programPath.c_str())) {
-            std::cout << "Failed to load kernel file: " << programPath
-                    << std::endl;
+            Util::LogError("Failed to load kernel file: %s\n",
+                    programPath.c_str());
             return FAILURE;
         }
         const char *source = kernelFile.source().c_str();
@@ -440,7 +471,7 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
         CHECK_OPENCL_ERROR(status, "clCreateProgramWithSource failed.");
     }
     if (verbose)
-        std::cout << "Building program " << buildData.programName << std::endl;
+        Util::LogInfo("Building program %s\n", buildData.programName.c_str());
     std::string flagsStr = buildData.flagsStr;
 // Get additional options
     if (buildData.flagsFileName.size() != 0) {
@@ -448,8 +479,8 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
         std::string flagsPath = getPath();
         flagsPath += buildData.flagsFileName;
         if (!flagsFile.open(flagsPath.c_str())) {
-            std::cout << "Failed to load flags file: " << flagsPath
-                    << std::endl;
+            Util::LogError("Failed to load flags file: %s\n",
+                    flagsPath.c_str());
             return FAILURE;
         }
         flagsFile.replaceNewlineWithSpaces();
@@ -457,36 +488,18 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
         flagsStr.append(flags);
     }
     if (verbose)
-        std::cout << "Build Options are : " << flagsStr.c_str() << std::endl;
+        Util::LogDebug("Build Options are : %s\n", flagsStr.c_str());
     /* create a cl program executable for specified device*/
     status = clBuildProgram(program, 1, &buildData.device, flagsStr.c_str(),
     NULL, NULL);
     if (status != CL_SUCCESS) {
         if (status == CL_BUILD_PROGRAM_FAILURE) {
-            cl_int logStatus;
-            size_t buildLogSize = 0;
-            logStatus = clGetProgramBuildInfo(program, buildData.device,
-            CL_PROGRAM_BUILD_LOG, buildLogSize, nullptr, &buildLogSize);
-            CHECK_OPENCL_ERROR(logStatus, "clGetProgramBuildInfo failed.");
-            std::unique_ptr<char[]> buildLog(new char[buildLogSize]);
-            CHECK_ALLOCATION(buildLog,
-                    "Failed to allocate host memory. (buildLog)");
-            memset(buildLog.get(), 0, buildLogSize);
-            logStatus = clGetProgramBuildInfo(program, buildData.device,
-            CL_PROGRAM_BUILD_LOG, buildLogSize, buildLog.get(),
-            NULL);
-            if (checkVal(logStatus, CL_SUCCESS,
-                    "clGetProgramBuildInfo failed.")) {
+            if (printBuildLog(program, buildData.device) != SUCCESS)
                 return FAILURE;
-            }
-            std::cout << " \n\t\t\tBUILD LOG\n";
-            std::cout << " ************************************************\n";
-            std::cout << buildLog.get() << std::endl;
-            std::cout << " ************************************************\n";
         }
         CHECK_OPENCL_ERROR(status, "clBuildProgram failed.");
     }
-    if (verbose) {
+    if (verbose && LoggerOCL::isEnabled(LogLevelDebug)) {
         size_t log_size = 0;
         cl_int err_status = clGetProgramBuildInfo(program, buildData.device,
         CL_PROGRAM_BUILD_LOG, 0,
@@ -500,12 +513,196 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
             err_status = clGetProgramBuildInfo(program, buildData.device,
             CL_PROGRAM_BUILD_LOG, log_size, build_log.get(), &actual_log_size);
             CHECK_OPENCL_ERROR(err_status, "clGetProgramBuildInfo failed.");
-            printf("Build Log: \n%s", build_log.get());
+            Util::LogDebug("Build Log: \n%s", build_log.get());
         }
     }
     return SUCCESS;
 }
 
+#ifdef CL_VERSION_1_2
+/**
+ * compileOpenCLProgram
+ * compiles the opencl program source without linking it
+ * @param program compiled program object
+ * @param context cl_context object
+ * @param buildData buildProgramData Object
+ * @return 0 if success else nonzero
+ */
+int compileOpenCLProgram(cl_program &program, const cl_context &context,
+        const buildProgramData &buildData) {
+    cl_int status = CL_SUCCESS;
+    KernelFile kernelFile;
+    auto programPath = buildData.programPath + buildData.programName;
+    Util::LogInfo("Compiling program %s from source\n",
+            buildData.programName.c_str());
+    if (!kernelFile.open(programPath.c_str())) {
+        Util::LogError("Failed to load kernel file: %s\n",
+                programPath.c_str());
+        return FAILURE;
+    }
+    const char *source = kernelFile.source().c_str();
+    size_t sourceSize[] = { strlen(source) };
+    program = clCreateProgramWithSource(context, 1, &source, sourceSize,
+            &status);
+    CHECK_OPENCL_ERROR(status, "clCreateProgramWithSource failed.");
+    // include directories passed with -I are honoured by the compiler,
+    // so there is no need to pass embedded headers
+    status = clCompileProgram(program, 1, &buildData.device,
+            buildData.flagsStr.c_str(), 0, NULL, NULL, NULL, NULL);
+    if (status != CL_SUCCESS) {
+        if (status == CL_COMPILE_PROGRAM_FAILURE)
+            printBuildLog(program, buildData.device);
+        clReleaseProgram(program);
+        program = 0;
+        CHECK_OPENCL_ERROR(status, "clCompileProgram failed.");
+    }
+    return SUCCESS;
+}
+
+/**
+ * linkOpenCLProgram
+ * links compiled programs and libraries into a library or an executable
+ * @param program linked program object
+ * @param context cl_context object
+ * @param device device to link for
+ * @param options link options, e.g. -create-library
+ * @param inputs compiled programs and libraries to link
+ * @return 0 if success else nonzero
+ */
+int linkOpenCLProgram(cl_program &program, const cl_context &context,
+        cl_device_id device, const std::string &options,
+        const std::vector<cl_program> &inputs) {
+    cl_int status = CL_SUCCESS;
+    program = clLinkProgram(context, 1, &device, options.c_str(),
+            (cl_uint) inputs.size(), inputs.data(), NULL, NULL, &status);
+    if (status != CL_SUCCESS) {
+        // a program object may still be returned, holding the link log
+        if (program) {
+            if (status == CL_LINK_PROGRAM_FAILURE)
+                printBuildLog(program, device);
+            clReleaseProgram(program);
+            program = 0;
+        }
+        CHECK_OPENCL_ERROR(status, "clLinkProgram failed.");
+    }
+    return SUCCESS;
+}
+#endif
+
+// FNV-1a hash
+static uint64_t hashString(const std::string &str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : str) {
+        hash ^= (uint8_t) c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * getBinaryFileName
+ * file name of program binary for a device and build options
+ * @param device device the binary was built for
+ * @param binaryName binary name prefix
+ * @param buildOptions options the program is built with
+ * @return binaryName.<device name without white space>.<cache key hash>
+ */
+std::string getBinaryFileName(cl_device_id device,
+        const std::string &binaryName, const std::string &buildOptions) {
+    char deviceName[1024];
+    deviceName[0] = 0;
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName,
+    NULL);
+    std::string deviceNameString(deviceName);
+    deviceNameString.erase(
+            remove_if(deviceNameString.begin(), deviceNameString.end(),
+                    ::isspace), deviceNameString.end());
+    // one file per cache key, so binaries built with other options
+    // or drivers are never overwritten
+    std::stringstream name;
+    name << binaryName << "." << deviceNameString << "." << std::hex
+            << hashString(getBinaryCacheKey(device, binaryName, buildOptions));
+    return name.str();
+}
+
+/**
+ * getBinaryCacheKey
+ * key identifying a program binary
+ * @param device device the binary is built for
+ * @param binaryName binary name prefix
+ * @param buildOptions options the program is built with
+ * @return binaryName|device|driver|options hash, without white space
+ */
+std::string getBinaryCacheKey(cl_device_id device,
+        const std::string &binaryName, const std::string &buildOptions) {
+    char deviceName[1024];
+    char driverVersion[256];
+    deviceName[0] = 0;
+    driverVersion[0] = 0;
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName,
+    NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driverVersion),
+            driverVersion, NULL);
+    std::stringstream key;
+    key << binaryName << "|" << deviceName << "|" << driverVersion << "|"
+            << std::hex << hashString(buildOptions);
+    auto rc = key.str();
+    rc.erase(remove_if(rc.begin(), rc.end(), ::isspace), rc.end());
+    return rc;
+}
+
+/**
+ * lookupBinaryManifest
+ * find binary file name for key in manifest
+ * @return true if manifest has an entry for key
+ */
+bool lookupBinaryManifest(const std::string &manifestPath,
+        const std::string &key, std::string &fileName) {
+    std::ifstream in(manifestPath);
+    if (!in.is_open())
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string entryKey, entryFile;
+        if ((ss >> entryKey >> entryFile) && entryKey == key) {
+            fileName = entryFile;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * updateBinaryManifest
+ * add or replace the manifest entry for key
+ * @return true if manifest was written
+ */
+bool updateBinaryManifest(const std::string &manifestPath,
+        const std::string &key, const std::string &fileName) {
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(manifestPath);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream ss(line);
+            std::string entryKey;
+            if ((ss >> entryKey) && entryKey != key)
+                lines.push_back(line);
+        }
+    }
+    std::ofstream out(manifestPath, std::ios::trunc);
+    if (!out.is_open()) {
+        Util::LogError("Failed to write binary manifest : %s\n",
+                manifestPath.c_str());
+        return false;
+    }
+    for (auto &line : lines)
+        out << line << "\n";
+    out << key << " " << fileName << "\n";
+    return out.good();
+}
+
 /**
  * generateBinaryImage
  * generate Binary for a kernel
@@ -514,63 +711,88 @@ int buildOpenCLProgram(cl_program &program, const cl_context &context,
  */
 int generateBinaryImage(const bifData &binaryData) {
     int rc = SUCCESS;
-    std::cout << "Generating binary image for " << binaryData.binaryName
-            << std::endl;
+    Util::LogInfo("Generating binary image for %s\n",
+            binaryData.binaryName.c_str());
     std::unique_ptr<cl_device_id[]> devices;
     std::unique_ptr<char*[]> binaries;
     std::unique_ptr<size_t[]> binarySizes;
-    size_t numDevices = 0;
-    cl_uint numPlatforms = 0;
+    cl_uint numDevices = 0;
     cl_platform_id platform = NULL;
+    char platformName[100];
     std::string flagsStr;
     KernelFile kernelFile;
     std::string kernelPath;
     const char *source = nullptr;
     cl_program program = 0;
-    cl_context context = 0;
+    cl_context context = binaryData.context;
+    bool ownsContext = false;
+    cl_int status = CL_SUCCESS;
 
-    cl_int status = clGetPlatformIDs(0, NULL, &numPlatforms);
-    CHECK_OPENCL_ERROR_CLEANUP(status, "clGetPlatformIDs failed.");
-    if (0 < numPlatforms) {
+    platformName[0] = 0;
+    if (binaryData.numDevices && binaryData.devices) {
+        // build for the requested devices, on their own platform
+        status = clGetDeviceInfo(binaryData.devices[0], CL_DEVICE_PLATFORM,
+                sizeof(platform), &platform, NULL);
+        CHECK_OPENCL_ERROR_CLEANUP(status,
+                "clGetDeviceInfo(CL_DEVICE_PLATFORM) failed.");
+    } else {
+        // build for all devices of the AMD platform if present, otherwise
+        // of the first platform
+        cl_uint numPlatforms = 0;
+        status = clGetPlatformIDs(0, NULL, &numPlatforms);
+        CHECK_OPENCL_ERROR_CLEANUP(status, "clGetPlatformIDs failed.");
         std::unique_ptr<cl_platform_id[]> platforms(
                 new cl_platform_id[numPlatforms]);
         status = clGetPlatformIDs(numPlatforms, platforms.get(), NULL);
         CHECK_OPENCL_ERROR_CLEANUP(status, "clGetPlatformIDs failed.");
-        char platformName[100];
         for (unsigned i = 0; i < numPlatforms; ++i) {
             status = clGetPlatformInfo(platforms[i],
             CL_PLATFORM_VENDOR, sizeof(platformName), platformName,
             NULL);
             CHECK_OPENCL_ERROR_CLEANUP(status, "clGetPlatformInfo failed.");
-            platform = platforms[i];
-            if (!strcmp(platformName, "Advanced Micro Devices, Inc.")) {
-                break;
-            }
+            if (!platform || !strcmp(platformName, "Advanced Micro Devices, Inc."))
+                platform = platforms[i];
         }
-        std::cout << "Platform found : " << platformName << std::endl;
     }
     if (NULL == platform) {
-        std::cout << "NULL platform found so Exiting Application.";
+        Util::LogError("NULL platform found so Exiting Application.\n");
         rc = FAILURE;
         goto CLEANUP;
     }
-    /*
-     * If we could find our platform, use it. Otherwise use just available platform.
-     */
-    {
-        cl_context_properties cps[5] = {
-        CL_CONTEXT_PLATFORM, (cl_context_properties) platform,
-        CL_CONTEXT_OFFLINE_DEVICES_AMD, (cl_context_properties) 1, 0 };
-        context = clCreateContextFromType(cps,
-        CL_DEVICE_TYPE_ALL,
-        NULL,
-        NULL, &status);
-    }
-    CHECK_OPENCL_ERROR_CLEANUP(status, "clCreateContextFromType failed.");
+    status = clGetPlatformInfo(platform, CL_PLATFORM_VENDOR,
+            sizeof(platformName), platformName, NULL);
+    CHECK_OPENCL_ERROR_CLEANUP(status, "clGetPlatformInfo failed.");
+    Util::LogInfo("Platform found : %s\n", platformName);
+
+    if (!context) {
+        ownsContext = true;
+        if (binaryData.numDevices && binaryData.devices) {
+            cl_context_properties cps[3] = {
+            CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+            context = clCreateContext(cps, (cl_uint) binaryData.numDevices,
+                    binaryData.devices, NULL, NULL, &status);
+            CHECK_OPENCL_ERROR_CLEANUP(status, "clCreateContext failed.");
+        } else {
+            cl_context_properties cps[5] = {
+            CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0, 0, 0 };
+#ifdef CL_CONTEXT_OFFLINE_DEVICES_AMD
+            // AMD can also build for devices that are not installed
+            if (!strcmp(platformName, "Advanced Micro Devices, Inc.")) {
+                cps[2] = CL_CONTEXT_OFFLINE_DEVICES_AMD;
+                cps[3] = (cl_context_properties) 1;
+            }
+#endif
+            context = clCreateContextFromType(cps,
+            CL_DEVICE_TYPE_ALL,
+            NULL,
+            NULL, &status);
+            CHECK_OPENCL_ERROR_CLEANUP(status, "clCreateContextFromType failed.");
+        }
+    }
     /* create a CL program using the kernel source */
     kernelPath = binaryData.programPath + binaryData.programFileName;
     if (!kernelFile.open(kernelPath.c_str())) {
-        std::cout << "Failed to load kernel file : " << kernelPath << std::endl;
+        Util::LogError("Failed to load kernel file : %s\n", kernelPath.c_str());
         rc = FAILURE;
         goto CLEANUP;
     }
@@ -582,101 +804,98 @@ int generateBinaryImage(const bifData &binaryData) {
     }
     CHECK_OPENCL_ERROR_CLEANUP(status, "clCreateProgramWithSource failed.");
     flagsStr = std::string(binaryData.flagsStr.c_str());
-// tell compiler not to include source and intermediate representations
-    flagsStr += " -fno-bin-llvmir -fno-bin-amdil -fno-bin-source";
 // Get additional options
     if (binaryData.flagsFileName.size() != 0) {
         KernelFile flagsFile;
         std::string flagsPath = getPath();
         flagsPath.append(binaryData.flagsFileName.c_str());
         if (!flagsFile.open(flagsPath.c_str())) {
-            std::cout << "Failed to load flags file: " << flagsPath
-                    << std::endl;
+            Util::LogError("Failed to load flags file: %s\n",
+                    flagsPath.c_str());
             rc = FAILURE;
             goto CLEANUP;
         }
         flagsFile.replaceNewlineWithSpaces();
         flagsStr.append(flagsFile.source().c_str());
     }
-    if (flagsStr.size() != 0) {
-        std::cout << "Build Options are : " << flagsStr.c_str() << std::endl;
-    }
-    /* create a cl program executable for all the devices specified */
-    status = clBuildProgram(program, (cl_uint) binaryData.numDevices,
-            binaryData.devices, flagsStr.c_str(),
-            NULL,
-            NULL);
-    CHECK_OPENCL_ERROR_CLEANUP(status, "clBuildProgram failed.");
+    {
+        // vendor specific options, e.g. AMD's -fno-bin-source, are
+        // supplied by the device architecture, so the runtime
+        // builds with exactly these options
+        if (flagsStr.size() != 0) {
+            Util::LogInfo("Build Options are : %s\n", flagsStr.c_str());
+        }
+        /* create a cl program executable for all the devices specified */
+        status = clBuildProgram(program, (cl_uint) binaryData.numDevices,
+                binaryData.devices, flagsStr.c_str(),
+                NULL,
+                NULL);
+        CHECK_OPENCL_ERROR_CLEANUP(status, "clBuildProgram failed.");
 
-    status = clGetProgramInfo(program,
-    CL_PROGRAM_NUM_DEVICES, sizeof(numDevices), &numDevices,
-    NULL);
-    CHECK_OPENCL_ERROR_CLEANUP(status,
-            "clGetProgramInfo(CL_PROGRAM_NUM_DEVICES) failed.");
-    std::cout << "Number of devices found : " << numDevices << std::endl;
-    devices = std::unique_ptr<cl_device_id[]>(new cl_device_id[numDevices]);
-    binaries = std::unique_ptr<char*[]>(new char*[numDevices]);
-    binarySizes = std::unique_ptr<size_t[]>(new size_t[numDevices]);
-
-    /* grab the handles to all of the devices in the program. */
-    status = clGetProgramInfo(program,
-    CL_PROGRAM_DEVICES, sizeof(cl_device_id) * numDevices, devices.get(),
-    NULL);
-    CHECK_OPENCL_ERROR_CLEANUP(status,
-            "clGetProgramInfo(CL_PROGRAM_DEVICES) failed.");
+        status = clGetProgramInfo(program,
+        CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint), &numDevices,
+        NULL);
+        CHECK_OPENCL_ERROR_CLEANUP(status,
+                "clGetProgramInfo(CL_PROGRAM_NUM_DEVICES) failed.");
+        Util::LogInfo("Number of devices found : %u\n", numDevices);
+        devices = std::unique_ptr<cl_device_id[]>(new cl_device_id[numDevices]);
+        binaries = std::unique_ptr<char*[]>(new char*[numDevices]);
+        binarySizes = std::unique_ptr<size_t[]>(new size_t[numDevices]);
+
+        /* grab the handles to all of the devices in the program. */
+        status = clGetProgramInfo(program,
+        CL_PROGRAM_DEVICES, sizeof(cl_device_id) * numDevices, devices.get(),
+        NULL);
+        CHECK_OPENCL_ERROR_CLEANUP(status,
+                "clGetProgramInfo(CL_PROGRAM_DEVICES) failed.");
 
-    /* figure out the sizes of each of the binaries. */
-    status = clGetProgramInfo(program,
-    CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * numDevices, binarySizes.get(),
-    NULL);
-    CHECK_OPENCL_ERROR_CLEANUP(status,
-            "clGetProgramInfo(CL_PROGRAM_BINARY_SIZES) failed.");
+        /* figure out the sizes of each of the binaries. */
+        status = clGetProgramInfo(program,
+        CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * numDevices, binarySizes.get(),
+        NULL);
+        CHECK_OPENCL_ERROR_CLEANUP(status,
+                "clGetProgramInfo(CL_PROGRAM_BINARY_SIZES) failed.");
 
-    /* copy over all of the generated binaries. */
-    for (size_t i = 0; i < numDevices; i++) {
-        if (binarySizes[i] != 0) {
-            binaries[i] = new char[binarySizes[i]];
-        } else {
-            binaries[i] = NULL;
+        /* copy over all of the generated binaries. */
+        for (size_t i = 0; i < numDevices; i++) {
+            if (binarySizes[i] != 0) {
+                binaries[i] = new char[binarySizes[i]];
+            } else {
+                binaries[i] = NULL;
+            }
         }
-    }
-
-    status = clGetProgramInfo(program,
-    CL_PROGRAM_BINARIES, sizeof(char*) * numDevices, binaries.get(),
-    NULL);
-    CHECK_OPENCL_ERROR_CLEANUP(status,
-            "clGetProgramInfo(CL_PROGRAM_BINARIES) failed.");
 
-    /* dump out each binary into its own separate file. */
-    for (size_t i = 0; i < numDevices; i++) {
-        char deviceName[1024];
-        status = clGetDeviceInfo(devices[i],
-        CL_DEVICE_NAME, sizeof(deviceName), deviceName,
+        status = clGetProgramInfo(program,
+        CL_PROGRAM_BINARIES, sizeof(char*) * numDevices, binaries.get(),
         NULL);
         CHECK_OPENCL_ERROR_CLEANUP(status,
-                "clGetDeviceInfo(CL_DEVICE_NAME) failed.");
-        if (binarySizes[i] != 0) {
-            // remove white space
-            std::string deviceNameString(deviceName);
-            deviceNameString.erase(
-                    remove_if(deviceNameString.begin(), deviceNameString.end(),
-                            ::isspace), deviceNameString.end());
-
-            auto fileName = binaryData.binaryName + "." + deviceNameString;
-            std::cout << "Generated binary kernel " << fileName
-                    << " for device " << deviceName << std::endl;
-            KernelFile BinaryFile;
-            if (BinaryFile.writeBinaryToFile(fileName.c_str(), binaries[i],
-                    binarySizes[i])) {
-                std::cout << "Failed to load kernel file : " << fileName
-                        << std::endl;
-                rc = FAILURE;
-                goto CLEANUP;
+                "clGetProgramInfo(CL_PROGRAM_BINARIES) failed.");
+
+        /* dump out each binary into its own separate file, and record it in the manifest */
+        for (size_t i = 0; i < numDevices && rc == SUCCESS; i++) {
+            if (binarySizes[i] != 0) {
+                auto fileName = getBinaryFileName(devices[i],
+                        binaryData.binaryName, flagsStr);
+                Util::LogInfo("Generated binary kernel %s\n",
+                        fileName.c_str());
+                KernelFile BinaryFile;
+                if (BinaryFile.writeBinaryToFile(
+                        (binaryData.outputPath + fileName).c_str(), binaries[i],
+                        binarySizes[i])) {
+                    Util::LogError("Failed to write binary file : %s\n",
+                            fileName.c_str());
+                    rc = FAILURE;
+                } else if (!updateBinaryManifest(
+                        binaryData.outputPath + binaryManifestName,
+                        getBinaryCacheKey(devices[i], binaryData.binaryName,
+                                flagsStr), fileName)) {
+                    rc = FAILURE;
+                }
+            } else {
+                Util::LogInfo("%s binary kernel : %s\n",
+                        binaryData.binaryName.c_str(),
+                        "Skipping as there is no binary data to write!");
             }
-        } else {
-            printf("%s binary kernel(%s) : %s\n", deviceName,
-                    binaryData.binaryName.c_str(),
-                    "Skipping as there is no binary data to write!");
         }
     }
 // Release all resources and memory
@@ -684,11 +903,15 @@ int generateBinaryImage(const bifData &binaryData) {
         if (binaries[i])
             delete[] binaries[i];
     }
-    CLEANUP: if (program) {
+    CLEANUP: if (status != CL_SUCCESS)
+        rc = FAILURE;
+    if (program) {
         status = clReleaseProgram(program);
+        program = 0;
         CHECK_OPENCL_ERROR_CLEANUP(status, "clReleaseProgram failed.");
     }
-    if (context) {
+    if (context && ownsContext) {
+        ownsContext = false;
         status = clReleaseContext(context);
         CHECK_OPENCL_ERROR_CLEANUP(status, "clReleaseContext failed.");
     }
@@ -752,6 +975,7 @@ DeviceInfo::DeviceInfo() {
     endianLittle = CL_FALSE;
     available = CL_FALSE;
     compilerAvailable = CL_FALSE;
+    linkerAvailable = CL_FALSE;
     execCapabilities = CL_EXEC_KERNEL;
     queueProperties = 0;
     platform = 0;
@@ -1210,6 +1434,16 @@ int DeviceInfo::setDeviceInfo(cl_device_id deviceId) {
                 "clGetDeviceInfo(CL_DEVICE_OPENCL_C_VERSION) failed");
     }
 #endif
+#ifdef CL_VERSION_1_2
+    if (checkOpenCLVersion(1, 2)) {
+        // Device linker available
+        status = clGetDeviceInfo(deviceId,
+        CL_DEVICE_LINKER_AVAILABLE, sizeof(cl_bool), &linkerAvailable,
+        NULL);
+        CHECK_OPENCL_ERROR(status,
+                "clGetDeviceInfo(CL_DEVICE_LINKER_AVAILABLE) failed");
+    }
+#endif
 #ifdef CL_VERSION_2_0
     if (checkOpenCL2_XCompatibility()) {
         status = clGetDeviceInfo(deviceId,
@@ -1268,23 +1502,49 @@ bool DeviceInfo::checkOpenCL2_XCompatibility() {
     return isOpenCL2_XSupported;
 }
 
+/**
+ * checkOpenCLVersion
+ * Check if the device supports at least OpenCL major.minor
+ * @return @bool
+ */
+bool DeviceInfo::checkOpenCLVersion(int major, int minor) {
+    int majorRev, minorRev;
+    if (!this->deviceVersion
+            || sscanf(this->deviceVersion, "OpenCL %d.%d", &majorRev, &minorRev)
+                    != 2)
+        return false;
+
+    return majorRev > major || (majorRev == major && minorRev >= minor);
+}
+
+void Util::LogDebug(const char *str, ...) {
+    if (str && LoggerOCL::isEnabled(LogLevelDebug)) {
+        va_list args;
+        va_start(args, str);
+
+        LoggerOCL::vlog(LogLevelDebug, str, args);
+
+        va_end(args);
+    }
+}
+
 void Util::LogInfo(const char *str, ...) {
-    if (str) {
+    if (str && LoggerOCL::isEnabled(LogLevelInfo)) {
         va_list args;
         va_start(args, str);
 
-        vfprintf(stdout, str, args);
+        LoggerOCL::vlog(LogLevelInfo, str, args);
 
         va_end(args);
     }
 }
 
 void Util::LogError(const char *str, ...) {
-    if (str) {
+    if (str && LoggerOCL::isEnabled(LogLevelError)) {
         va_list args;
         va_start(args, str);
 
-        vfprintf(stderr, str, args);
+        LoggerOCL::vlog(LogLevelError, str, args);
 
         va_end(args);
     }
@@ -1787,6 +2047,20 @@ cl_int Util::unmapMemory(cl_command_queue queue, cl_uint numWaitEvents,
 
 }
 
+cl_int Util::enqueueMarker(cl_command_queue queue, bool synchronous,
+        cl_uint numWaitEvents, const cl_event *waitEvents,
+        cl_event *completionEvent) {
+    cl_int error_code = clEnqueueMarkerWithWaitList(queue, numWaitEvents,
+            waitEvents, completionEvent);
+    if (CL_SUCCESS == error_code && synchronous)
+        error_code = clFinish(queue);
+    if (CL_SUCCESS != error_code) {
+        Util::LogError("Error: clEnqueueMarkerWithWaitList return %s.\n",
+                Util::TranslateOpenCLError(error_code));
+    }
+    return error_code;
+}
+
 cl_int Util::getRefCount(cl_event evt) {
     cl_int refCount = -1;
     cl_int error_code = clGetEventInfo(evt, CL_EVENT_REFERENCE_COUNT,
@@ -34,6 +34,7 @@
 #ifdef OPENCL_FOUND
 #include <string>
 #include <iostream>
+#include <vector>
 
 #if defined(__APPLE__) || defined(__MACOSX)
 #include <OpenCL/cl.h>
@@ -44,26 +45,31 @@
 #endif
 
 #include "IArch.h"
+#include "LoggerOCL.h"
 
 namespace ltk {
 
+// error location, logged after the error itself
+#define LTK_LOG_LOCATION() \
+    ltk::LoggerOCL::log(ltk::LogLevelError, "Location : %s:%d\n", __FILE__, __LINE__)
+
 #define CHECK_OPENCL_ERROR_NO_RETURN(actual, msg) \
     if(checkVal(actual, CL_SUCCESS, msg)) \
     { \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
     }
 
 #define CHECK_OPENCL_ERROR(actual, msg) \
     if(checkVal(actual, CL_SUCCESS, msg)) \
     { \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
         return FAILURE; \
     }
 
 #define CHECK_OPENCL_ERROR_CLEANUP(actual, msg) \
     if(checkVal(actual, CL_SUCCESS, msg)) \
     { \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
         goto CLEANUP; \
     }
 
@@ -82,7 +88,7 @@ const int EXPECTED_FAILURE = 2;
     if(actual == NULL) \
     { \
         error(msg); \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
         return FAILURE; \
     }
 
@@ -90,7 +96,7 @@ const int EXPECTED_FAILURE = 2;
     if(actual == NULL) \
     { \
         error(msg); \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
         goto CLEANUP; \
     }
 
@@ -98,7 +104,7 @@ const int EXPECTED_FAILURE = 2;
     if(actual != reference) \
     { \
         error(msg); \
-        std::cout << "Location : " << __FILE__ << ":" << __LINE__<< std::endl; \
+        LTK_LOG_LOCATION(); \
         return FAILURE; \
     }
 
@@ -183,15 +189,17 @@ struct bifData {
 	std::string flagsFileName; /**< flagFileName flags file for the kernel */
 	std::string flagsStr; /**< flagsStr flags string */
 	std::string binaryName; /**< binaryName name of the binary */
+	std::string outputPath; /**< outputPath directory (with trailing separator) for binaries and manifest */
 	size_t numDevices;
 	cl_device_id *devices; /**< devices array of device to build kernel for */
+	cl_context context; /**< context holding devices. If null, a context is created */
 
 	/**
 	 * Constructor
 	 */
 	bifData() :
-			kernelName(""), flagsFileName(""), flagsStr(""), binaryName(""), numDevices(
-					0), devices(nullptr) {
+			kernelName(""), flagsFileName(""), flagsStr(""), binaryName(""), outputPath(""), numDevices(
+					0), devices(nullptr), context(0) {
 	}
 };
 
@@ -352,8 +360,8 @@ static int checkVal(T input, T reference, std::string message, bool isAPIerror =
 		return SUCCESS;
 	} else {
 		if (isAPIerror) {
-			std::cout << "Error: " << message << ". Error code : ";
-			std::cout << getOpenCLErrorCodeStr(input) << std::endl;
+			LoggerOCL::log(LogLevelError, "Error: %s. Error code : %s\n",
+					message.c_str(), getOpenCLErrorCodeStr(input));
 		} else {
 			error(message);
 		}
@@ -369,9 +377,53 @@ static int checkVal(T input, T reference, std::string message, bool isAPIerror =
  */
 int displayDevices(cl_platform_id platform, cl_device_type deviceType);
 
+// manifest mapping binary cache keys to binary files
+const char* const binaryManifestName = "latke_binaries.manifest";
+
+/**
+ * getBinaryFileName
+ * file name of program binary for a device and build options
+ * @param device device the binary was built for
+ * @param binaryName binary name prefix
+ * @param buildOptions options the program is built with
+ * @return binaryName.<device name without white space>.<cache key hash>
+ */
+std::string getBinaryFileName(cl_device_id device,
+		const std::string &binaryName, const std::string &buildOptions);
+
+/**
+ * getBinaryCacheKey
+ * key identifying a program binary, shared by the offline binary
+ * generator and the runtime binary loader
+ * @param device device the binary is built for
+ * @param binaryName binary name prefix
+ * @param buildOptions options the program is built with
+ * @return key made of binary name, device name, driver version and options hash
+ */
+std::string getBinaryCacheKey(cl_device_id device,
+		const std::string &binaryName, const std::string &buildOptions);
+
+/**
+ * lookupBinaryManifest
+ * find binary file name for key in manifest
+ * @return true if manifest has an entry for key
+ */
+bool lookupBinaryManifest(const std::string &manifestPath,
+		const std::string &key, std::string &fileName);
+
+/**
+ * updateBinaryManifest
+ * add or replace the manifest entry for key
+ * @return true if manifest was written
+ */
+bool updateBinaryManifest(const std::string &manifestPath,
+		const std::string &key, const std::string &fileName);
+
 /**
  * generateBinaryImage
- * geenrate Binary for a kernel
+ * generate Binary for a kernel, for the devices in binaryData, or if none
+ * are specified, for all devices of the AMD platform (including offline devices)
+ * or the first platform. Each binary is recorded in the manifest in binaryData.outputPath
  * @param binaryData bifdata object
  * @return 0 if success else nonzero
  */
@@ -423,6 +475,33 @@ int getDevices(cl_context &context, cl_device_id **devices,
 int buildOpenCLProgram(cl_program &program, const cl_context &context,
 		const buildProgramData &buildData);
 
+#ifdef CL_VERSION_1_2
+/**
+ * compileOpenCLProgram
+ * compiles the OpenCL program source without linking it
+ * @param program compiled program object
+ * @param context cl_context object
+ * @param buildData buildProgramData Object (binaryName is ignored)
+ * @return 0 if success else nonzero
+ */
+int compileOpenCLProgram(cl_program &program, const cl_context &context,
+		const buildProgramData &buildData);
+
+/**
+ * linkOpenCLProgram
+ * links compiled programs and libraries into a library or an executable
+ * @param program linked program object
+ * @param context cl_context object
+ * @param device device to link for
+ * @param options link options, e.g. -create-library
+ * @param inputs compiled programs and libraries to link
+ * @return 0 if success else nonzero
+ */
+int linkOpenCLProgram(cl_program &program, const cl_context &context,
+		cl_device_id device, const std::string &options,
+		const std::vector<cl_program> &inputs);
+#endif
+
 /**
  * DeviceInfo
  * class implements the functionality to query
@@ -481,6 +560,7 @@ public:
 	cl_bool endianLittle; /**< endianLittle endian Little of device*/
 	cl_bool available; /**< available available of device*/
 	cl_bool compilerAvailable; /**< compilerAvailable compilerAvailable of device*/
+	cl_bool linkerAvailable; /**< linkerAvailable linker available on device (OpenCL 1.2+)*/
 	cl_device_exec_capabilities execCapabilities;/**< execCapabilities exec Capabilities of device*/
 	cl_command_queue_properties queueProperties;/**< queueProperties queueProperties of device*/
 	cl_platform_id platform; /**< platform platform of device*/
@@ -521,6 +601,13 @@ public:
 	 */
 	bool checkOpenCL2_XCompatibility();
 
+	/**
+	 * checkOpenCLVersion
+	 * Check if the device supports at least OpenCL major.minor
+	 * @return @bool
+	 */
+	bool checkOpenCLVersion(int major, int minor);
+
 private:
 
 	/**
@@ -534,10 +621,10 @@ private:
 			return 0;
 		} else {
 			if (isAPIerror) {
-				std::cout << "Error: " << message << ". Error code : ";
-				std::cout << getOpenCLErrorCodeStr(input) << std::endl;
+				LoggerOCL::log(LogLevelError, "Error: %s. Error code : %s\n",
+						message.c_str(), getOpenCLErrorCodeStr(input));
 			} else {
-				std::cout << message;
+				LoggerOCL::write(LogLevelError, message);
 			}
 			return 1;
 		}
@@ -554,10 +641,9 @@ class Util {
 
 public:
 
-	// Print useful information to the default output. Same usage as with printf
+	// Log through LoggerOCL at debug, info and error level. Same usage as with printf
+	static void LogDebug(const char *str, ...);
 	static void LogInfo(const char *str, ...);
-
-	// Print error notification to the default output. Same usage as with printf
 	static void LogError(const char *str, ...);
 
 	// Find an OpenCL platform from the preferredVendor with the preferred device(s)
@@ -603,6 +689,12 @@ public:
 			const cl_event *waitEvents, cl_event *completionEvent,
 			cl_mem memory, void *mappedPtr);
 
+	// command that moves no data, standing in for the map or unmap of a
+	// read/write transfer; synchronous waits for the queue to finish
+	static cl_int enqueueMarker(cl_command_queue queue, bool synchronous,
+			cl_uint numWaitEvents, const cl_event *waitEvents,
+			cl_event *completionEvent);
+
 	static cl_int getRefCount(cl_event evt);
 
 private:
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "WorkGroupTunerOCL.h"
+#include "DeviceOCL.h"
+#include "KernelOCL.h"
+#include "UtilOCL.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <limits>
+
+namespace ltk {
+
+static std::string stripWhiteSpace(const char *str) {
+	std::string rc(str ? str : "");
+	rc.erase(remove_if(rc.begin(), rc.end(), ::isspace), rc.end());
+	return rc;
+}
+
+WorkGroupTunerOCL::WorkGroupTunerOCL(DeviceOCL *dev, std::string file) :
+		device(dev), cacheFile(file), profilingQueue(nullptr) {
+}
+
+WorkGroupTunerOCL::~WorkGroupTunerOCL() {
+	delete profilingQueue;
+}
+
+QueueOCL* WorkGroupTunerOCL::getProfilingQueue() {
+	if (!profilingQueue)
+		profilingQueue = new QueueOCL(device, CL_QUEUE_PROFILING_ENABLE);
+	return profilingQueue;
+}
+
+std::vector<WorkGroupShape> WorkGroupTunerOCL::getCandidates(size_t apron,
+		size_t ldsBytesPerPixel) const {
+	std::vector<WorkGroupShape> candidates;
+	auto info = device->deviceInfo;
+	size_t maxCols = info->maxWorkItemDims > 0 ? info->maxWorkItemSizes[0] : 1;
+	size_t maxRows = info->maxWorkItemDims > 1 ? info->maxWorkItemSizes[1] : 1;
+	const size_t minWorkGroupSize = 16;
+	const size_t maxTileRows = 16;
+	for (size_t cols = 8; cols <= maxCols && cols <= 256; cols <<= 1) {
+		for (size_t rows = 1; rows <= maxRows && rows <= maxTileRows; ++rows) {
+			size_t wgSize = cols * rows;
+			if (wgSize < minWorkGroupSize || wgSize > info->maxWorkGroupSize)
+				continue;
+			cl_ulong lds = (cl_ulong) (cols + apron) * (rows + apron)
+					* ldsBytesPerPixel;
+			if (lds > info->localMemSize)
+				continue;
+			candidates.push_back(WorkGroupShape(cols, rows));
+		}
+	}
+	return candidates;
+}
+
+std::string WorkGroupTunerOCL::getKey(const std::string &kernelName,
+		size_t width, size_t height) const {
+	std::stringstream key;
+	key << stripWhiteSpace(device->deviceInfo->name) << "|"
+			<< stripWhiteSpace(device->deviceInfo->driverVersion) << "|"
+			<< kernelName << "|" << width << "x" << height;
+	return key.str();
+}
+
+bool WorkGroupTunerOCL::load(const std::string &kernelName, size_t width,
+		size_t height, WorkGroupShape &shape) const {
+	std::ifstream in(cacheFile);
+	if (!in.is_open())
+		return false;
+	auto key = getKey(kernelName, width, height);
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream ss(line);
+		std::string entryKey;
+		WorkGroupShape entry;
+		if (!(ss >> entryKey >> entry.cols >> entry.rows))
+			continue;
+		if (entryKey == key && entry.size() > 0) {
+			shape = entry;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool WorkGroupTunerOCL::store(const std::string &kernelName, size_t width,
+		size_t height, WorkGroupShape shape, double milliseconds) {
+	auto key = getKey(kernelName, width, height);
+	std::vector<std::string> lines;
+	{
+		std::ifstream in(cacheFile);
+		std::string line;
+		while (std::getline(in, line)) {
+			std::istringstream ss(line);
+			std::string entryKey;
+			if ((ss >> entryKey) && entryKey != key)
+				lines.push_back(line);
+		}
+	}
+	std::ofstream out(cacheFile, std::ios::trunc);
+	if (!out.is_open()) {
+		Util::LogError("Error: unable to write tuning cache %s\n",
+				cacheFile.c_str());
+		return false;
+	}
+	for (auto &line : lines)
+		out << line << "\n";
+	out << key << " " << shape.cols << " " << shape.rows << " "
+			<< milliseconds << "\n";
+	return out.good();
+}
+
+bool WorkGroupTunerOCL::tune(const std::string &kernelName, size_t width,
+		size_t height, const std::vector<WorkGroupShape> &candidates,
+		std::function<bool(WorkGroupShape, double&)> timeCandidate,
+		WorkGroupShape &best) {
+	double bestMs = std::numeric_limits<double>::max();
+	bool found = false;
+	for (auto &candidate : candidates) {
+		double ms = 0;
+		if (!timeCandidate(candidate, ms))
+			continue;
+		Util::LogInfo("Tile %zux%zu : %g ms\n", candidate.cols, candidate.rows,
+				ms);
+		if (ms < bestMs) {
+			bestMs = ms;
+			best = candidate;
+			found = true;
+		}
+	}
+	if (!found)
+		return false;
+	Util::LogInfo("Best tile for %s : %zux%zu (%g ms)\n", kernelName.c_str(),
+			best.cols, best.rows, bestMs);
+
+	return store(kernelName, width, height, best, bestMs);
+}
+
+bool WorkGroupTunerOCL::timeLaunch(KernelOCL *kernel, EnqueueInfoOCL info,
+		uint32_t iterations, double &milliseconds) {
+	if (iterations == 0)
+		return false;
+	info.queue = getProfilingQueue();
+	info.needsCompletionEvent = true;
+	std::vector<double> times;
+	// first launch is a warm-up
+	for (uint32_t i = 0; i < iterations + 1; ++i) {
+		try {
+			kernel->enqueue(info);
+		} catch (std::exception &ex) {
+			return false;
+		}
+		if (!info.completionEvent.wait())
+			return false;
+		if (i > 0)
+			times.push_back(getElapsedMs(info.completionEvent.get()));
+	}
+	std::sort(times.begin(), times.end());
+	milliseconds = times[times.size() / 2];
+
+	return true;
+}
+
+double WorkGroupTunerOCL::getElapsedMs(cl_event evt) {
+	cl_ulong start = 0, end = 0;
+	cl_int error_code = clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START,
+			sizeof(cl_ulong), &start, NULL);
+	if (error_code == CL_SUCCESS)
+		error_code = clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END,
+				sizeof(cl_ulong), &end, NULL);
+	if (error_code != CL_SUCCESS) {
+		Util::LogError("Error: clGetEventProfilingInfo returned %s.\n",
+				Util::TranslateOpenCLError(error_code));
+		return 0;
+	}
+	return (double) (end - start) / 1000000.0;
+}
+
+}
+#endif
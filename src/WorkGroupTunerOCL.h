@@ -0,0 +1,109 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+#include "latke_config.h"
+#ifdef OPENCL_FOUND
+#include "platform.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include "QueueOCL.h"
+#include "EnqueueInfoOCL.h"
+
+namespace ltk {
+
+class KernelOCL;
+
+// 2D work group (tile) shape : cols maps to dimension 0, rows to dimension 1
+struct WorkGroupShape {
+	WorkGroupShape() : cols(0), rows(0) {
+	}
+	WorkGroupShape(size_t c, size_t r) : cols(c), rows(r) {
+	}
+	size_t size() const {
+		return cols * rows;
+	}
+	size_t cols;
+	size_t rows;
+};
+
+/**
+ * WorkGroupTunerOCL
+ *
+ * Sweeps 2D work group shapes for a kernel, times each candidate
+ * with profiling events, and persists the fastest shape per
+ * (device, driver, kernel, resolution) in a plain text cache file.
+ */
+class WorkGroupTunerOCL {
+public:
+	WorkGroupTunerOCL(DeviceOCL *device, std::string cacheFile);
+	~WorkGroupTunerOCL();
+
+	/**
+	 * getCandidates
+	 * enumerate tile shapes that satisfy device work group limits and
+	 * the local memory budget of a tile plus its apron
+	 * @param apron number of extra rows/columns read by a tile
+	 * @param ldsBytesPerPixel local memory bytes per apron pixel
+	 * @return candidate shapes
+	 */
+	std::vector<WorkGroupShape> getCandidates(size_t apron,
+			size_t ldsBytesPerPixel) const;
+
+	// look up persisted shape. Returns false if no entry exists
+	bool load(const std::string &kernelName, size_t width, size_t height,
+			WorkGroupShape &shape) const;
+
+	// persist shape, replacing any existing entry with the same key
+	bool store(const std::string &kernelName, size_t width, size_t height,
+			WorkGroupShape shape, double milliseconds);
+
+	/**
+	 * tune
+	 * time every candidate and persist the fastest one
+	 * @param timeCandidate returns false if candidate can't be built or launched,
+	 * otherwise stores launch time in milliseconds
+	 * @return true if at least one candidate was successfully timed
+	 */
+	bool tune(const std::string &kernelName, size_t width, size_t height,
+			const std::vector<WorkGroupShape> &candidates,
+			std::function<bool(WorkGroupShape, double&)> timeCandidate,
+			WorkGroupShape &best);
+
+	// median device execution time of repeated launches on the profiling queue.
+	// Kernel arguments must already be set; info.queue is ignored.
+	bool timeLaunch(KernelOCL *kernel, EnqueueInfoOCL info, uint32_t iterations,
+			double &milliseconds);
+
+	QueueOCL* getProfilingQueue();
+
+	// END - START of a completed command, in milliseconds
+	static double getElapsedMs(cl_event evt);
+
+private:
+	std::string getKey(const std::string &kernelName, size_t width,
+			size_t height) const;
+	DeviceOCL *device;
+	std::string cacheFile;
+	QueueOCL *profilingQueue;
+};
+
+}
+#endif
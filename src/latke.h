@@ -22,6 +22,20 @@
 #include "DeviceOCL.h"
 #include "DeviceManagerOCL.h"
 #include "QueueOCL.h"
+#include "QueuePoolOCL.h"
+#include "TaskGraphOCL.h"
+#include "EventOCL.h"
+#include "CompletionDispatcherOCL.h"
+#include "FutureOCL.h"
+#include "CoroutineOCL.h"
+#include "CommandSequenceOCL.h"
+#include "ProfilerOCL.h"
+#include "TracerOCL.h"
+#include "DeviceProfileOCL.h"
+#include "RooflineOCL.h"
+#include "LoggerOCL.h"
+#include "CountersOCL.h"
+#include "CensusOCL.h"
 #include "EnqueueInfoOCL.h"
 #include "DualBufferOCL.h"
 #include "DualImageOCL.h"
@@ -29,5 +43,7 @@
 #include "UtilOCL.h"
 #include "KernelOCL.h"
 #include "ArchFactory.h"
+#include "WorkGroupTunerOCL.h"
+#include "ProgramCacheOCL.h"
 
 
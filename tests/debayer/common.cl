@@ -60,6 +60,16 @@
     //#define printf(fmt, ...)
 #endif
 
+// Per-pixel helpers stay INLINE in every kernel translation unit, so calls
+// with constant arguments fold; they are never emitted into the helper library.
+// With LTK_LINKED_HELPERS, only the non-hot helpers below are declared here :
+// their definitions are compiled once into the helper library (helpers.cl)
+// which the program is linked against
+#if defined(LTK_LINKED_HELPERS) && !defined(LTK_HELPER_LIBRARY)
+#define LTK_HELPER_DECLARATIONS
+#endif
+
+#ifndef LTK_HELPER_LIBRARY
 //don't take this near upper limits of integral type
 INLINE uint divUp(const uint x, const uint divisor){
     return (x + (divisor - 1)) / divisor;
@@ -94,6 +104,7 @@ INLINE uint log2Up(uint x){
 INLINE uint isPowerOf2(uint x){
     return (x & (x - 1)) == 0;
 }
+#endif
 
 #define STRINGIFY2( x) #x
 #define STRINGIFY(x) STRINGIFY2(x)
@@ -104,15 +115,23 @@ INLINE uint isPowerOf2(uint x){
 #define PASTE_3( a, b, c) a##b##c
 #define PASTE3( a, b, c) PASTE_3( a, b, c)
 
+#ifdef LTK_HELPER_DECLARATIONS
+uint get_workgroup_size();
+#else
 uint get_workgroup_size(){
     return get_local_size(0) * get_local_size(1) * get_local_size(2);
 }
+#endif
 
 #if __OPENCL_VERSION__ < 200
 #define work_group_barrier barrier
+#ifdef LTK_HELPER_DECLARATIONS
+uint get_local_linear_id();
+#else
 uint get_local_linear_id(){
     return get_local_id(0) + get_local_id(1) * get_local_size(0) + get_local_id(2) * get_local_size(0) * get_local_size(1);
 }
+#endif
 
 #define atomic_load(p) atomic_or((p), 0)
 #endif
@@ -18,16 +18,13 @@
  */
 #pragma once
 #include "common.h"
+#include "BayerGenerator.h"
 #include <cmath>
+#include <type_traits>
 
 // template struct to handle debayer to either image or buffer
 template<typename M, typename A> struct Debayer {
-	int debayer(int argc, char *argv[],
-			pfn_event_notify HostToDeviceMappedCallback,
-			pfn_event_notify DeviceToHostMappedCallback,
-			std::string kernelFile);
-	BlockingQueue<JobInfo<M>*> mappedHostToDeviceQueue;
-	BlockingQueue<JobInfo<M>*> mappedDeviceToHostQueue;
+	int debayer(int argc, char *argv[], std::string kernelFile);
 };
 
 enum pattern_t {
@@ -36,12 +33,37 @@ enum pattern_t {
 
 const int numCLBuffers = 4;
 const int numPostProcBuffers = 16;
+// default tile, used when no tuned tile has been persisted
 const int tile_rows = 5;
 const int tile_columns = 32;
+// LDS apron and bytes per LDS pixel of malvar_he_cutler_demosaic
+const int kernel_apron = 4;
+const int kernel_lds_pixel_bytes = 4;
+// integer ops per pixel of malvar_he_cutler_demosaic : every pixel computes
+// all four filter responses, then selects channels by Bayer site
+const double kernel_ops_per_pixel = 80;
+// profiler label of the demosaic launch
+const char *const demosaic_label = "demosaic";
+const uint32_t tuning_iterations = 10;
 const int platformId = 0;
 const eDeviceType deviceType = GPU;
 const int deviceNum = 0;
 
+// detaches a profiler from a queue pool before the profiler is destroyed,
+// on every exit path. Continuations already running may still hold the
+// profiler, so wait for the dispatcher to drain them
+struct ProfilerDetach {
+	ProfilerDetach(DeviceOCL *dev, QueuePoolOCL *pool) :
+			dev(dev), pool(pool) {
+	}
+	~ProfilerDetach() {
+		pool->setProfiler(nullptr);
+		dev->getCompletionDispatcher()->finish();
+	}
+	DeviceOCL *dev;
+	QueuePoolOCL *pool;
+};
+
 inline char separator()
 {
 #ifdef _WIN32
@@ -52,8 +74,7 @@ inline char separator()
 }
 
 template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
-		char *argv[], pfn_event_notify HostToDeviceMappedCallback,
-		pfn_event_notify DeviceToHostMappedCallback, std::string kernelFile) {
+		char *argv[], std::string kernelFile) {
 
 
 	CmdLine cmd("debayer command line", ' ',"v1.0");
@@ -67,10 +88,62 @@ template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
 	ValueArg<std::string> patternArg("p", "pattern", "Bayer Pattern", false,
 			"", "string", cmd);
 
+	SwitchArg tuneArg("t", "tune", "Autotune kernel tile size", cmd);
+
+	ValueArg<std::string> tuningCacheArg("c", "tuning-cache", "Tuning Cache File", false,
+			"latke_tuning.txt", "string", cmd);
+
+	SwitchArg profileArg("P", "profile", "Report device time per command", cmd);
+
+	SwitchArg probeArg("b", "probe",
+			"Choose transfers and size their batches from measured device bandwidth", cmd);
+
+	SwitchArg rooflineArg("R", "roofline",
+			"Report kernel bandwidth against device roofline", cmd);
+
+	ValueArg<std::string> traceArg("T", "trace", "Chrome Trace Output File", false,
+			"", "string", cmd);
+
+	ValueArg<std::string> syntheticArg("g", "synthetic",
+			"Generate WIDTHxHEIGHT Bayer frames instead of reading images", false,
+			"", "string", cmd);
+
+	ValueArg<uint32_t> framesArg("f", "frames", "Number of synthetic frames", false,
+			48, "uint", cmd);
+
+	ValueArg<uint32_t> bitDepthArg("d", "bit-depth",
+			"Synthetic frame bit depth : 8 or 16", false, 8, "uint", cmd);
+
+	SwitchArg nullSinkArg("n", "null-sink",
+			"Discard output instead of writing images", cmd);
+
+	ValueArg<std::string> metricsArg("m", "metrics",
+			"Prometheus textfile, rewritten every second", false,
+			"", "string", cmd);
+
+	ValueArg<std::string> censusArg("C", "census",
+			"Append OpenCL object census to file every second (- for stdout)",
+			false, "", "string", cmd);
+
+	ValueArg<std::string> logLevelArg("l", "log-level",
+			"Log level : debug, info, warning, error or off "
+			"(default LATKE_LOG_LEVEL, or info)", false, "info",
+			"string", cmd);
+
 	cmd.parse(argc, argv);
 
+	if (logLevelArg.isSet()) {
+		LogLevel logLevel;
+		if (!LoggerOCL::parseLevel(logLevelArg.getValue(), logLevel)) {
+			std::cerr << "Unknown log level " << logLevelArg.getValue();
+			return -1;
+		}
+		LoggerOCL::setLevel(logLevel);
+	}
+
 
-	if (!inputDirArg.isSet()) {
+	bool synthetic = syntheticArg.isSet();
+	if (!synthetic && !inputDirArg.isSet()) {
 		std::cerr << "Required image directory missing";
 		return -1;
 	}
@@ -80,36 +153,59 @@ template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
 	if (outputDirArg.isSet())
 		outputDir = outputDirArg.getValue();
 
-	// set up directory iterator
-	auto dir = opendir(inputDir.c_str());
-	if (!dir) {
-		std::cerr << "Unable to open image directory " << inputDir;
-		return -1;
-	}
-	struct dirent *content = nullptr;
-	std::string inputFile;
 	BlockingQueue<std::string> imageQueue;
-	while ((content = readdir(dir)) != nullptr) {
-		if (strcmp(".", content->d_name) == 0
-				|| strcmp("..", content->d_name) == 0)
-			continue;
-		inputFile = content->d_name;
-		imageQueue.push(content->d_name);
-	}
-	closedir(dir);
-	uint32_t numImages = (imageQueue.size()/numCLBuffers) * numCLBuffers;
-	int numBatches = numImages / numCLBuffers;
-
-	// read first image in to get image dimensions
+	uint32_t numImages = 0;
 	int width = 0, height = 0, channels = 0;
-	std::string inputFileFull = inputDir + separator() + inputFile.c_str();
-	auto image = stbi_load(inputFileFull.c_str(), &width, &height, &channels,
-			STBI_default);
-	if (!image) {
-		std::cerr << "Failed to read image file " << inputFile;
-		return -1;
+	uint32_t bitDepth = 8;
+	if (synthetic) {
+		unsigned int w = 0, h = 0;
+		if (sscanf(syntheticArg.getValue().c_str(), "%ux%u", &w, &h) != 2
+				|| w == 0 || h == 0) {
+			std::cerr << "Synthetic frame size must be WIDTHxHEIGHT";
+			return -1;
+		}
+		width = (int) w;
+		height = (int) h;
+		numImages = std::max<uint32_t>(framesArg.getValue() / numCLBuffers, 1)
+				* numCLBuffers;
+		bitDepth = bitDepthArg.getValue() == 16 ? 16 : 8;
+		if (bitDepth == 16 && std::is_same<M, DualImageOCL>::value) {
+			std::cerr << "16 bit frames are only supported by debayer_buffer";
+			return -1;
+		}
+	} else {
+		// set up directory iterator
+		auto dir = opendir(inputDir.c_str());
+		if (!dir) {
+			std::cerr << "Unable to open image directory " << inputDir;
+			return -1;
+		}
+		struct dirent *content = nullptr;
+		std::string inputFile;
+		while ((content = readdir(dir)) != nullptr) {
+			if (strcmp(".", content->d_name) == 0
+					|| strcmp("..", content->d_name) == 0)
+				continue;
+			inputFile = content->d_name;
+			imageQueue.push(content->d_name);
+		}
+		closedir(dir);
+		numImages = (imageQueue.size()/numCLBuffers) * numCLBuffers;
+
+		// read first image in to get image dimensions
+		std::string inputFileFull = inputDir + separator() + inputFile.c_str();
+		auto image = stbi_load(inputFileFull.c_str(), &width, &height, &channels,
+				STBI_default);
+		if (!image) {
+			std::cerr << "Failed to read image file " << inputFile;
+			return -1;
+		}
+		stbi_image_free(image);
 	}
-	stbi_image_free(image);
+	int numBatches = numImages / numCLBuffers;
+	uint32_t bytesPerSample = bitDepth / 8;
+	// PNG output is 8 bit only
+	bool nullSink = nullSinkArg.getValue() || bitDepth == 16;
 
 	uint32_t bufferWidth = width;
 	uint32_t bufferHeight = height;
@@ -128,19 +224,31 @@ template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
 			std::cout << "Unrecognized bayer pattern " << patt << ". Using RGGB." << std::endl;
 	}
 
+	std::unique_ptr<BayerGenerator> generator;
+	if (synthetic)
+		generator = std::make_unique<BayerGenerator>(bufferWidth, bufferHeight,
+				bayer_pattern, bitDepth);
+	auto generatorPtr = generator.get();
+	std::atomic<uint32_t> nextFrame(0);
+
 	uint32_t bps_out = 4;
-	uint32_t bufferPitch = bufferWidth;
+	uint32_t bufferPitch = bufferWidth * bytesPerSample;
 	uint32_t frameSize = bufferPitch * bufferHeight;
-	uint32_t bufferPitchOut = bufferWidth * bps_out;
+	uint32_t bufferPitchOut = bufferWidth * bps_out * bytesPerSample;
 	uint32_t frameSizeOut = bufferPitchOut * bufferHeight;
 
 	uint8_t *postProcBuffers[numPostProcBuffers];
 	BlockingQueue<uint8_t*> availableBuffers;
-	for (int i = 0; i < numPostProcBuffers; ++i) {
+	for (int i = 0; i < numPostProcBuffers && !nullSink; ++i) {
 		postProcBuffers[i] = new uint8_t[frameSizeOut];
 		availableBuffers.push(postProcBuffers[i]);
 	}
   cl_command_queue_properties queue_props = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+	// device commands are traced from profiling events
+	bool profile = profileArg.getValue() || traceArg.isSet()
+			|| rooflineArg.getValue();
+	if (profile)
+		queue_props |= CL_QUEUE_PROFILING_ENABLE;
 
 	// 1. create device manager
 	auto deviceManager = std::make_shared<DeviceManagerOCL>(true);
@@ -151,6 +259,11 @@ template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
 	}
 
 	auto dev = deviceManager->getDevice(deviceNum);
+	if (censusArg.isSet()
+			&& !CensusOCL::startDumps(censusArg.getValue(), 1000)) {
+		std::cerr << "Failed to open census file " << censusArg.getValue();
+		return -1;
+	}
 
 	auto arch = ArchFactory::getArchitecture(dev->deviceInfo->venderId);
 	if (!arch){
@@ -160,233 +273,471 @@ template<typename M, typename A> int Debayer<M, A>::debayer(int argc,
 
 	std::shared_ptr<M> hostToDevice[numCLBuffers];
 	std::shared_ptr<M> deviceToHost[numCLBuffers];
-	std::shared_ptr<QueueOCL> kernelQueue[numCLBuffers];
+	QueueOCL *kernelQueue[numCLBuffers];
 	JobInfo<M> *currentJobInfo[numCLBuffers];
 	JobInfo<M> *prevJobInfo[numCLBuffers];
 
-	std::stringstream buildOptions;
-	buildOptions << " -I ./ ";
-	buildOptions << " -D TILE_ROWS=" << tile_rows;
-	buildOptions << " -D TILE_COLS=" << tile_columns;
+	// options shared by the kernel and the helper library
+	std::stringstream commonOptions;
+	commonOptions << " -I ./ ";
 	switch (arch->getVendorId()) {
 		case vendorIdAMD:
-			buildOptions << " -D AMD_GPU_ARCH";
+			commonOptions << " -D AMD_GPU_ARCH";
 			break;
 		case vendorIdNVD:
-			buildOptions << " -D NVIDIA_ARCH";
+			commonOptions << " -D NVIDIA_ARCH";
+			break;
+		default:
 			break;
+	}
+	commonOptions << arch->getBuildOptions();
+	//commonOptions << " -D DEBUG";
+
+	auto makeInitInfo = [&](WorkGroupShape tile) {
+		std::stringstream buildOptions;
+		buildOptions << commonOptions.str();
+		buildOptions << " -D TILE_ROWS=" << tile.rows;
+		buildOptions << " -D TILE_COLS=" << tile.cols;
+		buildOptions << " -D OUTPUT_CHANNELS=" << bps_out;
+		if (bitDepth == 16)
+			buildOptions << " -D PIXELT=ushort -D ALPHA_VALUE=USHRT_MAX";
+
+		KernelInitInfoBase initInfoBase(dev, buildOptions.str(), "",
+		BUILD_BINARY_IN_MEMORY);
+		KernelInitInfo initInfo(initInfoBase, kernelFile, "debayer",
+				"malvar_he_cutler_demosaic");
+		// helpers are compiled once and shared by every tile size
+		initInfo.helperPrograms.push_back("helpers.cl");
+		initInfo.helperBuildOptions = commonOptions.str();
+		return initInfo;
+	};
+	switch (arch->getVendorId()) {
+		case vendorIdAMD:
+		case vendorIdNVD:
 		case vendorIdXILINX:
-			buildOptions << "";
+		case vendorIdINTL:
 			break;
-    case vendorIdINTL:
-      buildOptions << "";
-      break;
 		default:
 			return -1;
-
 	}
-	buildOptions << " -D OUTPUT_CHANNELS=" << bps_out;
-	buildOptions << arch->getBuildOptions();
-	//buildOptions << " -D DEBUG";
-
-	KernelInitInfoBase initInfoBase(dev, buildOptions.str(), "",
-	BUILD_BINARY_IN_MEMORY);
-	KernelInitInfo initInfo(initInfoBase, kernelFile, "debayer",
-			"malvar_he_cutler_demosaic");
-	std::shared_ptr<KernelOCL> kernel;
-	try {
-		kernel = std::make_unique<KernelOCL>(initInfo);
-	} catch (std::runtime_error &re) {
-		std::cerr << "Unable to build kernel. Exiting" << std::endl;
-		return -1;
+	if (dev->getQueuePool(queue_props)->isOutOfOrderEmulated())
+		std::cout << "Device has no out of order queues : using "
+				<< QueuePoolOCL::inOrderFanOut << " in order queues per role"
+				<< std::endl;
+	if (probeArg.getValue()) {
+		auto &deviceProfile = dev->getDeviceProfile();
+		if (deviceProfile.valid) {
+			std::cout << "Write " << deviceProfile.pinnedWriteBandwidth
+					<< " GB/s pinned, " << deviceProfile.pageableWriteBandwidth
+					<< " GB/s pageable, " << deviceProfile.mapWriteBandwidth
+					<< " GB/s mapped, " << deviceProfile.deviceCopyBandwidth
+					<< " GB/s device copy; transfer latency "
+					<< deviceProfile.smallTransferLatency << " us" << std::endl;
+			// buffers allocated below follow the profile
+			std::cout << "Using "
+					<< (deviceProfile.prefersMappedTransfers() ?
+							"mapped" : "read/write") << " transfers, "
+					<< (deviceProfile.prefersPinnedHostMemory() ?
+							"pinned" : "pageable") << " host memory" << std::endl;
+			dev->getQueuePool(queue_props)->setFlushPolicy(
+					deviceProfile.getFlushPolicy());
+		} else {
+			std::cout << "Device probe failed : using default flush policy"
+					<< std::endl;
+		}
 	}
-
-	A allocator(dev, bufferWidth, bufferHeight, 1, CL_UNSIGNED_INT8, queue_props);
-	A allocatorOut(dev, bufferWidth, bufferHeight, 4, CL_UNSIGNED_INT8, queue_props);
+	std::unique_ptr<ProfilerOCL> profiler;
+	// destroyed before profiler
+	std::unique_ptr<ProfilerDetach> profilerDetach;
+	if (profile) {
+		profiler = std::make_unique<ProfilerOCL>(dev);
+		dev->getQueuePool(queue_props)->setProfiler(profiler.get());
+		profilerDetach = std::make_unique<ProfilerDetach>(dev,
+				dev->getQueuePool(queue_props));
+	}
+	std::unique_ptr<TracerOCL> tracer;
+	if (traceArg.isSet())
+		tracer = std::make_unique<TracerOCL>();
+	auto tracerPtr = tracer.get();
+	uint32_t dataType = bitDepth == 16 ? CL_UNSIGNED_INT16 : CL_UNSIGNED_INT8;
+	A allocator(dev, bufferWidth, bufferHeight, 1, dataType, queue_props);
+	A allocatorOut(dev, bufferWidth, bufferHeight, 4, dataType, queue_props);
 	for (int i = 0; i < numCLBuffers; ++i) {
 		hostToDevice[i] = allocator.allocate(true);
 		deviceToHost[i] = allocatorOut.allocate(false);
-		kernelQueue[i] = std::make_unique<QueueOCL>(dev,queue_props);
+		kernelQueue[i] = dev->getQueuePool(queue_props)->lease(ComputeQueue);
 		currentJobInfo[i] = nullptr;
 		prevJobInfo[i] = nullptr;
 	}
 
-	// queue all kernel runs
-	for (int j = 0; j < numBatches; j++) {
-		for (int i = 0; i < numCLBuffers; ++i) {
-			bool lastBatch = j == numBatches - 1;
-			auto prev = currentJobInfo[i];
-			currentJobInfo[i] = new JobInfo<M>(dev, hostToDevice[i],
-												deviceToHost[i], prevJobInfo[i]);
-			prevJobInfo[i] = prev;
-
-			// map
-			// (wait for previous kernel to complete)
-			cl_event hostToDeviceMapped;
-			if (!hostToDevice[i]->map(prev ? 1 : 0,
-										prev ? &prev->kernelCompleted : nullptr,
-										&hostToDeviceMapped, false)) {
-				return -1;
-			}
-			// set callback, which will add this image
-			// info to host-side queue of mapped buffers
-			auto error_code = clSetEventCallback(hostToDeviceMapped,
-			CL_COMPLETE, HostToDeviceMappedCallback, currentJobInfo[i]);
-			if (DeviceSuccess != error_code) {
-				Util::LogError("Error: clSetEventCallback returned %s.\n",
-						Util::TranslateOpenCLError(error_code));
-				return -1;
-			}
-			Util::ReleaseEvent(hostToDeviceMapped);
-
-			// unmap
-			if (!hostToDevice[i]->unmap(1,
-										&currentJobInfo[i]->hostToDevice->triggerMemUnmap,
-										&currentJobInfo[i]->hostToDevice->memUnmapped)) {
-				return -1;
-			}
-
-			kernel->pushArg<cl_uint>(&bufferHeight);
-			kernel->pushArg<cl_uint>(&bufferWidth);
-			kernel->pushArg<cl_mem>(hostToDevice[i]->getDeviceMem());
-			kernel->pushArg<cl_uint>(&bufferPitch);
-			kernel->pushArg<cl_mem>(deviceToHost[i]->getDeviceMem());
-			kernel->pushArg<cl_uint>(&bufferPitchOut);
-			kernel->pushArg<cl_int>(&bayer_pattern);
-
-			EnqueueInfoOCL info(kernelQueue[i].get());
-			info.dimension = 2;
-			info.local_work_size[0] = tile_columns;
-			info.local_work_size[1] = tile_rows;
-			info.global_work_size[0] = (size_t) std::ceil(
-					bufferWidth / (double) tile_columns)
-					* info.local_work_size[0];
-			info.global_work_size[1] = (size_t) std::ceil(
-					bufferHeight / (double) tile_rows)
-					* info.local_work_size[1];
-			info.needsCompletionEvent = true;
-			info.pushWaitEvent(currentJobInfo[i]->hostToDevice->memUnmapped);
-			// wait for unmapping of previous deviceToHost
-			if (prev)
-				info.pushWaitEvent(prev->hostToDevice->memUnmapped);
+	auto setKernelArgs = [&](KernelOCL *knl, int i) {
+		knl->setArg<cl_uint>(0, &bufferHeight);
+		knl->setArg<cl_uint>(1, &bufferWidth);
+		knl->setArg<cl_mem>(2, hostToDevice[i]->getDeviceMem());
+		knl->setArg<cl_uint>(3, &bufferPitch);
+		knl->setArg<cl_mem>(4, deviceToHost[i]->getDeviceMem());
+		knl->setArg<cl_uint>(5, &bufferPitchOut);
+		knl->setArg<cl_int>(6, &bayer_pattern);
+	};
+	// 2. select tile : tune if requested, otherwise use persisted tile if available
+	WorkGroupTunerOCL tuner(dev, tuningCacheArg.getValue());
+	std::string tuningName = kernelFile + ":malvar_he_cutler_demosaic";
+	if (bitDepth == 16)
+		tuningName += ":16";
+	WorkGroupShape tile(tile_columns, tile_rows);
+	if (tuneArg.getValue()) {
+		auto candidates = tuner.getCandidates(kernel_apron, kernel_lds_pixel_bytes);
+		auto timeCandidate = [&](WorkGroupShape candidate, double &ms) {
+			std::unique_ptr<KernelOCL> knl;
+			EnqueueInfoOCL info(tuner.getProfilingQueue());
 			try {
-				kernel->enqueue(info);
+				knl = std::make_unique<KernelOCL>(makeInitInfo(candidate));
+				setKernelArgs(knl.get(), 0);
+				// local size comes from the kernel's reqd_work_group_size;
+				// throws if the compiled kernel can't run a tile this large
+				knl->configureLaunch(info, bufferWidth, bufferHeight);
 			} catch (std::exception &ex) {
-				// todo: handle exception
+				return false;
 			}
-			currentJobInfo[i]->kernelCompleted = info.completionEvent;
+			return tuner.timeLaunch(knl.get(), info, tuning_iterations, ms);
+		};
+		if (!tuner.tune(tuningName, bufferWidth, bufferHeight, candidates,
+				timeCandidate, tile))
+			std::cout << "Tuning failed : using default tile" << std::endl;
+	} else if (tuner.load(tuningName, bufferWidth, bufferHeight, tile)) {
+		std::cout << "Using tuned tile " << tile.cols << "x" << tile.rows
+				<< std::endl;
+	}
 
-			// map
-			cl_event deviceToHostMapped;
-			if (!deviceToHost[i]->map(1, &currentJobInfo[i]->kernelCompleted,
-					&deviceToHostMapped, false)) {
-				return -1;
-			}
-			// set callback on mapping
-			error_code = clSetEventCallback(deviceToHostMapped,
-											CL_COMPLETE,
-											DeviceToHostMappedCallback,
-											currentJobInfo[i]);
-			if (DeviceSuccess != error_code) {
-				Util::LogError("Error: clSetEventCallback returned %s.\n",
-						Util::TranslateOpenCLError(error_code));
-				return -1;
-			}
-			Util::ReleaseEvent(deviceToHostMapped);
-
-			// unmap (except last batch)
-			if (!lastBatch) {
-				if (!deviceToHost[i]->unmap(1,
-											&currentJobInfo[i]->deviceToHost->triggerMemUnmap,
-											&currentJobInfo[i]->deviceToHost->memUnmapped)) {
-					return -1;
-				}
-			}
+	std::shared_ptr<KernelOCL> kernel;
+	try {
+		kernel = std::make_unique<KernelOCL>(makeInitInfo(tile));
+	} catch (std::runtime_error &re) {
+		std::cerr << "Unable to build kernel. Exiting" << std::endl;
+		return -1;
+	}
+	// each launch reads its tiles plus aprons, and writes bps_out
+	// channels per pixel
+	std::unique_ptr<RooflineOCL> roofline;
+	if (rooflineArg.getValue()) {
+		roofline = std::make_unique<RooflineOCL>(dev, &dev->getDeviceProfile());
+		double pixels = (double) bufferWidth * bufferHeight;
+		double apronRatio = (double) ((tile.rows + kernel_apron)
+				* (tile.cols + kernel_apron)) / (double) (tile.rows * tile.cols);
+		// under the label of the profiled launch, recorded below
+		roofline->declare(demosaic_label,
+				KernelCostOCL(pixels * bytesPerSample * apronRatio,
+						pixels * bps_out * bytesPerSample,
+						pixels * kernel_ops_per_pixel, pixels));
+	}
+	// one kernel object per slot : arguments stay bound between frames,
+	// and slots never contend on a shared cl_kernel
+	std::unique_ptr<KernelOCL> slotKernel[numCLBuffers];
+	try {
+		for (int i = 0; i < numCLBuffers; ++i) {
+			slotKernel[i] = kernel->clone();
+			setKernelArgs(slotKernel[i].get(), i);
 		}
+	} catch (std::exception &ex) {
+		std::cerr << "Unable to clone kernel. Exiting" << std::endl;
+		return -1;
 	}
 
-	// wait for cl memory objects from queue, fill them, and trigger unmap event
-	auto start = std::chrono::high_resolution_clock::now();
-	std::thread pushImages([this, frameSize, numImages, &imageQueue, inputDir]() {
-		JobInfo<M> *info = nullptr;
-		int count = 0;
-		while (mappedHostToDeviceQueue.waitAndPop(info)) {
-			std::string fname;
-			imageQueue.waitAndPop(fname);
-			info->fileName = fname;
-			int width = 0, height = 0, channels = 0;
-			fname = inputDir + separator() + fname;
-			auto image = stbi_load(fname.c_str(), &width, &height, &channels,	STBI_default);
-			memcpy(info->hostToDevice->mem->getHostBuffer(), image, frameSize);
-			stbi_image_free(image);
-			// trigger unmap, allowing current kernel to proceed
-			Util::SetEventComplete(info->hostToDevice->triggerMemUnmap);
-			if (++count == numImages)
-				break;
+	// per frame commands are recorded once per slot, and replayed per frame
+	// with bindings 0 : hostToDevice, 1 : deviceToHost
+	enum {
+		MapIn, UnmapIn, Demosaic, MapOut, UnmapOut, NumSteps
+	};
+	std::unique_ptr<CommandSequenceOCL> sequence[numCLBuffers];
+	CommandSequenceOCL::Replay replays[numCLBuffers];
+	try {
+		for (int i = 0; i < numCLBuffers; ++i) {
+			KernelArgsOCL args;
+			args.set<cl_uint>(0, bufferHeight);
+			args.set<cl_uint>(1, bufferWidth);
+			args.set<cl_uint>(3, bufferPitch);
+			args.set<cl_uint>(5, bufferPitchOut);
+			args.set<cl_int>(6, bayer_pattern);
+			EnqueueInfoOCL launch(kernelQueue[i]);
+			slotKernel[i]->configureLaunch(launch, bufferWidth, bufferHeight);
+			launch.label = demosaic_label;
+
+			sequence[i] = std::make_unique<CommandSequenceOCL>(dev);
+			sequence[i]->recordMap(0);
+			sequence[i]->recordUnmap(0);
+			sequence[i]->recordKernel(slotKernel[i].get(), launch, args,
+					{ { 2, 0 }, { 4, 1 } });
+			sequence[i]->recordMap(1);
+			sequence[i]->recordUnmap(1);
+			sequence[i]->finalize();
+
+			replays[i].bindings = { hostToDevice[i].get(), deviceToHost[i].get() };
+			replays[i].waits.resize(NumSteps);
 		}
-	});
-
-	// wait for processed images from queue, handle them,
-	// and trigger unmap event
+	} catch (std::exception &ex) {
+		std::cerr << "Unable to record command sequence : " << ex.what() << std::endl;
+		return -1;
+	}
+	if (sequence[0]->usesCommandBuffers())
+		std::cout << "Replaying kernels from command buffers" << std::endl;
+
+	// host work is attached to device completion as continuations,
+	// which run on the device's completion dispatcher
+	auto dispatcher = dev->getCompletionDispatcher();
+	// runtime counters, optionally exported for the textfile collector
+	auto counters = &dev->counters;
+	std::string metricsFile = metricsArg.getValue();
+	std::string deviceLabel = dev->deviceInfo->name ? dev->deviceInfo->name : "";
+	std::atomic<bool> metricsDone(false);
+	std::thread metricsWriter;
+	if (metricsArg.isSet()) {
+		metricsWriter = std::thread([counters, metricsFile, deviceLabel,
+				&metricsDone] {
+			while (!metricsDone) {
+				counters->writeTextfile(metricsFile, deviceLabel);
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		});
+	}
+	auto stopMetrics = [&metricsWriter, &metricsDone] {
+		if (!metricsWriter.joinable())
+			return false;
+		metricsDone = true;
+		metricsWriter.join();
+		return true;
+	};
 	std::mutex postMutex;
 	std::condition_variable postCondition;
+	std::atomic<uint32_t> postCount(0);
+	// frames to post process : lowered to the frames issued if a replay fails
+	std::atomic<uint32_t> postTarget(numImages);
 	auto postProcPool = new ThreadPool(std::thread::hardware_concurrency());
-	std::thread pullImages([this, frameSizeOut, &postProcPool, bufferWidth, bufferHeight,
-							bps_out, &availableBuffers, outputDir, numImages,
-							&postCondition, &postMutex]() {
-		JobInfo<M> *info = nullptr;
-		int pullCount;
-		std::atomic<int> postCount(0);
-		while (mappedDeviceToHostQueue.waitAndPop(info)) {
-			uint8_t *buf;
-			if (availableBuffers.waitAndPop(buf)) {
+	// decode, copies and the wait for a free output buffer run here, not on
+	// the dispatcher thread : continuations only hand work over. Separate
+	// from postProcPool, whose encodes release the buffers pulls wait for
+	auto hostPool = std::make_unique<ThreadPool>(2 * numCLBuffers);
+	// fill mapped buffer with next image, and trigger unmap event
+	auto pushImage = [frameSize, &imageQueue, inputDir, tracerPtr, generatorPtr,
+						&nextFrame](JobInfo<M> *info, cl_int status) {
+		if (status < 0)
+			Util::LogError("Error: host to device map failed with %s.\n",
+					Util::TranslateOpenCLError(status));
+		if (generatorPtr) {
+			// generate straight into the mapped buffer
+			auto frameIndex = nextFrame++;
+			info->fileName = "frame_" + std::to_string(frameIndex);
+			{
+				TraceScopeOCL span(tracerPtr, "generate");
+				generatorPtr->generate(frameIndex,
+						info->hostToDevice->mem->getHostBuffer());
+			}
+			info->hostToDevice->triggerMemUnmap.setComplete();
+			return;
+		}
+		std::string fname;
+		imageQueue.waitAndPop(fname);
+		info->fileName = fname;
+		int width = 0, height = 0, channels = 0;
+		fname = inputDir + separator() + fname;
+		unsigned char *image = nullptr;
+		{
+			TraceScopeOCL span(tracerPtr, "decode");
+			image = stbi_load(fname.c_str(), &width, &height, &channels,	STBI_default);
+		}
+		if (image) {
+			TraceScopeOCL span(tracerPtr, "copy in");
+			memcpy(info->hostToDevice->mem->getHostBuffer(), image, frameSize);
+			stbi_image_free(image);
+		}
+		// trigger unmap, allowing current kernel to proceed
+		info->hostToDevice->triggerMemUnmap.setComplete();
+	};
+	// copy processed image out of mapped buffer, hand it to post processing,
+	// and trigger unmap event
+	auto pullImage = [frameSizeOut, postProcPool, bufferWidth, bufferHeight,
+						bps_out, &availableBuffers, outputDir, &postTarget,
+						&postCondition, &postMutex, &postCount, tracerPtr,
+						nullSink, counters](JobInfo<M> *info, cl_int status) {
+		if (status < 0)
+			Util::LogError("Error: device to host map failed with %s.\n",
+					Util::TranslateOpenCLError(status));
+		uint8_t *buf;
+		counters->framesInFlight--;
+		if (nullSink) {
+			if (++postCount == postTarget){
+				std::lock_guard<std::mutex> lk(postMutex);
+				postCondition.notify_one();
+			}
+		} else if (availableBuffers.waitAndPop(buf)) {
+			counters->poolOccupancy++;
+			{
+				TraceScopeOCL span(tracerPtr, "copy out");
 				memcpy(buf, info->deviceToHost->mem->getHostBuffer(),frameSizeOut);
-				auto evt = [buf, bufferWidth, bufferHeight,
-							bps_out, &availableBuffers, info, outputDir, numImages,
-							&postCondition, &postMutex, &postCount] {
-					std::stringstream f;
-					f << outputDir << separator() << info->fileName << ".png";
-					stbi_write_png(f.str().c_str(), bufferWidth, bufferHeight, bps_out,buf, bufferWidth*bps_out);
-					availableBuffers.push(buf);
-					if (++postCount == numImages){
-						std::lock_guard<std::mutex> lk(postMutex);
-						postCondition.notify_one();
-					}
-				};
-				postProcPool->enqueue(evt);
-			} else {
-				std::cout << "mappedDeviceToHostQueue failed" << std::endl;
 			}
-			// trigger unmap, allowing next kernel to proceed
-			Util::SetEventComplete(info->deviceToHost->triggerMemUnmap);
-
-			// cleanup
-			delete info->prev;
-			info->prev = nullptr;
-			if (++pullCount == numImages){
-				break;
+			std::string fileName = info->fileName;
+			auto evt = [buf, bufferWidth, bufferHeight,
+						bps_out, &availableBuffers, fileName, outputDir, &postTarget,
+						&postCondition, &postMutex, &postCount, tracerPtr,
+						counters] {
+				std::stringstream f;
+				f << outputDir << separator() << fileName << ".png";
+				{
+					TraceScopeOCL span(tracerPtr, "encode");
+					stbi_write_png(f.str().c_str(), bufferWidth, bufferHeight, bps_out,buf, bufferWidth*bps_out);
+				}
+				availableBuffers.push(buf);
+				counters->poolOccupancy--;
+				if (++postCount == postTarget){
+					std::lock_guard<std::mutex> lk(postMutex);
+					postCondition.notify_one();
+				}
+			};
+			postProcPool->enqueue(evt);
+		} else {
+			std::cout << "availableBuffers failed" << std::endl;
+		}
+		// trigger unmap, allowing next kernel to proceed
+		info->deviceToHost->triggerMemUnmap.setComplete();
+
+		// cleanup
+		delete info->prev;
+		info->prev = nullptr;
+	};
+
+	// queue all kernel runs
+	auto start = std::chrono::high_resolution_clock::now();
+	FutureOCL pulled[numCLBuffers];
+	for (int i = 0; i < numCLBuffers; ++i)
+		pulled[i] = FutureOCL::makeReady();
+	uint32_t issued = 0;
+	bool failed = false;
+	for (int j = 0; j < numBatches && !failed; j++) {
+		for (int i = 0; i < numCLBuffers; ++i) {
+			bool lastBatch = j == numBatches - 1;
+			auto prev = currentJobInfo[i];
+			currentJobInfo[i] = new JobInfo<M>(dev, hostToDevice[i],
+												deviceToHost[i], prevJobInfo[i]);
+			prevJobInfo[i] = prev;
+			auto job = currentJobInfo[i];
+			counters->framesInFlight++;
+
+			// replay map, unmap, debayer, map, unmap (no final unmap
+			// on last batch). Each step waits on the step before it.
+			auto &replay = replays[i];
+			// unmap once host has filled the buffer
+			replay.waits[UnmapIn] = { job->hostToDevice->triggerMemUnmap.get() };
+			// wait for unmapping of previous hostToDevice
+			replay.waits[Demosaic].clear();
+			if (prev)
+				replay.waits[Demosaic].push_back(prev->hostToDevice->memUnmapped.get());
+			replay.waits[UnmapOut] = { job->deviceToHost->triggerMemUnmap.get() };
+			// map waits for previous kernel to complete
+			{
+				TraceScopeOCL span(tracerPtr, "enqueue");
+				if (!sequence[i]->replay(replay, prev ? 1 : 0,
+						prev ? prev->kernelCompleted.ptr() : nullptr,
+						lastBatch ? UnmapOut : NumSteps)) {
+					// stop issuing work. Release whatever part of this job
+					// was enqueued; jobs already issued are drained below
+					// before their continuations' state is destroyed
+					counters->framesInFlight--;
+					job->hostToDevice->triggerMemUnmap.setComplete();
+					job->deviceToHost->triggerMemUnmap.setComplete();
+					failed = true;
+					break;
+				}
 			}
+			issued++;
+
+			auto pool = hostPool.get();
+			FutureOCL hostToDeviceMapped(std::move(replay.events[MapIn]), dispatcher);
+			hostToDeviceMapped.then([job, pushImage, pool](cl_int status) {
+				pool->enqueue([job, pushImage, status] {
+					pushImage(job, status);
+				});
+			});
+			job->hostToDevice->memUnmapped = std::move(replay.events[UnmapIn]);
+			job->kernelCompleted = std::move(replay.events[Demosaic]);
+			FutureOCL deviceToHostMapped(std::move(replay.events[MapOut]), dispatcher);
+			// previous job in this slot is pulled first, as pulling
+			// this job deletes it : the slot's future is ready once the
+			// pull has run on the host pool
+			PromiseOCL pulledPromise;
+			FutureOCL::whenAll( { pulled[i], deviceToHostMapped }).then(
+					[job, deviceToHostMapped, pullImage, pool, pulledPromise](
+							cl_int status) {
+						(void) status;
+						pool->enqueue([job, deviceToHostMapped, pullImage,
+								pulledPromise]() mutable {
+							pullImage(job, deviceToHostMapped.getStatus());
+							pulledPromise.setStatus();
+						});
+					});
+			pulled[i] = pulledPromise.getFuture();
+			job->deviceToHost->memUnmapped = std::move(replay.events[UnmapOut]);
 		}
-	});
-	std::unique_lock<std::mutex> lk(postMutex);
-	postCondition.wait(lk);
+	}
+
+	// wait for all issued images to be pulled and post processed
+	if (failed)
+		postTarget = issued;
+	FutureOCL::whenAll(std::vector<FutureOCL>(pulled, pulled + numCLBuffers)).wait();
+	// no continuation may still reference the pools or the state below
+	dispatcher->finish();
+	{
+		std::unique_lock<std::mutex> lk(postMutex);
+		postCondition.wait(lk, [&postCount, &postTarget] {
+			return postCount == postTarget;
+		});
+	}
 	auto finish = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = finish - start;
 
+	if (stopMetrics() && !failed
+			&& counters->writeTextfile(metricsFile, deviceLabel))
+		std::cout << "Wrote metrics to " << metricsFile << std::endl;
+
 	// cleanup
-	pushImages.join();
-	pullImages.join();
+	hostPool.reset();
 	delete postProcPool;
-	for (int i = 0; i < numPostProcBuffers; ++i)
+	for (int i = 0; i < numPostProcBuffers && !nullSink; ++i)
 		delete[] postProcBuffers[i];
 	for (int i = 0; i < numCLBuffers; ++i) {
-		deviceToHost[i]->unmap(0, nullptr, nullptr);
-		delete currentJobInfo[i]->prev;
+		// the last batch leaves its output mapped
+		if (!failed)
+			deviceToHost[i]->unmap(0, nullptr, nullptr);
+		if (currentJobInfo[i])
+			delete currentJobInfo[i]->prev;
+		delete prevJobInfo[i];
 		delete currentJobInfo[i];
 	}
 	delete arch;
+	if (failed)
+		return -1;
+	// library messages are written before the results
+	LoggerOCL::flush();
 	fprintf(stdout, "opencl processing time per image = %f ms\n",
 			(elapsed.count() * 1000) / (double) numImages);
+	auto submissions = dev->getQueuePool(queue_props)->getSubmissionStats();
+	fprintf(stdout, "%llu commands in %llu submissions (mean batch %.1f, max %u)\n",
+			(unsigned long long) submissions.commands,
+			(unsigned long long) submissions.submissions,
+			submissions.meanBatch(), submissions.maxBatch);
+	if (tracer && tracer->writeChromeTrace(traceArg.getValue(), profiler.get()))
+		std::cout << "Wrote trace to " << traceArg.getValue() << std::endl;
+	if (profiler) {
+		if (profileArg.getValue())
+			profiler->report(std::cout);
+		if (roofline)
+			roofline->report(std::cout, *profiler);
+	}
+	// all job events are released at this point
+	CensusOCL::stopDumps();
+	if (Event::getLiveCount()) {
+		fprintf(stdout, "warning: %lld OpenCL events leaked\n",
+				(long long) Event::getLiveCount());
+		CensusOCL::report(std::cout);
+	}
 
 	return 0;
 }
@@ -18,32 +18,7 @@
  */
 #include "debayer.cpp"
 
-Debayer<DualBufferOCL, BufferAllocater> debayer;
-
-void CL_CALLBACK HostToDeviceMappedCallback(cl_event event,
-		cl_int cmd_exec_status, void *user_data) {
-
-	assert(user_data);
-
-	auto info = (JobInfo<DualBufferOCL>*) user_data;
-
-	// push mapped image into queue
-	debayer.mappedHostToDeviceQueue.push(info);
-}
-
-void CL_CALLBACK DeviceToHostMappedCallback(cl_event event,
-		cl_int cmd_exec_status, void *user_data) {
-
-	assert(user_data);
-	// handle processed data
-	auto info = (JobInfo<DualBufferOCL>*) user_data;
-
-	// push mapped image into queue
-	debayer.mappedDeviceToHostQueue.push(info);
-}
-
 int main(int argc, char *argv[]) {
-	return debayer.debayer(argc, argv,
-			(pfn_event_notify) HostToDeviceMappedCallback,
-			(pfn_event_notify) DeviceToHostMappedCallback, "debayerBuffer.cl");
+	Debayer<DualBufferOCL, BufferAllocater> debayer;
+	return debayer.debayer(argc, argv, "debayerBuffer.cl");
 }
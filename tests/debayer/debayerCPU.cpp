@@ -0,0 +1,384 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "debayerCPU.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define DEBAYER_CPU_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+// ADDRESS_REFLECT_BORDER_EXCLUSIVE in image.cl
+inline int reflect(int v, int n) {
+	v = v < 0 ? -v : v;
+	return v >= n ? n - (v - n) - 2 : v;
+}
+
+template<typename T> inline T saturate(int v) {
+	const int maxVal = std::numeric_limits<T>::max();
+	return (T) (v < 0 ? 0 : (v > maxVal ? maxVal : v));
+}
+
+// one pixel, written as in debayerBuffer.cl
+template<typename T> void demosaicPixel(const T *const *rows, T *out, int c,
+		int width, bool redRow, int siteCol) {
+	auto F = [rows, c, width](int dx, int dy) -> int {
+		return rows[2 + dy][reflect(c + dx, width)];
+	};
+	const int Fij = F(0, 0);
+	const int R1 = (4 * F(0, 0)
+			+ 2 * (F(-1, 0) + F(0, -1) + F(1, 0) + F(0, 1)) - F(-2, 0)
+			- F(2, 0) - F(0, -2) - F(0, 2)) / 8;
+	const int R2 = (8 * (F(-1, 0) + F(1, 0)) + 10 * F(0, 0) + F(0, -2)
+			+ F(0, 2)
+			- 2 * ((F(-1, -1) + F(1, -1) + F(-1, 1) + F(1, 1)) + F(-2, 0)
+					+ F(2, 0))) / 16;
+	const int R3 = (8 * (F(0, -1) + F(0, 1)) + 10 * F(0, 0) + F(-2, 0)
+			+ F(2, 0)
+			- 2 * ((F(-1, -1) + F(1, -1) + F(-1, 1) + F(1, 1)) + F(0, -2)
+					+ F(0, 2))) / 16;
+	const int R4 = (12 * F(0, 0)
+			- 3 * (F(-2, 0) + F(2, 0) + F(0, -2) + F(0, 2))
+			+ 4 * (F(-1, -1) + F(1, -1) + F(-1, 1) + F(1, 1))) / 16;
+
+	const bool isSite = (c & 1) == siteCol;
+	int R, G, B;
+	G = isSite ? R1 : Fij;
+	if (redRow) {
+		R = isSite ? Fij : R2;
+		B = isSite ? R4 : R3;
+	} else {
+		R = isSite ? R4 : R3;
+		B = isSite ? Fij : R2;
+	}
+	out[c * 4] = saturate<T>(R);
+	out[c * 4 + 1] = saturate<T>(G);
+	out[c * 4 + 2] = saturate<T>(B);
+	out[c * 4 + 3] = std::numeric_limits<T>::max();
+}
+
+#ifdef DEBAYER_CPU_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+namespace sse41 {
+struct Vec {
+	typedef __m128i V;
+	static const uint32_t lanes = 4;
+	static inline V load(const uint8_t *p) {
+		int32_t v;
+		memcpy(&v, p, sizeof(v));
+		return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+	}
+	static inline V load(const uint16_t *p) {
+		return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) p));
+	}
+	static inline V add(V a, V b) {
+		return _mm_add_epi32(a, b);
+	}
+	static inline V sub(V a, V b) {
+		return _mm_sub_epi32(a, b);
+	}
+	static inline V mul(V a, int b) {
+		return _mm_mullo_epi32(a, _mm_set1_epi32(b));
+	}
+	// signed division truncating toward zero, as in C
+	static inline V div8(V a) {
+		return _mm_srai_epi32(
+				_mm_add_epi32(a, _mm_and_si128(_mm_srai_epi32(a, 31),
+						_mm_set1_epi32(7))), 3);
+	}
+	static inline V div16(V a) {
+		return _mm_srai_epi32(
+				_mm_add_epi32(a, _mm_and_si128(_mm_srai_epi32(a, 31),
+						_mm_set1_epi32(15))), 4);
+	}
+	// b where mask is set, otherwise a
+	static inline V blend(V a, V b, V mask) {
+		return _mm_blendv_epi8(a, b, mask);
+	}
+	// lanes start on an even column
+	static inline V siteMask(int siteCol) {
+		return siteCol ? _mm_setr_epi32(0, -1, 0, -1) :
+							_mm_setr_epi32(-1, 0, -1, 0);
+	}
+	static inline V clamp(V a, int maxVal) {
+		return _mm_min_epi32(_mm_max_epi32(a, _mm_setzero_si128()),
+				_mm_set1_epi32(maxVal));
+	}
+	static inline void store(uint8_t *out, V R, V G, V B) {
+		V rgba = _mm_or_si128(
+				_mm_or_si128(clamp(R, UINT8_MAX),
+						_mm_slli_epi32(clamp(G, UINT8_MAX), 8)),
+				_mm_or_si128(_mm_slli_epi32(clamp(B, UINT8_MAX), 16),
+						_mm_set1_epi32((int) 0xFF000000)));
+		_mm_storeu_si128((__m128i*) out, rgba);
+	}
+	static inline void store(uint16_t *out, V R, V G, V B) {
+		V rg = _mm_or_si128(clamp(R, UINT16_MAX),
+				_mm_slli_epi32(clamp(G, UINT16_MAX), 16));
+		V ba = _mm_or_si128(clamp(B, UINT16_MAX),
+				_mm_set1_epi32((int) 0xFFFF0000));
+		_mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi32(rg, ba));
+		_mm_storeu_si128((__m128i*) (out + 8), _mm_unpackhi_epi32(rg, ba));
+	}
+};
+#include "debayerCPUSimd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2 {
+struct Vec {
+	typedef __m256i V;
+	static const uint32_t lanes = 8;
+	static inline V load(const uint8_t *p) {
+		return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) p));
+	}
+	static inline V load(const uint16_t *p) {
+		return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p));
+	}
+	static inline V add(V a, V b) {
+		return _mm256_add_epi32(a, b);
+	}
+	static inline V sub(V a, V b) {
+		return _mm256_sub_epi32(a, b);
+	}
+	static inline V mul(V a, int b) {
+		return _mm256_mullo_epi32(a, _mm256_set1_epi32(b));
+	}
+	static inline V div8(V a) {
+		return _mm256_srai_epi32(
+				_mm256_add_epi32(a, _mm256_and_si256(_mm256_srai_epi32(a, 31),
+						_mm256_set1_epi32(7))), 3);
+	}
+	static inline V div16(V a) {
+		return _mm256_srai_epi32(
+				_mm256_add_epi32(a, _mm256_and_si256(_mm256_srai_epi32(a, 31),
+						_mm256_set1_epi32(15))), 4);
+	}
+	static inline V blend(V a, V b, V mask) {
+		return _mm256_blendv_epi8(a, b, mask);
+	}
+	static inline V siteMask(int siteCol) {
+		return siteCol ? _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1) :
+							_mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+	}
+	static inline V clamp(V a, int maxVal) {
+		return _mm256_min_epi32(_mm256_max_epi32(a, _mm256_setzero_si256()),
+				_mm256_set1_epi32(maxVal));
+	}
+	static inline void store(uint8_t *out, V R, V G, V B) {
+		V rgba = _mm256_or_si256(
+				_mm256_or_si256(clamp(R, UINT8_MAX),
+						_mm256_slli_epi32(clamp(G, UINT8_MAX), 8)),
+				_mm256_or_si256(_mm256_slli_epi32(clamp(B, UINT8_MAX), 16),
+						_mm256_set1_epi32((int) 0xFF000000)));
+		_mm256_storeu_si256((__m256i*) out, rgba);
+	}
+	static inline void store(uint16_t *out, V R, V G, V B) {
+		V rg = _mm256_or_si256(clamp(R, UINT16_MAX),
+				_mm256_slli_epi32(clamp(G, UINT16_MAX), 16));
+		V ba = _mm256_or_si256(clamp(B, UINT16_MAX),
+				_mm256_set1_epi32((int) 0xFFFF0000));
+		// unpack works within 128 bit halves : pixels 0,1,4,5 and 2,3,6,7
+		V lo = _mm256_unpacklo_epi32(rg, ba);
+		V hi = _mm256_unpackhi_epi32(rg, ba);
+		_mm256_storeu_si256((__m256i*) out, _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*) (out + 16),
+				_mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+};
+#include "debayerCPUSimd.inl"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+inline void demosaicRowSIMD(DebayerCPU::ISA isa, const uint8_t *const *rows,
+		uint8_t *out, uint32_t begin, uint32_t end, bool redRow, int siteCol) {
+	if (isa == DebayerCPU::AVX2)
+		avx2::demosaicRow8(rows, out, begin, end, redRow, siteCol);
+	else
+		sse41::demosaicRow8(rows, out, begin, end, redRow, siteCol);
+}
+inline void demosaicRowSIMD(DebayerCPU::ISA isa, const uint16_t *const *rows,
+		uint16_t *out, uint32_t begin, uint32_t end, bool redRow, int siteCol) {
+	if (isa == DebayerCPU::AVX2)
+		avx2::demosaicRow16(rows, out, begin, end, redRow, siteCol);
+	else
+		sse41::demosaicRow16(rows, out, begin, end, redRow, siteCol);
+}
+
+#endif
+
+uint32_t simdLanes(DebayerCPU::ISA isa) {
+	switch (isa) {
+	case DebayerCPU::AVX2:
+		return 8;
+	case DebayerCPU::SSE41:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+}
+
+DebayerCPU::DebayerCPU(uint32_t width, uint32_t height, int pattern, ISA isa) :
+		width(width), height(height), pattern(pattern & 3), isa(isa) {
+	if (width < 3 || height < 3)
+		throw std::runtime_error("DebayerCPU : frame must be at least 3x3");
+	if (!supported(isa))
+		throw std::runtime_error(
+				std::string("DebayerCPU : ") + name(isa)
+						+ " is not supported on this host");
+}
+
+template<typename T> void DebayerCPU::run(const T *in, size_t pitch, T *out,
+		size_t pitchOut, uint32_t rowBegin, uint32_t rowEnd) const {
+	// RGGB = 0, GRBG = 1, GBRG = 2, BGGR = 3
+	const int redCol = pattern & 1;
+	const int redRowParity = pattern >> 1;
+	const uint32_t lanes = simdLanes(isa);
+	// vector columns need two valid columns on either side
+	uint32_t simdEnd = 2;
+	if (lanes && width >= 4 + lanes)
+		simdEnd = 2 + ((width - 4) / lanes) * lanes;
+	rowEnd = std::min(rowEnd, height);
+	for (uint32_t r = rowBegin; r < rowEnd; ++r) {
+		const T *rows[5];
+		for (int dy = -2; dy <= 2; ++dy)
+			rows[dy + 2] = (const T*) ((const uint8_t*) in
+					+ reflect((int) r + dy, (int) height) * pitch);
+		T *outRow = (T*) ((uint8_t*) out + r * pitchOut);
+		const bool redRow = (int) (r & 1) == redRowParity;
+		const int siteCol = redRow ? redCol : 1 - redCol;
+		uint32_t c = 0;
+#ifdef DEBAYER_CPU_X86
+		if (simdEnd > 2) {
+			for (; c < 2; ++c)
+				demosaicPixel(rows, outRow, (int) c, (int) width, redRow,
+						siteCol);
+			demosaicRowSIMD(isa, rows, outRow, 2, simdEnd, redRow, siteCol);
+			c = simdEnd;
+		}
+#endif
+		for (; c < width; ++c)
+			demosaicPixel(rows, outRow, (int) c, (int) width, redRow, siteCol);
+	}
+}
+
+template<typename T> void DebayerCPU::run(const T *in, size_t pitch, T *out,
+		size_t pitchOut, uint32_t numThreads) const {
+	numThreads = std::max<uint32_t>(std::min(numThreads, height), 1);
+	if (numThreads == 1) {
+		run(in, pitch, out, pitchOut, 0, height);
+		return;
+	}
+	std::vector<std::thread> threads;
+	uint32_t band = (height + numThreads - 1) / numThreads;
+	for (uint32_t begin = 0; begin < height; begin += band) {
+		uint32_t end = std::min(begin + band, height);
+		threads.push_back(std::thread([=] {
+			run(in, pitch, out, pitchOut, begin, end);
+		}));
+	}
+	for (auto &t : threads)
+		t.join();
+}
+
+template void DebayerCPU::run<uint8_t>(const uint8_t*, size_t, uint8_t*,
+		size_t, uint32_t, uint32_t) const;
+template void DebayerCPU::run<uint16_t>(const uint16_t*, size_t, uint16_t*,
+		size_t, uint32_t, uint32_t) const;
+template void DebayerCPU::run<uint8_t>(const uint8_t*, size_t, uint8_t*,
+		size_t, uint32_t) const;
+template void DebayerCPU::run<uint16_t>(const uint16_t*, size_t, uint16_t*,
+		size_t, uint32_t) const;
+
+DebayerCPU::ISA DebayerCPU::best() {
+	if (supported(AVX2))
+		return AVX2;
+	if (supported(SSE41))
+		return SSE41;
+	return Scalar;
+}
+
+bool DebayerCPU::supported(ISA isa) {
+	if (isa == Scalar)
+		return true;
+#if defined(DEBAYER_CPU_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	if (isa == SSE41)
+		return (info[2] & (1 << 19)) != 0;
+	// AVX2 also needs the OS to save ymm state
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(DEBAYER_CPU_X86)
+	__builtin_cpu_init();
+	if (isa == SSE41)
+		return __builtin_cpu_supports("sse4.1");
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+const char* DebayerCPU::name(ISA isa) {
+	switch (isa) {
+	case SSE41:
+		return "sse4.1";
+	case AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * DebayerCPU
+ *
+ * Host Malvar-He-Cutler demosaic, bit exact with malvar_he_cutler_demosaic
+ * in debayerBuffer.cl built with OUTPUT_CHANNELS=4 : same reflected borders,
+ * same integer filters with division truncating toward zero, and the same
+ * saturation. Output is RGBA, with alpha at the maximum sample value.
+ *
+ * Interior columns are computed with SSE4.1 (4 pixels) or AVX2 (8 pixels)
+ * when the host supports them; border columns, and every column on other
+ * architectures, use the scalar path. All paths produce identical output.
+ *
+ * Patterns are numbered as in the debayer kernels : RGGB = 0, GRBG = 1,
+ * GBRG = 2, BGGR = 3. Samples are uint8_t, or uint16_t in host byte order.
+ */
+class DebayerCPU {
+public:
+	enum ISA {
+		Scalar, SSE41, AVX2
+	};
+	// width and height must be at least 3
+	DebayerCPU(uint32_t width, uint32_t height, int pattern, ISA isa = best());
+
+	// demosaic rows [rowBegin, rowEnd); pitches are in bytes
+	template<typename T> void run(const T *in, size_t pitch, T *out,
+			size_t pitchOut, uint32_t rowBegin, uint32_t rowEnd) const;
+	// whole frame, split into row bands over numThreads threads
+	template<typename T> void run(const T *in, size_t pitch, T *out,
+			size_t pitchOut, uint32_t numThreads = 1) const;
+
+	ISA getISA() const {
+		return isa;
+	}
+	// widest instruction set supported by this host
+	static ISA best();
+	static bool supported(ISA isa);
+	static const char* name(ISA isa);
+private:
+	uint32_t width;
+	uint32_t height;
+	int pattern;
+	ISA isa;
+};
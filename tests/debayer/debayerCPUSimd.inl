@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Vector row of the Malvar-He-Cutler demosaic.
+ *
+ * Included by debayerCPU.cpp once per instruction set, inside a namespace
+ * that defines Vec (32 bit lanes) and with that instruction set's target
+ * options enabled, so no include guard.
+ *
+ * rows holds the five input rows r-2 .. r+2, already reflected. Columns
+ * [begin, end) are computed, with begin even, begin >= 2, end + 2 <= width
+ * and (end - begin) a multiple of Vec::lanes, so no column is reflected.
+ * siteCol is the parity of the red (in a red row) or blue (in a blue row)
+ * columns; the other columns of the row are green.
+ */
+template<typename T> void demosaicRow(const T *const *rows, T *out,
+		uint32_t begin, uint32_t end, bool redRow, int siteCol) {
+	typedef typename Vec::V V;
+	const V site = Vec::siteMask(siteCol);
+	for (uint32_t c = begin; c < end; c += Vec::lanes) {
+#define L(dy, dx) Vec::load(rows[2 + (dy)] + c + (dx))
+		const V F = L(0, 0);
+		const V cross = Vec::add(Vec::add(L(0, -1), L(0, 1)),
+				Vec::add(L(-1, 0), L(1, 0)));
+		const V horz = Vec::add(L(0, -1), L(0, 1));
+		const V vert = Vec::add(L(-1, 0), L(1, 0));
+		const V horz2 = Vec::add(L(0, -2), L(0, 2));
+		const V vert2 = Vec::add(L(-2, 0), L(2, 0));
+		const V diag = Vec::add(Vec::add(L(-1, -1), L(-1, 1)),
+				Vec::add(L(1, -1), L(1, 1)));
+#undef L
+		const V F10 = Vec::mul(F, 10);
+		// same filters as the kernel; lane arithmetic is exact in 32 bits
+		const V R1 = Vec::div8(
+				Vec::sub(Vec::add(Vec::mul(F, 4), Vec::mul(cross, 2)),
+						Vec::add(horz2, vert2)));
+		const V R2 = Vec::div16(
+				Vec::sub(Vec::add(Vec::add(Vec::mul(horz, 8), F10), vert2),
+						Vec::mul(Vec::add(diag, horz2), 2)));
+		const V R3 = Vec::div16(
+				Vec::sub(Vec::add(Vec::add(Vec::mul(vert, 8), F10), horz2),
+						Vec::mul(Vec::add(diag, vert2), 2)));
+		const V R4 = Vec::div16(
+				Vec::add(
+						Vec::sub(Vec::mul(F, 12),
+								Vec::mul(Vec::add(horz2, vert2), 3)),
+						Vec::mul(diag, 4)));
+		const V G = Vec::blend(F, R1, site);
+		if (redRow)
+			Vec::store(out + c * 4, Vec::blend(R2, F, site), G,
+					Vec::blend(R3, R4, site));
+		else
+			Vec::store(out + c * 4, Vec::blend(R3, R4, site), G,
+					Vec::blend(R2, F, site));
+	}
+}
+
+void demosaicRow8(const uint8_t *const *rows, uint8_t *out, uint32_t begin,
+		uint32_t end, bool redRow, int siteCol) {
+	demosaicRow(rows, out, begin, end, redRow, siteCol);
+}
+
+void demosaicRow16(const uint16_t *const *rows, uint16_t *out,
+		uint32_t begin, uint32_t end, bool redRow, int siteCol) {
+	demosaicRow(rows, out, begin, end, redRow, siteCol);
+}
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Standalone : debayer.cpp and tclap don't build as C++20, so this example
+ * has its own includes and argument parsing.
+ */
+#ifdef _WIN32
+#include "windirent.h"
+#else
+#include <dirent.h>
+#endif
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include "latke.h"
+#include "CoroutineOCL.h"
+#include "BlockingQueue.h"
+#include "ThreadPool.h"
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+using namespace ltk;
+
+// pipeline configuration, as in debayer.cpp
+const int numCLBuffers = 4;
+const int numPostProcBuffers = 16;
+const int tile_rows = 5;
+const int tile_columns = 32;
+const int platformId = 0;
+const eDeviceType deviceType = GPU;
+const int deviceNum = 0;
+// RGGB
+const int bayer_pattern_rggb = 0;
+
+inline char separator() {
+#ifdef _WIN32
+	return '\\';
+#else
+	return '/';
+#endif
+}
+
+/**
+ * Coroutine version of the debayer pipeline : one coroutine per frame,
+ * written as straight-line code. Frames take turns on numCLBuffers slots;
+ * a frame waits for the previous frame in its slot to finish, so up to
+ * numCLBuffers frames overlap on the device, as in debayer.cpp.
+ */
+
+#ifdef LTK_COROUTINES_FOUND
+
+struct Slot {
+	std::shared_ptr<DualBufferOCL> hostToDevice;
+	std::shared_ptr<DualBufferOCL> deviceToHost;
+	std::unique_ptr<KernelOCL> kernel;
+	QueueOCL *queue;
+};
+
+struct Pipeline {
+	CompletionDispatcherOCL *dispatcher;
+	std::string inputDir;
+	std::string outputDir;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameSize;
+	uint32_t frameSizeOut;
+	uint32_t bps_out;
+	ThreadPool *postProcPool;
+	// decode, copies and the wait for an output buffer : never on the
+	// dispatcher thread. Separate from postProcPool, whose encodes release
+	// the buffers waited for here
+	ThreadPool *hostPool;
+	BlockingQueue<uint8_t*> availableBuffers;
+	std::atomic<uint32_t> postCount;
+	uint32_t numImages;
+	std::mutex postMutex;
+	std::condition_variable postCondition;
+};
+
+TaskOCL processFrame(Pipeline &p, Slot &slot, FutureOCL slotFree,
+		std::string fileName) {
+	// previous frame in this slot has released its buffers
+	if (co_await slotFree < 0)
+		throw std::runtime_error("previous frame failed");
+
+	// upload
+	if (co_await slot.hostToDevice->mapAsync(p.dispatcher, 0, nullptr) < 0)
+		throw std::runtime_error("host to device map failed");
+	co_await resumeOn(*p.hostPool);
+	int width = 0, height = 0, channels = 0;
+	auto fname = p.inputDir + separator() + fileName;
+	auto image = stbi_load(fname.c_str(), &width, &height, &channels,	STBI_default);
+	if (!image)
+		throw std::runtime_error("failed to load " + fname);
+	memcpy(slot.hostToDevice->getHostBuffer(), image, p.frameSize);
+	stbi_image_free(image);
+	Event unmapped;
+	if (!slot.hostToDevice->unmap(0, nullptr, unmapped))
+		throw std::runtime_error("host to device unmap failed");
+
+	// debayer
+	EnqueueInfoOCL info(slot.queue);
+	info.pushWaitEvent(unmapped.get());
+	slot.kernel->configureLaunch(info, p.width, p.height);
+	auto debayered = slot.kernel->enqueueAsync(info);
+
+	// download
+	cl_event kernelCompleted = debayered.getEvent();
+	if (co_await slot.deviceToHost->mapAsync(p.dispatcher, 1, &kernelCompleted) < 0)
+		throw std::runtime_error("device to host map failed");
+	co_await resumeOn(*p.hostPool);
+	uint8_t *buf = nullptr;
+	p.availableBuffers.waitAndPop(buf);
+	memcpy(buf, slot.deviceToHost->getHostBuffer(), p.frameSizeOut);
+	co_await slot.deviceToHost->unmapAsync(p.dispatcher, 0, nullptr);
+
+	// write output on the post processing pool, off the dispatcher thread
+	p.postProcPool->enqueue([&p, buf, fileName] {
+		std::stringstream f;
+		f << p.outputDir << separator() << fileName << ".png";
+		stbi_write_png(f.str().c_str(), p.width, p.height, p.bps_out, buf,
+				p.width * p.bps_out);
+		p.availableBuffers.push(buf);
+		if (++p.postCount == p.numImages) {
+			std::lock_guard<std::mutex> lk(p.postMutex);
+			p.postCondition.notify_one();
+		}
+	});
+}
+
+int main(int argc, char *argv[]) {
+	Pipeline p;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--input-dir"))
+			p.inputDir = argv[i + 1];
+		else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output-dir"))
+			p.outputDir = argv[i + 1];
+	}
+	if (p.inputDir.empty()) {
+		std::cerr << "Usage : debayer_coro -i INPUT_DIR [-o OUTPUT_DIR]"
+				<< std::endl;
+		return -1;
+	}
+	if (p.outputDir.empty())
+		p.outputDir = p.inputDir;
+
+	std::vector<std::string> files;
+	auto dir = opendir(p.inputDir.c_str());
+	if (!dir) {
+		std::cerr << "Unable to open image directory " << p.inputDir;
+		return -1;
+	}
+	struct dirent *content = nullptr;
+	while ((content = readdir(dir)) != nullptr) {
+		if (strcmp(".", content->d_name) == 0
+				|| strcmp("..", content->d_name) == 0)
+			continue;
+		files.push_back(content->d_name);
+	}
+	closedir(dir);
+	if (files.empty())
+		return 0;
+
+	int width = 0, height = 0, channels = 0;
+	auto first = p.inputDir + separator() + files[0];
+	auto image = stbi_load(first.c_str(), &width, &height, &channels, STBI_default);
+	if (!image) {
+		std::cerr << "Failed to read image file " << files[0];
+		return -1;
+	}
+	stbi_image_free(image);
+	p.width = width;
+	p.height = height;
+	p.bps_out = 4;
+	p.frameSize = p.width * p.height;
+	p.frameSizeOut = p.frameSize * p.bps_out;
+	p.numImages = (uint32_t) files.size();
+	p.postCount = 0;
+
+	cl_command_queue_properties queue_props = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+	auto deviceManager = std::make_shared<DeviceManagerOCL>(true);
+	if (deviceManager->init(platformId, deviceType, deviceNum, true, queue_props)
+			!= DeviceSuccess) {
+		std::cerr << "Failed to initialize OpenCL device";
+		return -1;
+	}
+	auto dev = deviceManager->getDevice(deviceNum);
+	p.dispatcher = dev->getCompletionDispatcher();
+
+	std::stringstream buildOptions;
+	buildOptions << " -I ./ " << dev->arch->getBuildOptions();
+	buildOptions << " -D TILE_ROWS=" << tile_rows;
+	buildOptions << " -D TILE_COLS=" << tile_columns;
+	buildOptions << " -D OUTPUT_CHANNELS=" << p.bps_out;
+	KernelInitInfoBase initInfoBase(dev, buildOptions.str(), "",
+			BUILD_BINARY_IN_MEMORY);
+	KernelInitInfo initInfo(initInfoBase, "debayerBuffer.cl", "debayer",
+			"malvar_he_cutler_demosaic");
+	std::unique_ptr<KernelOCL> kernel;
+	Slot slots[numCLBuffers];
+	int bayer_pattern = bayer_pattern_rggb;
+	uint32_t pitchOut = p.width * p.bps_out;
+	try {
+		kernel = std::make_unique<KernelOCL>(initInfo);
+		for (auto &slot : slots) {
+			slot.hostToDevice = std::make_shared<DualBufferOCL>(dev, p.frameSize,
+					HostToDeviceBuffer, queue_props);
+			slot.deviceToHost = std::make_shared<DualBufferOCL>(dev,
+					p.frameSizeOut, DeviceToHostBuffer, queue_props);
+			slot.queue = dev->getQueuePool(queue_props)->lease(ComputeQueue);
+			slot.kernel = kernel->clone();
+			slot.kernel->setArg<cl_uint>(0, &p.height);
+			slot.kernel->setArg<cl_uint>(1, &p.width);
+			slot.kernel->setArg<cl_mem>(2, slot.hostToDevice->getDeviceMem());
+			slot.kernel->setArg<cl_uint>(3, &p.width);
+			slot.kernel->setArg<cl_mem>(4, slot.deviceToHost->getDeviceMem());
+			slot.kernel->setArg<cl_uint>(5, &pitchOut);
+			slot.kernel->setArg<cl_int>(6, &bayer_pattern);
+		}
+	} catch (std::exception &ex) {
+		std::cerr << "Unable to set up pipeline. Exiting" << std::endl;
+		return -1;
+	}
+
+	std::vector<uint8_t*> postProcBuffers;
+	for (int i = 0; i < numPostProcBuffers; ++i) {
+		postProcBuffers.push_back(new uint8_t[p.frameSizeOut]);
+		p.availableBuffers.push(postProcBuffers.back());
+	}
+	p.postProcPool = new ThreadPool(std::thread::hardware_concurrency());
+	p.hostPool = new ThreadPool(2 * numCLBuffers);
+
+	// launch one coroutine per frame
+	auto start = std::chrono::high_resolution_clock::now();
+	FutureOCL slotFree[numCLBuffers];
+	for (int i = 0; i < numCLBuffers; ++i)
+		slotFree[i] = FutureOCL::makeReady();
+	std::vector<FutureOCL> frames;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto s = i % numCLBuffers;
+		slotFree[s] = processFrame(p, slots[s], slotFree[s], files[i]).getFuture();
+		frames.push_back(slotFree[s]);
+	}
+	auto status = FutureOCL::whenAll(frames).wait();
+	if (status == CL_COMPLETE) {
+		std::unique_lock<std::mutex> lk(p.postMutex);
+		p.postCondition.wait(lk, [&p] {
+			return p.postCount == p.numImages;
+		});
+	}
+	auto finish = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed = finish - start;
+
+	delete p.hostPool;
+	delete p.postProcPool;
+	for (auto buf : postProcBuffers)
+		delete[] buf;
+	if (status != CL_COMPLETE) {
+		std::cerr << "Pipeline failed" << std::endl;
+		return -1;
+	}
+	fprintf(stdout, "opencl processing time per image = %f ms\n",
+			(elapsed.count() * 1000) / (double) p.numImages);
+
+	return 0;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+	(void) argc;
+	(void) argv;
+	std::cerr << "Compiler does not support C++20 coroutines" << std::endl;
+
+	return -1;
+}
+
+#endif
@@ -0,0 +1,457 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * debayer_validate
+ *
+ * Checks that the buffer debayer kernel and DebayerCPU produce bit identical
+ * RGBA output for all four Bayer patterns, on a synthetic scene and on a
+ * noise frame that drives every filter into saturation. The vector CPU path
+ * is checked against the scalar one as well. On the device, the two frames of
+ * each pattern run back to back through a TaskGraphOCL, and the dependencies
+ * the graph derives are checked too. Both paths are then timed :
+ *
+ *     debayer_validate -g 3840x2160 -f 20 -d 16
+ *
+ * With -c no OpenCL device is used, so the CPU reference alone is checked
+ * and timed; this is also the fallback on hosts without a device.
+ * Exit code is 1 if any output differs.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <climits>
+#include <cstring>
+#include <cstdio>
+#include "latke.h"
+#include "BayerGenerator.h"
+#include "debayerCPU.h"
+#define TCLAP_NAMESTARTSTRING "-"
+#include "tclap/CmdLine.h"
+using namespace TCLAP;
+
+using namespace ltk;
+
+// debayer kernel configuration, as in tests/debayer
+const int tile_rows = 5;
+const int tile_columns = 32;
+const uint32_t bps_out = 4;
+const char *patternNames[] = { "RGGB", "GRBG", "GBRG", "BGGR" };
+
+double elapsedMs(std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point finish) {
+	return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+// buffer kernel, one input and one output buffer
+class GpuDebayer {
+public:
+	GpuDebayer(DeviceOCL *dev, cl_command_queue_properties queue_props,
+			uint32_t width, uint32_t height, uint32_t bitDepth, int pattern,
+			std::string sourceDir) :
+			width(width), height(height), bytesPerSample(bitDepth / 8), pattern(
+					pattern), pool(dev->getQueuePool(queue_props)), info(
+					pool->lease(ComputeQueue)) {
+		std::string options = " -I ./ ";
+		switch (dev->deviceInfo->venderId) {
+		case vendorIdAMD:
+			options += " -D AMD_GPU_ARCH";
+			break;
+		case vendorIdNVD:
+			options += " -D NVIDIA_ARCH";
+			break;
+		default:
+			break;
+		}
+		std::stringstream buildOptions;
+		buildOptions << options;
+		buildOptions << " -D TILE_ROWS=" << tile_rows;
+		buildOptions << " -D TILE_COLS=" << tile_columns;
+		buildOptions << " -D OUTPUT_CHANNELS=" << bps_out;
+		if (bitDepth == 16)
+			buildOptions << " -D PIXELT=ushort -D ALPHA_VALUE=USHRT_MAX";
+		KernelInitInfoBase initInfoBase(dev, buildOptions.str(), sourceDir,
+				BUILD_BINARY_IN_MEMORY);
+		KernelInitInfo initInfo(initInfoBase, "debayerBuffer.cl", "debayer",
+				"malvar_he_cutler_demosaic");
+		initInfo.helperPrograms.push_back("helpers.cl");
+		initInfo.helperBuildOptions = options;
+		kernel = std::make_unique<KernelOCL>(initInfo);
+
+		pitch = width * bytesPerSample;
+		pitchOut = width * bps_out * bytesPerSample;
+		in = std::make_unique<DualBufferOCL>(dev, (size_t) pitch * height,
+				HostToDeviceBuffer, queue_props);
+		out = std::make_unique<DualBufferOCL>(dev, (size_t) pitchOut * height,
+				DeviceToHostBuffer, queue_props);
+		kernel->setArg<cl_uint>(0, &this->height);
+		kernel->setArg<cl_uint>(1, &this->width);
+		kernel->setArg<cl_mem>(2, in->getDeviceMem());
+		kernel->setArg<cl_uint>(3, &pitch);
+		kernel->setArg<cl_mem>(4, out->getDeviceMem());
+		kernel->setArg<cl_uint>(5, &pitchOut);
+		kernel->setArg<cl_int>(6, &this->pattern);
+		kernel->configureLaunch(info, width, height);
+		info.needsCompletionEvent = true;
+	}
+	// upload frame, or leave the previous upload in place if null
+	void upload(const void *frame) {
+		if (!frame)
+			return;
+		if (!in->map(0, nullptr, nullptr, true))
+			throw std::runtime_error("map failed");
+		memcpy(in->getHostBuffer(), frame, (size_t) pitch * height);
+		Event unmapped;
+		if (!in->unmap(0, nullptr, unmapped.out()) || !unmapped.wait())
+			throw std::runtime_error("unmap failed");
+	}
+	// returns device time in ms, or 0 without profiling
+	double launch() {
+		kernel->enqueue(info);
+		if (!info.completionEvent.wait())
+			throw std::runtime_error("kernel failed");
+		return WorkGroupTunerOCL::getElapsedMs(info.completionEvent.get());
+	}
+	void download(void *dest) {
+		if (!out->map(0, nullptr, nullptr, true))
+			throw std::runtime_error("map failed");
+		memcpy(dest, out->getHostBuffer(), (size_t) pitchOut * height);
+		Event unmapped;
+		if (!out->unmap(0, nullptr, unmapped.out()) || !unmapped.wait())
+			throw std::runtime_error("unmap failed");
+	}
+	// upload, debayer and download frames through one task graph. Frames share
+	// the input and output buffers, so besides each frame's upload -> kernel
+	// -> download chain, an upload waits for the previous kernel (write after
+	// read) and a kernel for the previous download; the write after write
+	// edges are implied by these and must be dropped
+	void run(const std::vector<const uint8_t*> &frames,
+			const std::vector<uint8_t*> &dest) {
+		TaskGraphOCL graph(pool);
+		cl_mem inMem = *in->getDeviceMem();
+		cl_mem outMem = *out->getDeviceMem();
+		size_t inBytes = (size_t) pitch * height;
+		size_t outBytes = (size_t) pitchOut * height;
+		std::vector<TaskGraphOCL::NodeId> uploads, kernels, downloads;
+		for (size_t i = 0; i < frames.size(); ++i) {
+			const uint8_t *src = frames[i];
+			uint8_t *dst = dest[i];
+			uploads.push_back(graph.addTask([inMem, inBytes, src](QueueOCL *queue,
+					cl_uint numWaitEvents, const cl_event *waitEvents,
+					cl_event *completionEvent) {
+				cl_int error_code = clEnqueueWriteBuffer(queue->getQueueImpl(),
+						inMem, CL_FALSE, 0, inBytes, src, numWaitEvents,
+						waitEvents, completionEvent);
+				if (CL_SUCCESS != error_code)
+					throw std::runtime_error("clEnqueueWriteBuffer failed");
+				queue->onEnqueue(inBytes);
+			}, {}, { inMem }, UploadQueue));
+			kernels.push_back(graph.addKernel(kernel.get(), info, { inMem },
+					{ outMem }));
+			downloads.push_back(graph.addTask([outMem, outBytes, dst](QueueOCL *queue,
+					cl_uint numWaitEvents, const cl_event *waitEvents,
+					cl_event *completionEvent) {
+				cl_int error_code = clEnqueueReadBuffer(queue->getQueueImpl(),
+						outMem, CL_FALSE, 0, outBytes, dst, numWaitEvents,
+						waitEvents, completionEvent);
+				if (CL_SUCCESS != error_code)
+					throw std::runtime_error("clEnqueueReadBuffer failed");
+				queue->onEnqueue(outBytes);
+			}, { outMem }, {}, DownloadQueue));
+		}
+		for (size_t i = 0; i < frames.size(); ++i) {
+			if (i == 0) {
+				checkDependencies(graph, uploads[i], { });
+				checkDependencies(graph, kernels[i], { uploads[i] });
+			} else {
+				checkDependencies(graph, uploads[i], { kernels[i - 1] });
+				checkDependencies(graph, kernels[i],
+						{ downloads[i - 1], uploads[i] });
+			}
+			checkDependencies(graph, downloads[i], { kernels[i] });
+		}
+		graph.submit();
+		if (!graph.wait()) {
+			// host frames must outlive any command still in flight
+			pool->finish();
+			throw std::runtime_error("task graph failed");
+		}
+	}
+private:
+	static void checkDependencies(const TaskGraphOCL &graph,
+			TaskGraphOCL::NodeId node,
+			const std::vector<TaskGraphOCL::NodeId> &expected) {
+		auto deps = graph.getDependencies(node);
+		std::sort(deps.begin(), deps.end());
+		if (deps != expected) {
+			std::stringstream ss;
+			ss << "task graph : task " << node << " has " << deps.size()
+					<< " dependencies, expected " << expected.size();
+			throw std::runtime_error(ss.str());
+		}
+	}
+	cl_uint width;
+	cl_uint height;
+	uint32_t bytesPerSample;
+	cl_int pattern;
+	QueuePoolOCL *pool;
+	cl_uint pitch;
+	cl_uint pitchOut;
+	EnqueueInfoOCL info;
+	std::unique_ptr<KernelOCL> kernel;
+	std::unique_ptr<DualBufferOCL> in;
+	std::unique_ptr<DualBufferOCL> out;
+};
+
+// report first difference between two RGBA frames
+bool compare(const char *what, const uint8_t *expected, const uint8_t *actual,
+		uint32_t width, uint32_t height, uint32_t bytesPerSample) {
+	size_t len = (size_t) width * height * bps_out * bytesPerSample;
+	if (memcmp(expected, actual, len) == 0)
+		return true;
+	for (size_t i = 0; i < len; i += bytesPerSample) {
+		if (memcmp(expected + i, actual + i, bytesPerSample) == 0)
+			continue;
+		size_t sample = i / bytesPerSample;
+		uint32_t e = bytesPerSample == 2 ? ((const uint16_t*) expected)[sample] : expected[i];
+		uint32_t a = bytesPerSample == 2 ? ((const uint16_t*) actual)[sample] : actual[i];
+		size_t pixel = sample / bps_out;
+		std::cout << "  " << what << " : first mismatch at (" << pixel % width
+				<< ", " << pixel / width << ") channel " << "RGBA"[sample % bps_out]
+				<< " : expected " << e << ", got " << a << std::endl;
+		break;
+	}
+	return false;
+}
+
+// every sample is 0, maximum or random
+void noiseFrame(std::vector<uint8_t> &frame, uint32_t bytesPerSample) {
+	std::mt19937 rng(0x1a7ce);
+	size_t samples = frame.size() / bytesPerSample;
+	uint32_t maxVal = bytesPerSample == 2 ? USHRT_MAX : UCHAR_MAX;
+	for (size_t i = 0; i < samples; ++i) {
+		uint32_t r = rng();
+		uint32_t v = (r & 3) == 0 ? 0 : ((r & 3) == 1 ? maxVal : (r >> 8) & maxVal);
+		if (bytesPerSample == 2)
+			((uint16_t*) frame.data())[i] = (uint16_t) v;
+		else
+			frame[i] = (uint8_t) v;
+	}
+}
+
+void runCPU(const DebayerCPU &cpu, const std::vector<uint8_t> &in,
+		std::vector<uint8_t> &out, uint32_t width, uint32_t bytesPerSample,
+		uint32_t numThreads) {
+	size_t pitch = (size_t) width * bytesPerSample;
+	if (bytesPerSample == 2)
+		cpu.run((const uint16_t*) in.data(), pitch, (uint16_t*) out.data(),
+				pitch * bps_out, numThreads);
+	else
+		cpu.run(in.data(), pitch, out.data(), pitch * bps_out, numThreads);
+}
+
+int main(int argc, char *argv[]) {
+	CmdLine cmd("debayer_validate command line", ' ', "v1.0");
+
+	ValueArg<std::string> deviceTypeArg("t", "device-type",
+			"Device type : gpu, cpu, accelerator or default", false, "gpu",
+			"string", cmd);
+
+	ValueArg<int> platformArg("P", "platform", "Platform index", false, 0, "int",
+			cmd);
+
+	ValueArg<std::string> geometryArg("g", "geometry", "Frame size as WIDTHxHEIGHT",
+			false, "1920x1080", "string", cmd);
+
+	ValueArg<uint32_t> framesArg("f", "frames", "Frames per speed run", false,
+			20, "uint", cmd);
+
+	ValueArg<uint32_t> bitDepthArg("d", "bit-depth", "Bit depth : 8 or 16",
+			false, 8, "uint", cmd);
+
+	SwitchArg cpuOnlyArg("c", "cpu-only",
+			"Check and time the CPU reference only, without OpenCL", cmd);
+
+	ValueArg<std::string> isaArg("I", "isa",
+			"CPU instruction set : scalar, sse4.1, avx2 or best", false, "best",
+			"string", cmd);
+
+	ValueArg<uint32_t> threadsArg("j", "threads",
+			"CPU threads, 0 for one per hardware thread", false, 0, "uint", cmd);
+
+	ValueArg<std::string> sourceDirArg("k", "kernel-dir", "Kernel source directory",
+			false, "", "string", cmd);
+
+	cmd.parse(argc, argv);
+
+	uint32_t width = 0, height = 0;
+	if (sscanf(geometryArg.getValue().c_str(), "%ux%u", &width, &height) != 2
+			|| width < 3 || height < 3) {
+		std::cerr << "Invalid frame size " << geometryArg.getValue() << std::endl;
+		return -1;
+	}
+	uint32_t bitDepth = bitDepthArg.getValue() == 16 ? 16 : 8;
+	uint32_t bytesPerSample = bitDepth / 8;
+	uint32_t frames = std::max<uint32_t>(framesArg.getValue(), 1);
+	uint32_t numThreads = threadsArg.getValue();
+	if (!numThreads)
+		numThreads = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+
+	DebayerCPU::ISA isa = DebayerCPU::best();
+	if (isaArg.getValue() != "best") {
+		bool found = false;
+		for (auto candidate : { DebayerCPU::Scalar, DebayerCPU::SSE41,
+				DebayerCPU::AVX2 }) {
+			if (isaArg.getValue() == DebayerCPU::name(candidate)) {
+				isa = candidate;
+				found = true;
+			}
+		}
+		if (!found || !DebayerCPU::supported(isa)) {
+			std::cerr << "Unsupported instruction set " << isaArg.getValue()
+					<< std::endl;
+			return -1;
+		}
+	}
+
+	std::shared_ptr<DeviceManagerOCL> deviceManager;
+	DeviceOCL *dev = nullptr;
+	// profiling gives kernel only time for the speed run
+	cl_command_queue_properties queue_props = CL_QUEUE_PROFILING_ENABLE;
+	if (!cpuOnlyArg.getValue()) {
+		eDeviceType deviceType = GPU;
+		auto type = deviceTypeArg.getValue();
+		if (type == "cpu")
+			deviceType = CPU;
+		else if (type == "accelerator")
+			deviceType = ACCELERATOR;
+		else if (type == "default")
+			deviceType = DEFAULT;
+		else if (type != "gpu")
+			std::cout << "Unrecognized device type " << type << ". Using gpu."
+					<< std::endl;
+		deviceManager = std::make_shared<DeviceManagerOCL>(true);
+		if (deviceManager->init(platformArg.getValue(), deviceType, 0, false,
+				queue_props) != DeviceSuccess) {
+			std::cerr << "Failed to initialize OpenCL device; use -c to run "
+					"the CPU reference only" << std::endl;
+			return -1;
+		}
+		dev = deviceManager->getDevice(0);
+		std::cout << "Device : "
+				<< (dev->deviceInfo->name ? dev->deviceInfo->name : "unknown")
+				<< std::endl;
+	}
+	auto sourceDir = sourceDirArg.getValue();
+	if (!sourceDir.empty() && sourceDir.back() != '/' && sourceDir.back() != '\\')
+		sourceDir += '/';
+	std::cout << "Frame : " << width << "x" << height << ", " << bitDepth
+			<< " bit, CPU " << DebayerCPU::name(isa) << " x " << numThreads
+			<< " threads" << std::endl;
+
+	size_t frameBytes = (size_t) width * height * bytesPerSample;
+	size_t frameBytesOut = frameBytes * bps_out;
+	// scene and noise frames
+	std::vector<uint8_t> input(frameBytes), noiseInput(frameBytes);
+	std::vector<uint8_t> scalarOut(frameBytesOut), cpuOut(frameBytesOut),
+			gpuOut(frameBytesOut), gpuNoiseOut(frameBytesOut);
+	bool identical = true;
+	try {
+		for (int pattern = 0; pattern < 4; ++pattern) {
+			BayerGenerator generator(width, height, pattern, bitDepth);
+			DebayerCPU scalar(width, height, pattern, DebayerCPU::Scalar);
+			DebayerCPU cpu(width, height, pattern, isa);
+			std::unique_ptr<GpuDebayer> gpu;
+			if (dev)
+				gpu = std::make_unique<GpuDebayer>(dev, queue_props, width,
+						height, bitDepth, pattern, sourceDir);
+			generator.generate(0, input.data());
+			noiseFrame(noiseInput, bytesPerSample);
+			if (gpu)
+				gpu->run({ input.data(), noiseInput.data() },
+						{ gpuOut.data(), gpuNoiseOut.data() });
+			for (int noise = 0; noise < 2; ++noise) {
+				auto &frame = noise ? noiseInput : input;
+				bool match = true;
+				runCPU(scalar, frame, scalarOut, width, bytesPerSample, 1);
+				runCPU(cpu, frame, cpuOut, width, bytesPerSample, numThreads);
+				match &= compare(DebayerCPU::name(isa), scalarOut.data(),
+						cpuOut.data(), width, height, bytesPerSample);
+				if (gpu)
+					match &= compare("gpu", scalarOut.data(),
+							(noise ? gpuNoiseOut : gpuOut).data(), width,
+							height, bytesPerSample);
+				std::cout << patternNames[pattern]
+						<< (noise ? " noise" : " scene") << " : "
+						<< (match ? "identical" : "MISMATCH") << std::endl;
+				identical &= match;
+			}
+		}
+
+		// speed : same frame every iteration, generation excluded
+		BayerGenerator generator(width, height, 0, bitDepth);
+		generator.generate(0, input.data());
+		DebayerCPU cpu(width, height, 0, isa);
+		runCPU(cpu, input, cpuOut, width, bytesPerSample, numThreads);
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < frames; ++i)
+			runCPU(cpu, input, cpuOut, width, bytesPerSample, numThreads);
+		double cpuMs = elapsedMs(start, std::chrono::steady_clock::now())
+				/ frames;
+		double megaPixels = (double) width * height / 1e6;
+		std::cout << "CPU " << DebayerCPU::name(isa) << " : " << cpuMs
+				<< " ms/frame, " << megaPixels * 1000.0 / cpuMs << " MP/s"
+				<< std::endl;
+		if (dev) {
+			GpuDebayer gpu(dev, queue_props, width, height, bitDepth, 0,
+					sourceDir);
+			gpu.upload(input.data());
+			gpu.launch();
+			double kernelMs = 0;
+			start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < frames; ++i) {
+				gpu.upload(input.data());
+				kernelMs += gpu.launch();
+				gpu.download(gpuOut.data());
+			}
+			double gpuMs = elapsedMs(start, std::chrono::steady_clock::now())
+					/ frames;
+			kernelMs /= frames;
+			std::cout << "GPU kernel : " << kernelMs << " ms/frame, "
+					<< (kernelMs > 0 ? megaPixels * 1000.0 / kernelMs : 0)
+					<< " MP/s" << std::endl;
+			std::cout << "GPU with transfers : " << gpuMs << " ms/frame, "
+					<< megaPixels * 1000.0 / gpuMs << " MP/s" << std::endl;
+		}
+	} catch (std::exception &ex) {
+		std::cerr << "Validation failed : " << ex.what() << std::endl;
+		return -1;
+	}
+	if (!identical) {
+		std::cerr << "Outputs differ" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Helper library translation unit : compiled once per device and linked
+ * against every program built with LTK_LINKED_HELPERS (see KernelInitInfo::helperPrograms).
+ * Macros, static inline functions and the INLINE per-pixel helpers of
+ * common.cl / image.cl remain in each kernel translation unit.
+ */
+
+#define LTK_HELPER_LIBRARY
+#include "platform.cl"
+#include "common.cl"
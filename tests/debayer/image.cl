@@ -51,6 +51,8 @@ enum {
 	ADDRESS_NOOP = 4 //programmer guarantees no reflection necessary
 };
 
+// per-pixel helpers : always INLINE in the kernel translation unit (see common.cl)
+#ifndef LTK_HELPER_LIBRARY
 //coordinate is c, r for compatibility with climage and CUDA
 INLINE uint2 tex2D(const int rows, const int cols, const int _c, const int _r,
 		const uint sample_method) {
@@ -102,5 +104,6 @@ INLINE __global uchar* image_tex2D_(__global uchar *im_p, const uint im_rows, co
 #define image_tex2D(PixelT, im_p, im_rows, im_cols, image_pitch, r, c, sample_method) \
   (((sample_method) == ADDRESS_ZERO) & (((r) < 0) | ((r) >= (im_rows)) | ((c) < 0) | ((c) >= (im_cols))) ? 0 : \
   *(__global PixelT *) image_tex2D_((__global uchar *)(im_p), (im_rows), (im_cols), (image_pitch), (r), (c), sizeof(PixelT), (sample_method)))
+#endif
 
 #endif
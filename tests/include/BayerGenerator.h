@@ -0,0 +1,111 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * BayerGenerator
+ *
+ * Deterministic synthetic Bayer mosaics, for throughput runs that shouldn't
+ * pay for disk reads and PNG decoding. Each frame samples an RGB scene
+ * (gradients, moving stripes and hashed noise) through the colour filter
+ * array of the pattern, so every pattern exercises every interpolation
+ * case of the demosaic. A given (size, pattern, depth, seed, frame index)
+ * always produces the same frame.
+ *
+ * Patterns are numbered as in the debayer kernels : RGGB = 0, GRBG = 1,
+ * GBRG = 2, BGGR = 3. 16 bit samples are stored in host byte order.
+ */
+class BayerGenerator {
+public:
+	BayerGenerator(uint32_t width, uint32_t height, int pattern,
+			uint32_t bitDepth, uint32_t seed = 0) :
+			width(width), height(height), pattern(pattern & 3), bitDepth(
+					bitDepth == 16 ? 16 : 8), seed(seed) {
+	}
+	uint32_t getBytesPerSample() const {
+		return bitDepth / 8;
+	}
+	size_t getFrameBytes() const {
+		return (size_t) width * height * getBytesPerSample();
+	}
+	// write frame into dest, with rows pitch bytes apart
+	void generate(uint32_t frameIndex, void *dest, size_t pitch = 0) const {
+		if (!pitch)
+			pitch = (size_t) width * getBytesPerSample();
+		for (uint32_t y = 0; y < height; ++y) {
+			auto row = (uint8_t*) dest + y * pitch;
+			for (uint32_t x = 0; x < width; ++x) {
+				uint32_t v = sample(channelAt(x, y), x, y, frameIndex);
+				if (bitDepth == 16)
+					((uint16_t*) row)[x] = (uint16_t) v;
+				else
+					row[x] = (uint8_t) (v >> 8);
+			}
+		}
+	}
+	// 0 = red, 1 = green, 2 = blue
+	int channelAt(uint32_t x, uint32_t y) const {
+		// colours of the 2x2 cell, row major, for each pattern
+		static const int cells[4][4] = { { 0, 1, 1, 2 }, { 1, 0, 2, 1 }, {
+				1, 2, 0, 1 }, { 2, 1, 1, 0 } };
+		return cells[pattern][(y & 1) * 2 + (x & 1)];
+	}
+	// 16 bit scene value of channel at (x, y)
+	uint32_t sample(int channel, uint32_t x, uint32_t y,
+			uint32_t frameIndex) const {
+		uint32_t v = 0;
+		switch (channel) {
+		case 0:
+			// horizontal gradient, scrolling with frame index
+			v = (uint32_t) (((uint64_t) x * 65535) / std::max<uint32_t>(width - 1, 1)
+					+ frameIndex * 2048) & 0xFFFF;
+			break;
+		case 1:
+			v = (uint32_t) (((uint64_t) y * 65535)
+					/ std::max<uint32_t>(height - 1, 1));
+			break;
+		default:
+			// diagonal stripes, for sharp edges
+			v = ((x + y + frameIndex * 4) / 16) & 1 ? 57344 : 8192;
+			break;
+		}
+		int32_t noisy = (int32_t) v + (int32_t) (hash(x, y, frameIndex) & 0x1FF)
+				- 256;
+		return (uint32_t) std::min(std::max(noisy, 0), 65535);
+	}
+private:
+	uint32_t hash(uint32_t x, uint32_t y, uint32_t frameIndex) const {
+		uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ frameIndex * 0xC2B2AE3Du
+				^ seed;
+		h ^= h >> 15;
+		h *= 0x2C1B3C6Du;
+		h ^= h >> 12;
+		return h;
+	}
+	uint32_t width;
+	uint32_t height;
+	int pattern;
+	uint32_t bitDepth;
+	uint32_t seed;
+};
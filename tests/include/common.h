@@ -59,27 +59,22 @@ using namespace ltk;
 template<typename M> struct JobInfo {
 	JobInfo(DeviceOCL *dev, std::shared_ptr<M> hostToDev,
 			std::shared_ptr<M> devToHost, JobInfo *previous) :
-			hostToDevice(new MemMapEvents<M>(dev, hostToDev)), kernelCompleted(
-					0), deviceToHost(new MemMapEvents<M>(dev, devToHost)), prev(
-					previous) {
+			hostToDevice(new MemMapEvents<M>(dev, hostToDev)), deviceToHost(
+					new MemMapEvents<M>(dev, devToHost)), prev(previous) {
 	}
 	~JobInfo() {
 		delete hostToDevice;
-		Util::ReleaseEvent(kernelCompleted);
 		delete deviceToHost;
 	}
 
 	MemMapEvents<M> *hostToDevice;
-	cl_event kernelCompleted;
+	Event kernelCompleted;
 	MemMapEvents<M> *deviceToHost;
 	std::string fileName;
 
 	JobInfo *prev;
 };
 
-typedef void (CL_CALLBACK *pfn_event_notify)(cl_event event,
-		cl_int event_command_exec_status, void *user_data);
-
 class BufferAllocater {
 public:
 	BufferAllocater(DeviceOCL *dev, size_t dimX, size_t dimY, size_t bps,
@@ -88,12 +83,13 @@ public:
 			m_dimX(dimX),
 			m_dimY(dimY),
 			m_bps(bps),
+			m_bytesPerSample(data_type == CL_UNSIGNED_INT16 ? 2 : 1),
 			m_queue_props(queue_props)
   {
-		(void) data_type;
 	}
 	std::unique_ptr<DualBufferOCL> allocate(bool hostToDevice) {
-		return std::make_unique<DualBufferOCL>(m_dev, m_dimX * m_dimY * m_bps,
+		return std::make_unique<DualBufferOCL>(m_dev,
+				m_dimX * m_dimY * m_bps * m_bytesPerSample,
 				hostToDevice ? HostToDeviceBuffer : DeviceToHostBuffer, m_queue_props);
 	}
 private:
@@ -101,6 +97,7 @@ private:
 	size_t m_dimX;
 	size_t m_dimY;
 	size_t m_bps;
+	size_t m_bytesPerSample;
 	cl_command_queue_properties m_queue_props;
 };
 
@@ -0,0 +1,7 @@
+/*
+ * Kernels used by latke_bench
+ */
+
+// measures launch overhead : does no work
+__kernel void empty_kernel(void) {
+}
@@ -0,0 +1,724 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * latke_bench
+ *
+ * Microbenchmarks for the pieces of a latke pipeline, measured separately :
+ * map/unmap latency, host <-> device bandwidth, kernel only debayer
+ * throughput for the buffer and image paths, launch overhead and event
+ * callback latency. The stages of the debayer pipeline (upload, compute,
+ * download and PNG encode) are timed as metrics of their own. Frame sized
+ * cases run at 1080p, 4K and 8K.
+ *
+ * Results are written as JSON, with p50/p99 per metric. Any OpenCL device
+ * works, including CPU devices such as POCL :
+ *
+ *     latke_bench -t cpu -o bench.json
+ *
+ * With a baseline, p50 and p99 of every metric are compared against the
+ * baseline run, and the exit code is 2 if any metric regressed by more
+ * than its tolerance. p99 is only compared when both runs have at least
+ * -q samples of the metric, since p99 of a few samples is their maximum :
+ *
+ *     latke_bench -t cpu -o bench.json -B baseline.json -x 10
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include "latke.h"
+#include "BayerGenerator.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#define TCLAP_NAMESTARTSTRING "-"
+#include "tclap/CmdLine.h"
+using namespace TCLAP;
+
+using namespace ltk;
+
+// debayer kernel configuration, as in tests/debayer
+const int tile_rows = 5;
+const int tile_columns = 32;
+const uint32_t bps_out = 4;
+// RGGB
+const int bayer_pattern = 0;
+
+struct FrameSize {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+const FrameSize frameSizes[] = { { "1080p", 1920, 1080 },
+		{ "4K", 3840, 2160 }, { "8K", 7680, 4320 } };
+
+struct Metric {
+	Metric(std::string name, std::string size, std::string unit,
+			bool higherIsBetter) :
+			name(name), size(size), unit(unit), higherIsBetter(higherIsBetter) {
+	}
+	std::string name;
+	// frame size, or "none" for size independent metrics
+	std::string size;
+	std::string unit;
+	bool higherIsBetter;
+	std::vector<double> samples;
+};
+
+static double percentile(std::vector<double> samples, double p) {
+	if (samples.empty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	auto index = (size_t) (p / 100.0 * (double) (samples.size() - 1) + 0.5);
+	return samples[std::min(index, samples.size() - 1)];
+}
+
+static double mean(const std::vector<double> &samples) {
+	double sum = 0;
+	for (auto s : samples)
+		sum += s;
+	return samples.empty() ? 0 : sum / (double) samples.size();
+}
+
+static std::string escapeJson(const std::string &str) {
+	std::string rc;
+	for (auto c : str) {
+		if (c == '"' || c == '\\')
+			rc += '\\';
+		if ((unsigned char) c >= 0x20)
+			rc += c;
+	}
+	return rc;
+}
+
+static void writeJson(std::ostream &out, DeviceOCL *dev, uint32_t iterations,
+		const std::vector<Metric> &metrics) {
+	out << "{\n  \"device\": \"" << escapeJson(dev->deviceInfo->name)
+			<< "\",\n  \"driver\": \""
+			<< escapeJson(dev->deviceInfo->driverVersion)
+			<< "\",\n  \"iterations\": " << iterations
+			<< ",\n  \"metrics\": [\n";
+	out.precision(6);
+	for (size_t i = 0; i < metrics.size(); ++i) {
+		auto &m = metrics[i];
+		auto &s = m.samples;
+		out << "    { \"name\": \"" << m.name << "\", \"size\": \"" << m.size
+				<< "\", \"unit\": \"" << m.unit << "\", \"better\": \""
+				<< (m.higherIsBetter ? "higher" : "lower")
+				<< "\", \"samples\": " << s.size() << ", \"mean\": " << mean(s)
+				<< ", \"min\": "
+				<< (s.empty() ? 0 : *std::min_element(s.begin(), s.end()))
+				<< ", \"max\": "
+				<< (s.empty() ? 0 : *std::max_element(s.begin(), s.end()))
+				<< ", \"p50\": " << percentile(s, 50) << ", \"p99\": "
+				<< percentile(s, 99) << " }"
+				<< (i + 1 < metrics.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+// metric of a stored run
+struct BaselineMetric {
+	BaselineMetric() :
+			higherIsBetter(false), samples(0), p50(0), p99(0) {
+	}
+	bool higherIsBetter;
+	size_t samples;
+	double p50;
+	double p99;
+};
+
+static std::string metricKey(const std::string &name, const std::string &size) {
+	return name + "@" + size;
+}
+
+// read the metrics of a file written by writeJson : a flat object per metric
+static bool readBaseline(const std::string &fileName,
+		std::map<std::string, BaselineMetric> &baseline) {
+	std::ifstream in(fileName);
+	if (!in)
+		return false;
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	auto json = buffer.str();
+	auto pos = json.find("\"metrics\"");
+	if (pos == std::string::npos)
+		return false;
+	while ((pos = json.find('{', pos)) != std::string::npos) {
+		auto end = json.find('}', pos);
+		if (end == std::string::npos)
+			return false;
+		std::map<std::string, std::string> fields;
+		size_t i = pos + 1;
+		auto readString = [&json, &i, end]() {
+			std::string str;
+			for (++i; i < end && json[i] != '"'; ++i) {
+				if (json[i] == '\\' && i + 1 < end)
+					++i;
+				str += json[i];
+			}
+			++i;
+			return str;
+		};
+		while (i < end) {
+			i = json.find('"', i);
+			if (i == std::string::npos || i >= end)
+				break;
+			auto key = readString();
+			i = json.find(':', i);
+			if (i == std::string::npos || i >= end)
+				return false;
+			++i;
+			while (i < end && isspace((unsigned char) json[i]))
+				++i;
+			if (i < end && json[i] == '"') {
+				fields[key] = readString();
+			} else {
+				auto valueEnd = json.find_first_of(",}", i);
+				fields[key] = json.substr(i, valueEnd - i);
+				i = valueEnd;
+			}
+		}
+		BaselineMetric metric;
+		metric.higherIsBetter = fields["better"] == "higher";
+		metric.samples = (size_t) atol(fields["samples"].c_str());
+		metric.p50 = atof(fields["p50"].c_str());
+		metric.p99 = atof(fields["p99"].c_str());
+		baseline[metricKey(fields["name"], fields["size"])] = metric;
+		pos = end + 1;
+	}
+
+	return true;
+}
+
+// relative change, positive when worse
+static double regression(double current, double base, bool higherIsBetter) {
+	if (base == 0)
+		return 0;
+	double change = (current - base) / std::fabs(base);
+	return higherIsBetter ? -change : change;
+}
+
+// compare metrics with baseline; returns number of regressions.
+// p99 is skipped unless both runs have minP99Samples samples
+static size_t compareBaseline(const std::vector<Metric> &metrics,
+		const std::map<std::string, BaselineMetric> &baseline,
+		double p50Tolerance, double p99Tolerance, size_t minP99Samples,
+		const std::map<std::string, double> &metricTolerances) {
+	size_t regressions = 0;
+	for (auto &m : metrics) {
+		auto key = metricKey(m.name, m.size);
+		auto base = baseline.find(key);
+		if (base == baseline.end()) {
+			std::cout << key << " : not in baseline" << std::endl;
+			continue;
+		}
+		double tolerances[2] = { p50Tolerance, p99Tolerance };
+		// name@size is more specific than name
+		auto override = metricTolerances.find(key);
+		if (override == metricTolerances.end())
+			override = metricTolerances.find(m.name);
+		if (override != metricTolerances.end())
+			tolerances[0] = tolerances[1] = override->second;
+		const char *names[2] = { "p50", "p99" };
+		double current[2] = { percentile(m.samples, 50), percentile(m.samples,
+				99) };
+		double previous[2] = { base->second.p50, base->second.p99 };
+		for (int i = 0; i < 2; ++i) {
+			if (i == 1 && (m.samples.size() < minP99Samples
+					|| base->second.samples < minP99Samples)) {
+				std::cout << "skipped    " << key << " p99 : "
+						<< std::min(m.samples.size(), base->second.samples)
+						<< " samples, " << minP99Samples << " needed"
+						<< std::endl;
+				continue;
+			}
+			double change = regression(current[i], previous[i], m.higherIsBetter);
+			bool regressed = change * 100.0 > tolerances[i];
+			if (regressed)
+				regressions++;
+			std::cout << (regressed ? "REGRESSION " : "ok         ") << key
+					<< " " << names[i] << " : " << current[i] << " " << m.unit
+					<< " vs " << previous[i] << " (" << (change > 0 ? "+" : "")
+					<< change * 100.0 << "% worse, tolerance " << tolerances[i]
+					<< "%)" << std::endl;
+		}
+	}
+
+	return regressions;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start,
+		std::chrono::steady_clock::time_point finish) {
+	return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+static void appendPng(void *context, void *data, int size) {
+	auto png = (std::vector<uint8_t>*) context;
+	png->insert(png->end(), (uint8_t*) data, (uint8_t*) data + size);
+}
+
+class Bench {
+public:
+	Bench(DeviceOCL *dev, cl_command_queue_properties queue_props,
+			uint32_t iterations, std::string sourceDir) :
+			dev(dev), queue_props(queue_props), iterations(iterations), sourceDir(
+					sourceDir) {
+	}
+
+	void mapUnmap(const FrameSize &size) {
+		Metric map("map_latency", size.name, "ms", false);
+		Metric unmap("unmap_latency", size.name, "ms", false);
+		DualBufferOCL buffer(dev, (size_t) size.width * size.height,
+				HostToDeviceBuffer, queue_props);
+		for (uint32_t i = 0; i < iterations + 1; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			if (!buffer.map(0, nullptr, nullptr, true))
+				throw std::runtime_error("map failed");
+			auto mapped = std::chrono::steady_clock::now();
+			buffer.getHostBuffer()[0] = (unsigned char) i;
+			Event unmapped;
+			if (!buffer.unmap(0, nullptr, unmapped.out()) || !unmapped.wait())
+				throw std::runtime_error("unmap failed");
+			auto finish = std::chrono::steady_clock::now();
+			// first iteration is a warm-up
+			if (i == 0)
+				continue;
+			map.samples.push_back(elapsedMs(start, mapped));
+			unmap.samples.push_back(elapsedMs(mapped, finish));
+		}
+		metrics.push_back(map);
+		metrics.push_back(unmap);
+	}
+
+	void bandwidth(const FrameSize &size) {
+		// upload a Bayer frame, download an RGBA frame
+		size_t uploadBytes = (size_t) size.width * size.height;
+		size_t downloadBytes = uploadBytes * bps_out;
+		Metric upload("upload_bandwidth", size.name, "GB/s", true);
+		Metric download("download_bandwidth", size.name, "GB/s", true);
+		cl_int error_code = CL_SUCCESS;
+		auto mem = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, downloadBytes,
+				nullptr, &error_code);
+		if (CL_SUCCESS != error_code) {
+			Util::LogError("Error: clCreateBuffer returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+			throw std::runtime_error("clCreateBuffer failed");
+		}
+		std::vector<uint8_t> host(downloadBytes, 1);
+		auto queue = dev->getQueuePool(queue_props)->lease(UploadQueue)->getQueueImpl();
+		for (uint32_t i = 0; i < iterations + 1 && CL_SUCCESS == error_code; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			error_code = clEnqueueWriteBuffer(queue, mem, CL_TRUE, 0, uploadBytes,
+					host.data(), 0, nullptr, nullptr);
+			auto written = std::chrono::steady_clock::now();
+			if (CL_SUCCESS == error_code)
+				error_code = clEnqueueReadBuffer(queue, mem, CL_TRUE, 0,
+						downloadBytes, host.data(), 0, nullptr, nullptr);
+			auto finish = std::chrono::steady_clock::now();
+			if (i == 0)
+				continue;
+			upload.samples.push_back(
+					(double) uploadBytes / (elapsedMs(start, written) * 1e6));
+			download.samples.push_back(
+					(double) downloadBytes / (elapsedMs(written, finish) * 1e6));
+		}
+		Util::ReleaseMemory(mem);
+		if (CL_SUCCESS != error_code) {
+			Util::LogError("Error: transfer returned %s.\n",
+					Util::TranslateOpenCLError(error_code));
+			throw std::runtime_error("transfer failed");
+		}
+		metrics.push_back(upload);
+		metrics.push_back(download);
+	}
+
+	template<typename M> void debayer(const FrameSize &size, std::string path,
+			std::unique_ptr<M> in, std::unique_ptr<M> out) {
+		uint32_t width = size.width, height = size.height;
+		EnqueueInfoOCL info(dev->getQueuePool(queue_props)->lease(ComputeQueue));
+		auto kernel = debayerKernel(size, path, in->getDeviceMem(),
+				out->getDeviceMem(), info);
+		Metric ms("kernel_" + path + "_time", size.name, "ms", false);
+		Metric throughput("kernel_" + path + "_throughput", size.name,
+				"Mpixel/s", true);
+		for (uint32_t i = 0; i < iterations + 1; ++i) {
+			kernel->enqueue(info);
+			if (!info.completionEvent.wait())
+				throw std::runtime_error("kernel failed");
+			if (i == 0)
+				continue;
+			double elapsed = WorkGroupTunerOCL::getElapsedMs(
+					info.completionEvent.get());
+			ms.samples.push_back(elapsed);
+			if (elapsed > 0)
+				throughput.samples.push_back(
+						(double) width * height / (elapsed * 1000.0));
+		}
+		metrics.push_back(ms);
+		metrics.push_back(throughput);
+	}
+
+	// stages of the debayer buffer pipeline, timed on the host for one frame
+	// at a time : upload (map, copy, unmap), compute, download (map, copy,
+	// unmap) and PNG encode. The encode goes to memory, so disk speed is
+	// left out
+	void pipeline(const FrameSize &size) {
+		size_t frameBytes = (size_t) size.width * size.height;
+		size_t frameBytesOut = frameBytes * bps_out;
+		DualBufferOCL in(dev, frameBytes, HostToDeviceBuffer, queue_props);
+		DualBufferOCL out(dev, frameBytesOut, DeviceToHostBuffer, queue_props);
+		EnqueueInfoOCL info(dev->getQueuePool(queue_props)->lease(ComputeQueue));
+		auto kernel = debayerKernel(size, "Buffer", in.getDeviceMem(),
+				out.getDeviceMem(), info);
+		std::vector<uint8_t> bayer(frameBytes), rgba(frameBytesOut), png;
+		BayerGenerator generator(size.width, size.height, bayer_pattern, 8);
+		generator.generate(0, bayer.data());
+		const char *stageNames[] = { "upload", "compute", "download", "encode" };
+		std::vector<Metric> stages;
+		for (auto name : stageNames)
+			stages.emplace_back(std::string("pipeline_") + name, size.name,
+					"ms", false);
+		Metric frame("pipeline_frame", size.name, "ms", false);
+		for (uint32_t i = 0; i < iterations + 1; ++i) {
+			std::chrono::steady_clock::time_point t[5];
+			t[0] = std::chrono::steady_clock::now();
+			if (!in.map(0, nullptr, nullptr, true))
+				throw std::runtime_error("map failed");
+			memcpy(in.getHostBuffer(), bayer.data(), frameBytes);
+			Event uploaded;
+			if (!in.unmap(0, nullptr, uploaded.out()) || !uploaded.wait())
+				throw std::runtime_error("unmap failed");
+			t[1] = std::chrono::steady_clock::now();
+			kernel->enqueue(info);
+			if (!info.completionEvent.wait())
+				throw std::runtime_error("kernel failed");
+			t[2] = std::chrono::steady_clock::now();
+			if (!out.map(0, nullptr, nullptr, true))
+				throw std::runtime_error("map failed");
+			memcpy(rgba.data(), out.getHostBuffer(), frameBytesOut);
+			Event downloaded;
+			if (!out.unmap(0, nullptr, downloaded.out()) || !downloaded.wait())
+				throw std::runtime_error("unmap failed");
+			t[3] = std::chrono::steady_clock::now();
+			png.clear();
+			if (!stbi_write_png_to_func(appendPng, &png, (int) size.width,
+					(int) size.height, bps_out, rgba.data(),
+					(int) (size.width * bps_out)))
+				throw std::runtime_error("encode failed");
+			t[4] = std::chrono::steady_clock::now();
+			if (i == 0)
+				continue;
+			for (size_t j = 0; j < stages.size(); ++j)
+				stages[j].samples.push_back(elapsedMs(t[j], t[j + 1]));
+			frame.samples.push_back(elapsedMs(t[0], t[4]));
+		}
+		metrics.insert(metrics.end(), stages.begin(), stages.end());
+		metrics.push_back(frame);
+	}
+
+	void launchOverhead() {
+		KernelInitInfoBase initInfoBase(dev, " -I ./ ", sourceDir,
+				BUILD_BINARY_IN_MEMORY);
+		KernelInitInfo initInfo(initInfoBase, "bench.cl", "bench",
+				"empty_kernel");
+		KernelOCL kernel(initInfo);
+		EnqueueInfoOCL info(dev->getQueuePool(queue_props)->lease(ComputeQueue));
+		info.dimension = 1;
+		info.global_work_size[0] = 1;
+		info.local_work_size[0] = 1;
+		info.needsCompletionEvent = true;
+		Metric enqueue("launch_enqueue", "none", "us", false);
+		Metric roundTrip("launch_round_trip", "none", "us", false);
+		for (uint32_t i = 0; i < iterations * 10 + 1; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			kernel.enqueue(info);
+			auto enqueued = std::chrono::steady_clock::now();
+			if (!info.completionEvent.wait())
+				throw std::runtime_error("kernel failed");
+			auto finish = std::chrono::steady_clock::now();
+			if (i == 0)
+				continue;
+			enqueue.samples.push_back(elapsedMs(start, enqueued) * 1000.0);
+			roundTrip.samples.push_back(elapsedMs(start, finish) * 1000.0);
+		}
+		metrics.push_back(enqueue);
+		metrics.push_back(roundTrip);
+	}
+
+	// time from event completion to continuation on the completion dispatcher
+	void callbackLatency() {
+		auto dispatcher = dev->getCompletionDispatcher();
+		Metric latency("callback_latency", "none", "us", false);
+		for (uint32_t i = 0; i < iterations * 10 + 1; ++i) {
+			Event evt(Util::CreateUserEvent(dev->context));
+			if (!evt)
+				throw std::runtime_error("clCreateUserEvent failed");
+			std::promise<std::chrono::steady_clock::time_point> called;
+			auto calledTime = called.get_future();
+			dispatcher->dispatch(evt.get(), [&called](cl_int status) {
+				(void) status;
+				called.set_value(std::chrono::steady_clock::now());
+			});
+			auto start = std::chrono::steady_clock::now();
+			evt.setComplete();
+			auto finish = calledTime.get();
+			if (i == 0)
+				continue;
+			latency.samples.push_back(elapsedMs(start, finish) * 1000.0);
+		}
+		metrics.push_back(latency);
+	}
+
+	std::vector<Metric> metrics;
+private:
+	// debayer kernel of path ("Buffer" or "Image") from in to out; the launch
+	// geometry is set in info
+	std::unique_ptr<KernelOCL> debayerKernel(const FrameSize &size,
+			const std::string &path, cl_mem *in, cl_mem *out,
+			EnqueueInfoOCL &info) {
+		cl_uint width = size.width, height = size.height;
+		cl_uint pitch = width, pitchOut = width * bps_out;
+		std::stringstream buildOptions;
+		buildOptions << commonOptions();
+		buildOptions << " -D TILE_ROWS=" << tile_rows;
+		buildOptions << " -D TILE_COLS=" << tile_columns;
+		buildOptions << " -D OUTPUT_CHANNELS=" << bps_out;
+		KernelInitInfoBase initInfoBase(dev, buildOptions.str(), sourceDir,
+				BUILD_BINARY_IN_MEMORY);
+		KernelInitInfo initInfo(initInfoBase, "debayer" + path + ".cl",
+				"debayer" + path, "malvar_he_cutler_demosaic");
+		initInfo.helperPrograms.push_back("helpers.cl");
+		initInfo.helperBuildOptions = commonOptions();
+		auto kernel = std::make_unique<KernelOCL>(initInfo);
+		kernel->setArg<cl_uint>(0, &height);
+		kernel->setArg<cl_uint>(1, &width);
+		kernel->setArg<cl_mem>(2, in);
+		kernel->setArg<cl_uint>(3, &pitch);
+		kernel->setArg<cl_mem>(4, out);
+		kernel->setArg<cl_uint>(5, &pitchOut);
+		cl_int pattern = bayer_pattern;
+		kernel->setArg<cl_int>(6, &pattern);
+		kernel->configureLaunch(info, width, height);
+		info.needsCompletionEvent = true;
+		return kernel;
+	}
+	// options shared by the debayer kernel and its helper library;
+	// the device's own options are added by KernelOCL
+	std::string commonOptions() {
+		std::string options = " -I ./ ";
+		switch (dev->deviceInfo->venderId) {
+		case vendorIdAMD:
+			options += " -D AMD_GPU_ARCH";
+			break;
+		case vendorIdNVD:
+			options += " -D NVIDIA_ARCH";
+			break;
+		default:
+			break;
+		}
+		return options;
+	}
+	DeviceOCL *dev;
+	cl_command_queue_properties queue_props;
+	uint32_t iterations;
+	std::string sourceDir;
+};
+
+int main(int argc, char *argv[]) {
+	CmdLine cmd("latke_bench command line", ' ', "v1.0");
+
+	ValueArg<std::string> deviceTypeArg("t", "device-type",
+			"Device type : gpu, cpu, accelerator or default", false, "gpu",
+			"string", cmd);
+
+	ValueArg<int> platformArg("P", "platform", "Platform index", false, 0, "int",
+			cmd);
+
+	ValueArg<uint32_t> iterationsArg("n", "iterations",
+			"Iterations per frame sized case", false, 10, "uint", cmd);
+
+	ValueArg<std::string> sizesArg("s", "sizes",
+			"Comma separated frame sizes : 1080p, 4K, 8K", false, "1080p,4K,8K",
+			"string", cmd);
+
+	ValueArg<std::string> sourceDirArg("k", "kernel-dir", "Kernel source directory",
+			false, "", "string", cmd);
+
+	ValueArg<std::string> outputArg("o", "output", "JSON output file", false,
+			"latke_bench.json", "string", cmd);
+
+	ValueArg<std::string> baselineArg("B", "baseline",
+			"Baseline JSON to compare against. Exit code is 2 on regression",
+			false, "", "string", cmd);
+
+	ValueArg<double> toleranceArg("x", "tolerance",
+			"Allowed p50 regression, in percent", false, 10.0, "double", cmd);
+
+	ValueArg<double> p99ToleranceArg("y", "p99-tolerance",
+			"Allowed p99 regression, in percent", false, 25.0, "double", cmd);
+
+	ValueArg<uint32_t> p99MinSamplesArg("q", "p99-min-samples",
+			"Samples a metric needs, in this run and in the baseline, for its p99 to be compared",
+			false, 100, "uint", cmd);
+
+	MultiArg<std::string> metricToleranceArg("m", "metric-tolerance",
+			"Allowed p50 and p99 regression of one metric, as name=percent or name@size=percent",
+			false, "string", cmd);
+
+	cmd.parse(argc, argv);
+
+	eDeviceType deviceType = GPU;
+	auto type = deviceTypeArg.getValue();
+	if (type == "cpu")
+		deviceType = CPU;
+	else if (type == "accelerator")
+		deviceType = ACCELERATOR;
+	else if (type == "default")
+		deviceType = DEFAULT;
+	else if (type != "gpu")
+		std::cout << "Unrecognized device type " << type << ". Using gpu."
+				<< std::endl;
+	auto sourceDir = sourceDirArg.getValue();
+	if (!sourceDir.empty() && sourceDir.back() != '/' && sourceDir.back() != '\\')
+		sourceDir += '/';
+
+	// in order profiling queues : each case waits for its own commands
+	cl_command_queue_properties queue_props = CL_QUEUE_PROFILING_ENABLE;
+	auto deviceManager = std::make_shared<DeviceManagerOCL>(true);
+	if (deviceManager->init(platformArg.getValue(), deviceType, 0, false,
+			queue_props) != DeviceSuccess) {
+		std::cerr << "Failed to initialize OpenCL device" << std::endl;
+		return -1;
+	}
+	auto dev = deviceManager->getDevice(0);
+	std::cout << "Device : " << dev->deviceInfo->name << " ("
+			<< dev->deviceInfo->driverVersion << ")" << std::endl;
+
+	Bench bench(dev, queue_props, std::max<uint32_t>(iterationsArg.getValue(), 1),
+			sourceDir);
+	bool failed = false;
+	auto run = [&failed](const std::string &name, std::function<void()> benchCase) {
+		try {
+			benchCase();
+		} catch (std::exception &ex) {
+			std::cerr << name << " failed : " << ex.what() << std::endl;
+			failed = true;
+		}
+	};
+	std::stringstream sizes(sizesArg.getValue());
+	std::string sizeName;
+	while (std::getline(sizes, sizeName, ',')) {
+		auto size = std::find_if(std::begin(frameSizes), std::end(frameSizes),
+				[&sizeName](const FrameSize &s) {
+					return sizeName == s.name;
+				});
+		if (size == std::end(frameSizes)) {
+			std::cerr << "Unrecognized frame size " << sizeName << std::endl;
+			continue;
+		}
+		std::cout << "Running " << size->name << std::endl;
+		run("map/unmap", [&] {
+			bench.mapUnmap(*size);
+		});
+		run("bandwidth", [&] {
+			bench.bandwidth(*size);
+		});
+		run("buffer kernel", [&] {
+			bench.debayer(*size, "Buffer",
+					std::make_unique<DualBufferOCL>(dev,
+							(size_t) size->width * size->height,
+							HostToDeviceBuffer, queue_props),
+					std::make_unique<DualBufferOCL>(dev,
+							(size_t) size->width * size->height * bps_out,
+							DeviceToHostBuffer, queue_props));
+		});
+		run("image kernel", [&] {
+			bench.debayer(*size, "Image",
+					std::make_unique<DualImageOCL>(dev, size->width,
+							size->height, CL_R, CL_UNSIGNED_INT8, true,
+							queue_props),
+					std::make_unique<DualImageOCL>(dev, size->width,
+							size->height, CL_RGBA, CL_UNSIGNED_INT8, false,
+							queue_props));
+		});
+		run("pipeline", [&] {
+			bench.pipeline(*size);
+		});
+	}
+	run("launch overhead", [&] {
+		bench.launchOverhead();
+	});
+	run("callback latency", [&] {
+		bench.callbackLatency();
+	});
+
+	for (auto &m : bench.metrics)
+		std::cout << m.name << " @ " << m.size << " : p50 "
+				<< percentile(m.samples, 50) << " " << m.unit << ", p99 "
+				<< percentile(m.samples, 99) << " " << m.unit << std::endl;
+	std::ofstream out(outputArg.getValue());
+	if (!out) {
+		std::cerr << "Unable to write " << outputArg.getValue() << std::endl;
+		return -1;
+	}
+	writeJson(out, dev, iterationsArg.getValue(), bench.metrics);
+	if (failed)
+		return -1;
+
+	if (baselineArg.isSet()) {
+		std::map<std::string, BaselineMetric> baseline;
+		if (!readBaseline(baselineArg.getValue(), baseline)) {
+			std::cerr << "Unable to read baseline " << baselineArg.getValue()
+					<< std::endl;
+			return -1;
+		}
+		std::map<std::string, double> metricTolerances;
+		for (auto &entry : metricToleranceArg.getValue()) {
+			auto separatorPos = entry.rfind('=');
+			if (separatorPos == std::string::npos) {
+				std::cerr << "Ignoring metric tolerance " << entry << std::endl;
+				continue;
+			}
+			metricTolerances[entry.substr(0, separatorPos)] = atof(
+					entry.substr(separatorPos + 1).c_str());
+		}
+		auto regressions = compareBaseline(bench.metrics, baseline,
+				toleranceArg.getValue(), p99ToleranceArg.getValue(),
+				p99MinSamplesArg.getValue(), metricTolerances);
+		if (regressions) {
+			std::cout << regressions << " regressions against "
+					<< baselineArg.getValue() << std::endl;
+			return 2;
+		}
+		std::cout << "No regressions against " << baselineArg.getValue()
+				<< std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2016-2020 Grok Image Compression Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * latke_precompile
+ *
+ * Build program binaries for every device of every installed OpenCL platform,
+ * and record them in a manifest keyed on binary name, device, driver and
+ * build options. At runtime, KernelOCL loads binaries with LOAD_BINARY
+ * by looking up the same key, so deployments can skip compilation.
+ */
+
+#include <iostream>
+#include <memory>
+#include "latke.h"
+#define TCLAP_NAMESTARTSTRING "-"
+#include "tclap/CmdLine.h"
+using namespace TCLAP;
+
+using namespace ltk;
+
+inline char separator()
+{
+#ifdef _WIN32
+    return '\\';
+#else
+    return '/';
+#endif
+}
+
+static std::string withSeparator(std::string dir) {
+	if (!dir.empty() && dir.back() != separator() && dir.back() != '/')
+		dir += separator();
+	return dir;
+}
+
+// build binary for a single device, with the same options used at runtime
+static bool precompile(cl_platform_id platform, cl_device_id deviceId,
+		const std::string &programFile, const std::string &binaryName,
+		const std::string &sourceDir, const std::string &outputDir,
+		const std::string &buildOptions) {
+	auto deviceInfo = new DeviceInfo();
+	if (deviceInfo->setDeviceInfo(deviceId) != SUCCESS) {
+		delete deviceInfo;
+		return false;
+	}
+	std::cout << "Device : " << deviceInfo->name << " (" << deviceInfo->driverVersion
+			<< ")" << std::endl;
+	cl_context_properties cps[3] = {
+	CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+	cl_int status = CL_SUCCESS;
+	auto context = clCreateContext(cps, 1, &deviceId, NULL, NULL, &status);
+	if (status != CL_SUCCESS) {
+		Util::LogError("Error: clCreateContext returned %s.\n",
+				Util::TranslateOpenCLError(status));
+		delete deviceInfo;
+		return false;
+	}
+	auto arch = ArchFactory::getArchitecture(deviceInfo->venderId);
+	std::unique_ptr<DeviceOCL> device;
+	try {
+		// device takes ownership of context, device info and architecture
+		device.reset(new DeviceOCL(context, true, deviceId, deviceInfo, arch, 0));
+	} catch (std::exception &ex) {
+		return false;
+	}
+	KernelInitInfoBase initInfoBase(device.get(), buildOptions, sourceDir,
+			BUILD_BINARY_OFFLINE);
+	KernelInitInfo initInfo(initInfoBase, programFile, binaryName, "");
+
+	return KernelOCL::generateBinary(initInfo, outputDir);
+}
+
+int main(int argc, char *argv[]) {
+	CmdLine cmd("latke_precompile command line", ' ', "v1.0");
+
+	ValueArg<std::string> programArg("p", "program", "OpenCL program file", true,
+			"", "string", cmd);
+
+	ValueArg<std::string> binaryArg("b", "binary-name", "Binary name", true,
+			"", "string", cmd);
+
+	ValueArg<std::string> sourceDirArg("s", "source-dir", "Program source directory",
+			false, "", "string", cmd);
+
+	ValueArg<std::string> outputDirArg("o", "output-dir", "Binary and manifest output directory",
+			false, "", "string", cmd);
+
+	ValueArg<std::string> optionsArg("O", "build-options",
+			"Program build options. Must match the options used at runtime, excluding device options",
+			false, " -I ./ ", "string", cmd);
+
+	cmd.parse(argc, argv);
+
+	auto sourceDir = withSeparator(sourceDirArg.getValue());
+	auto outputDir = withSeparator(outputDirArg.getValue());
+
+	cl_uint numPlatforms = 0;
+	cl_int status = clGetPlatformIDs(0, NULL, &numPlatforms);
+	if (status != CL_SUCCESS || numPlatforms == 0) {
+		std::cerr << "No OpenCL platforms found" << std::endl;
+		return -1;
+	}
+	std::unique_ptr<cl_platform_id[]> platforms(new cl_platform_id[numPlatforms]);
+	status = clGetPlatformIDs(numPlatforms, platforms.get(), NULL);
+	if (status != CL_SUCCESS) {
+		Util::LogError("Error: clGetPlatformIDs returned %s.\n",
+				Util::TranslateOpenCLError(status));
+		return -1;
+	}
+
+	size_t built = 0, failed = 0;
+	for (cl_uint p = 0; p < numPlatforms; ++p) {
+		char platformName[256];
+		platformName[0] = 0;
+		clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, sizeof(platformName),
+				platformName, NULL);
+		std::cout << "Platform : " << platformName << std::endl;
+
+		cl_uint numDevices = 0;
+		status = clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, NULL,
+				&numDevices);
+		if (status != CL_SUCCESS || numDevices == 0)
+			continue;
+		std::unique_ptr<cl_device_id[]> devices(new cl_device_id[numDevices]);
+		status = clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, numDevices,
+				devices.get(), NULL);
+		if (status != CL_SUCCESS)
+			continue;
+		for (cl_uint d = 0; d < numDevices; ++d) {
+			if (precompile(platforms[p], devices[d], programArg.getValue(),
+					binaryArg.getValue(), sourceDir, outputDir,
+					optionsArg.getValue()))
+				built++;
+			else
+				failed++;
+		}
+	}
+	std::cout << "Built " << built << " binaries, " << failed << " failed"
+			<< std::endl;
+
+	return (failed || !built) ? -1 : 0;
+}